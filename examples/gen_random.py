@@ -12,8 +12,11 @@ Usage examples:
   # generate one hw config and one workload with explicit ranges
   python3 examples/gen_random.py --hw 1 --wl 1 --jobs 100 --min-eng 2 --max-eng 8
 
+  # also write a bootstrap graph per job (for --dag)
+  python3 examples/gen_random.py --hw 1 --wl 1 --dag
+
 Outputs are written to `examples/hw_rand_<i>.cfg` and
-`examples/wl_rand_<i>.txt`.
+`examples/wl_rand_<i>.txt`, plus `examples/wl_rand_<i>.dag` with --dag.
 """
 
 import argparse
@@ -49,10 +52,24 @@ def gen_hw_config(path, num_engines_range=(1, 8), hbm_range=(128, 2048),
     return path
 
 
+def gen_dag_line(job_id, num_boot, max_width=16):
+    # Circuit levels: a bootstrap in one level needs every bootstrap of the
+    # level before it.  Widths vary so that parallelism comes and goes.
+    widths = []
+    left = num_boot
+    while left > 0:
+        w = min(left, random.randint(1, max_width))
+        widths.append(w)
+        left -= w
+    return f"{job_id} levels {' '.join(str(w) for w in widths)}\n"
+
+
 def gen_workload(path, n_jobs=100, max_arrival_us=10000, tenants=4,
                  boot_min=1, boot_max=100, key_min=1, key_max=1024,
                  noise_min=1, noise_max=100, priorities=3,
-                 deadline_prob=0.2, deadline_scale=5.0):
+                 deadline_prob=0.2, deadline_scale=5.0, key_sets=0,
+                 dag_path=None):
+    dag_lines = []
     # Write header for readability (read_workload ignores '#' lines)
     with open(path, 'w') as f:
         f.write('# id tenant arrival_us num_boot key_size_mb noise_budget priority deadline_us\n')
@@ -87,7 +104,19 @@ def gen_workload(path, n_jobs=100, max_arrival_us=10000, tenants=4,
             else:
                 deadline = 0
 
-            f.write(f"{i} {tenant} {arrival} {num_boot} {key_size} {noise} {priority} {deadline}\n")
+            if key_sets > 0:
+                # optional 9th column: explicit key set id shared across jobs
+                key_id = random.randrange(key_sets)
+                f.write(f"{i} {tenant} {arrival} {num_boot} {key_size} {noise} {priority} {deadline} {key_id}\n")
+            else:
+                f.write(f"{i} {tenant} {arrival} {num_boot} {key_size} {noise} {priority} {deadline}\n")
+            if dag_path:
+                dag_lines.append(gen_dag_line(i, num_boot))
+
+    if dag_path:
+        with open(dag_path, 'w') as f:
+            f.write('# id levels width...\n')
+            f.writelines(dag_lines)
 
     return path
 
@@ -106,6 +135,8 @@ def main():
     parser.add_argument('--jobs', type=int, default=100, help='jobs per workload')
     parser.add_argument('--seed', type=int, default=None, help='random seed')
     parser.add_argument('--include-batch', action='store_true', help='include batch_size in hw configs')
+    parser.add_argument('--key-sets', type=int, default=0, help='emit a key_id column drawn from this many key sets')
+    parser.add_argument('--dag', action='store_true', help='write a bootstrap graph per job next to each workload')
 
     args = parser.parse_args()
 
@@ -128,8 +159,12 @@ def main():
     # generate workloads
     for i in range(args.wl):
         name = f'examples/workloads/wl_rand_{i}.txt'
-        gen_workload(name, n_jobs=args.jobs)
+        dag_name = f'examples/workloads/wl_rand_{i}.dag' if args.dag else None
+        gen_workload(name, n_jobs=args.jobs, key_sets=args.key_sets,
+                     dag_path=dag_name)
         print(f'Wrote workload: {name}')
+        if dag_name:
+            print(f'Wrote graphs: {dag_name}')
         generated.append(name)
 
     print('\nDone. To run a generated pair:')
@@ -0,0 +1,165 @@
+/* Shortest-remaining-work-first as a scheduler plugin.
+ *
+ *   make plugins
+ *   ./tfhe_sim --sched-plugin examples/plugins/sjf.so \
+ *              --scheduler fifo --scheduler sjf hw.cfg workload.txt
+ *
+ * Keeps a min-heap of (remaining bootstraps, admission seq, slot).  Entries
+ * are not updated in place: a job gets a fresh entry whenever its remaining
+ * count drops, and stale ones are dropped when they reach the top.  A job
+ * whose keys are still uploading loses its entry at the top and gets a new
+ * one when the upload ends.  Jobs whose keys are not on the device are
+ * queued in a second heap, which picks leave out while SchedContext.uploads
+ * says no upload can start. */
+#include <stdlib.h>
+#include "sched_plugin.h"
+
+typedef struct {
+    int remaining;
+    long long seq;
+    int slot;
+} Entry;
+
+typedef struct {
+    Entry *entries;
+    int len, cap;
+} Heap;
+
+typedef struct {
+    const SchedContext *ctx;
+    Heap keys, no_keys;
+    long long *seq;     // per slot, to spot entries of a reused slot
+    int seq_cap;
+} Sjf;
+
+static int entry_less(const Entry *a, const Entry *b) {
+    if (a->remaining != b->remaining) return a->remaining < b->remaining;
+    return a->seq < b->seq;
+}
+
+static void heap_push(Heap *h, Entry e) {
+    if (h->len == h->cap) {
+        h->cap = h->cap ? 2 * h->cap : 256;
+        h->entries = realloc(h->entries, h->cap * sizeof(Entry));
+    }
+    int i = h->len++;
+    while (i > 0 && entry_less(&e, &h->entries[(i - 1) / 2])) {
+        h->entries[i] = h->entries[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    h->entries[i] = e;
+}
+
+static void heap_pop(Heap *h) {
+    Entry last = h->entries[--h->len];
+    int i = 0;
+    for (;;) {
+        int c = 2 * i + 1;
+        if (c >= h->len) break;
+        if (c + 1 < h->len && entry_less(&h->entries[c + 1], &h->entries[c])) c++;
+        if (!entry_less(&h->entries[c], &last)) break;
+        h->entries[i] = h->entries[c];
+        i = c;
+    }
+    if (h->len > 0) h->entries[i] = last;
+}
+
+/* A fresh entry for the job, in the heap its keys call for. */
+static void sjf_push(Sjf *s, int slot) {
+    int remaining = sched_job_remaining(s->ctx, slot);
+    if (remaining <= 0) return;
+    Heap *h = sched_job_transferred(s->ctx, slot) ? &s->keys : &s->no_keys;
+    heap_push(h, (Entry){ remaining, s->seq[slot], slot });
+}
+
+static int sjf_resize(void *state) {
+    Sjf *s = state;
+    if (s->ctx->cap <= s->seq_cap) return 0;
+    long long *seq = realloc(s->seq, s->ctx->cap * sizeof(long long));
+    if (!seq) return -1;
+    s->seq = seq;
+    s->seq_cap = s->ctx->cap;
+    return 0;
+}
+
+static void *sjf_init(const SchedContext *ctx) {
+    Sjf *s = calloc(1, sizeof(Sjf));
+    if (!s) return NULL;
+    s->ctx = ctx;
+    if (sjf_resize(s) != 0) {
+        free(s);
+        return NULL;
+    }
+    return s;
+}
+
+static void sjf_destroy(void *state) {
+    Sjf *s = state;
+    free(s->keys.entries);
+    free(s->no_keys.entries);
+    free(s->seq);
+    free(s);
+}
+
+static void sjf_arrival(void *state, int slot, long long seq, double now_us) {
+    Sjf *s = state;
+    (void)now_us;
+    s->seq[slot] = seq;
+    sjf_push(s, slot);
+}
+
+static void sjf_bootstrap_done(void *state, int slot, int engine, double now_us) {
+    Sjf *s = state;
+    (void)engine;
+    (void)now_us;
+    sjf_push(s, slot);
+}
+
+static void sjf_transfer_done(void *state, int slot, double now_us) {
+    Sjf *s = state;
+    (void)now_us;
+    sjf_push(s, slot);
+}
+
+/* The top entry of `h` that is still current, or NULL. */
+static const Entry *heap_top(Sjf *s, Heap *h, int with_keys) {
+    while (h->len > 0) {
+        Entry e = h->entries[0];
+        int current = s->seq[e.slot] == e.seq &&
+                      sched_job_remaining(s->ctx, e.slot) == e.remaining &&
+                      sched_job_runnable(s->ctx, e.slot);
+        int keys = sched_job_transferred(s->ctx, e.slot) != 0;
+        if (current && keys == with_keys) return &h->entries[0];
+        heap_pop(h);
+        // the cache had the keys of a job queued without them
+        if (current && !with_keys) heap_push(&s->keys, e);
+    }
+    return NULL;
+}
+
+static int sjf_pick(void *state, double now_us, int idle_engines, int *n_slices) {
+    Sjf *s = state;
+    (void)now_us;
+    (void)idle_engines;
+    (void)n_slices;
+    int uploads = s->ctx->uploads;
+    const Entry *a = uploads != SCHED_UPLOADS_ONLY ? heap_top(s, &s->keys, 1) : NULL;
+    const Entry *b = uploads != SCHED_UPLOADS_CLOSED ? heap_top(s, &s->no_keys, 0) : NULL;
+    if (a && b) return entry_less(b, a) ? b->slot : a->slot;
+    return a ? a->slot : b ? b->slot : -1;
+}
+
+static const SchedulerOps sjf_ops = {
+    .abi = SCHED_PLUGIN_ABI,
+    .name = "sjf",
+    .label = "Shortest Remaining Work",
+    .init = sjf_init,
+    .destroy = sjf_destroy,
+    .on_resize = sjf_resize,
+    .on_arrival = sjf_arrival,
+    .on_transfer_done = sjf_transfer_done,
+    .on_bootstrap_done = sjf_bootstrap_done,
+    .pick_batch = sjf_pick
+};
+
+const SchedulerOps *tfhe_schedulers[] = { &sjf_ops, NULL };
@@ -0,0 +1,78 @@
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include "types.h"
+#include "workload.h"
+#include "simulator.h"
+
+/* Several accelerators behind one host.
+ *
+ * The cluster config has one setting per line, '#' for comments:
+ *
+ *   device          examples/hw/hw1.cfg x4   # four devices with this config
+ *   device          examples/hw/hw2.cfg
+ *   root_pcie_gbps  64       # host root complex shared by all links (0 = none)
+ *   link_latency_us 2        # host-to-device latency, the sync lookahead
+ *   window_us       2        # sync window, at most link_latency_us
+ *   dispatch        key-locality
+ *   locality_slack  1.0      # key-locality: extra jobs per engine tolerated
+ *   pin             3 0      # tenant-pinned: tenant 3 goes to device 0
+ *
+ * Each device runs the usual event loop on its own thread.  The host reads
+ * the trace and hands every job to a device when it arrives; the job
+ * reaches the device link_latency_us later.  Since nothing the host does
+ * can affect a device sooner than that, the devices advance in windows of
+ * window_us without talking to each other (conservative synchronisation)
+ * and meet at every boundary, where the host dispatches the next window's
+ * jobs from the device loads seen there and splits the root complex among
+ * the devices by their active transfers.  Empty stretches are skipped.
+ *
+ * Dispatch policies:
+ *   least-loaded   fewest jobs in flight per engine
+ *   key-locality   the device that last got the job's key (key_id, or the
+ *                  tenant without one) unless it has locality_slack more
+ *                  jobs per engine than the least loaded device
+ *   tenant-pinned  the device from a `pin` line, else tenant % devices
+ *
+ * Device-side times are used throughout, so response times do not include
+ * the link latency. */
+#define CLUSTER_MAX_DEVICES 64
+
+typedef enum {
+    DISPATCH_LEAST_LOADED,
+    DISPATCH_KEY_LOCALITY,
+    DISPATCH_TENANT_PINNED
+} DispatchPolicy;
+
+typedef struct {
+    int n_devices;
+    HwConfig hw[CLUSTER_MAX_DEVICES];
+    double root_pcie_gbps;
+    double link_latency_us;
+    double window_us;
+    DispatchPolicy dispatch;
+    double locality_slack;
+    int *pin;               // device per tenant, -1 = not pinned
+    int n_pin;
+} ClusterConfig;
+
+typedef struct {
+    int n_devices;
+    SimStats *dev;          // per device; n_jobs == 0 for an unused one
+    long long windows;      // sync rounds
+    SimStats total;         // merged; no percentiles or per-tenant tables
+} ClusterStats;
+
+int  read_cluster_config(const char *path, ClusterConfig *c);
+void cluster_config_free(ClusterConfig *c);
+int  dispatch_parse_policy(const char *name, DispatchPolicy *out);
+
+/* Run `ops` on every device over the arrival-sorted trace in `src`.
+ * params->csv_prefix gets a "-devN" suffix per device; counters and
+ * progress output are not supported.  Returns -1 on error. */
+int  run_cluster(const ClusterConfig *c, JobSource *src,
+                 const SchedulerOps *ops, const SimParams *params,
+                 ClusterStats *out);
+void cluster_stats_free(ClusterStats *s);
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include <stdio.h>
+#include "types.h"
+#include "histogram.h"
+#include "sched_plugin.h"
+
+/* Online scheduling: a policy in front of real engines.
+ *
+ * The daemon has no clock and no trace of its own.  The hardware (or
+ * tfhe_sim --replay standing in for it) tells it what happens, one line
+ * per event, each stamped with its time in us:
+ *
+ *   arrive LINE        a job, LINE as in a workload file; its arrival
+ *                      time is the event time
+ *   keys T ID          the keys the daemon asked for job ID are resident
+ *   done T ENGINE      the slice on ENGINE has ended
+ *   stats              report the decision latency so far
+ *   quit               end the session (EOF does too)
+ *   shutdown           end the session and stop listening
+ *
+ * Apart from `quit` and `shutdown`, every line gets the daemon's
+ * decisions, then a line with a single '.' (blank lines get no reply):
+ *
+ *   upload ID          start uploading job ID's keys, answer with `keys`
+ *   assign ENGINE ID   run one bootstrap of job ID on ENGINE
+ *   finished ID        the last bootstrap of job ID has ended
+ *   stats N P50 P90 P99 P99.9   events so far and their decision
+ *                      latency in us
+ *   error MESSAGE      the line was not understood and was ignored
+ *
+ * Engines are numbered from 0 to num_engines - 1 of the hw config, and
+ * every engine starts idle.  Decisions follow the simulator's assignment
+ * round: a job gets up to batch_size engines per pick, never more than it
+ * has bootstraps not yet running, and at most num_engines uploads are in
+ * flight.  With pcie_gbps 0 keys are taken to be resident.
+ *
+ * The decision latency of a line is the time from having read it to
+ * having formatted the reply, so it leaves out the transport both ways. */
+
+typedef struct {
+    long long lines;            // events handled
+    long long decisions;        // assign and upload lines sent
+    Histogram latency_us;       // per event
+} DaemonStats;
+
+/* One session over `in` and `out` with a fresh instance of `ops`.
+ * Returns 1 after `shutdown`, 0 at the end of the session, -1 if the
+ * policy could not be started.  `stats` may be NULL. */
+int daemon_session(const HwConfig *cfg, const SchedulerOps *ops,
+                   const void *sched_arg, FILE *in, FILE *out,
+                   DaemonStats *stats);
+
+/* Serve sessions on stdin/stdout (path "-", one session) or on a Unix
+ * socket at `path`, one client at a time until a client sends
+ * `shutdown`.  Returns 0, or -1 if the socket could not be set up. */
+int daemon_serve(const HwConfig *cfg, const SchedulerOps *ops,
+                 const void *sched_arg, const char *path);
+
+/* Drive a daemon as the hardware would: feed it the jobs of `jobs` at
+ * their arrival times and model the engines and the PCIe link from `cfg`
+ * with the simulator's static costs, uploads one after another.  `path`
+ * is the daemon's socket, or "-" to run a daemon session for `ops` in a
+ * child process over pipes.  Prints the run and the decision latency,
+ * both as the daemon measured it and as the round trip seen from here.
+ * Returns 0, or -1 on a protocol or connection error. */
+int daemon_replay(const HwConfig *cfg, const SchedulerOps *ops,
+                  const void *sched_arg, const char *path,
+                  const TfheJob *jobs, int n_jobs);
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef DAG_H
+#define DAG_H
+
+#include "types.h"
+
+/* Bootstrap dependency graphs.
+ *
+ * By default a job's bootstraps are independent, so any number of them
+ * can run at once.  A graph file gives jobs the shape of their circuit:
+ * a bootstrap is released only once every bootstrap it depends on has
+ * finished (key-switches and linear ops in between are folded into the
+ * edge).  One job per line, '#' starts a comment:
+ *
+ *     ID levels W0 W1 ...      W0 bootstraps, then W1 that each need all
+ *                              of the first level, and so on
+ *     ID edges N A>B ...       N bootstraps numbered from 0; B needs A
+ *
+ * A job's graph must hold exactly its num_bootstraps.  Jobs without a
+ * line keep independent bootstraps.
+ *
+ * The level of a bootstrap is the number of bootstraps on the longest
+ * chain from it to the end of its job, itself included.  A job's released
+ * bootstraps are issued highest level first, as in HLFET list
+ * scheduling. */
+typedef struct {
+    int n_nodes;            // 0 = no graph
+    int *level;
+    int *n_preds;
+    int *succ_off;          // successors of v: succ[succ_off[v] .. succ_off[v + 1])
+    int *succ;
+} JobDag;
+
+typedef struct JobDagSet JobDagSet;
+
+JobDagSet *dag_set_load(const char *path);     // NULL with a message
+void dag_set_free(JobDagSet *s);
+
+/* The graph of job `job_id`, NULL if it has none. */
+const JobDag *dag_set_find(const JobDagSet *s, int job_id);
+
+/* 0 if every graph matches its job's bootstrap count, otherwise -1 with
+ * a message. */
+int  dag_set_check(const JobDagSet *s, const TfheJob *jobs, int n_jobs);
+
+/* One run of a job through its graph. */
+typedef struct {
+    const JobDag *dag;
+    int *preds_left;        // per bootstrap, unfinished predecessors
+    int *ready;             // released, not issued; max-heap on level
+    int n_ready;
+} DagRun;
+
+int  dag_run_init(DagRun *r, const JobDag *dag);
+void dag_run_free(DagRun *r);
+
+/* Issue the released bootstrap with the highest level, -1 if none. */
+int  dag_run_take(DagRun *r);
+/* Bootstrap `node` finished; release the successors it was holding. */
+void dag_run_done(DagRun *r, int node);
+
+/* Level of the best released bootstrap, 0 when none is released. */
+static inline int dag_run_path(const DagRun *r) {
+    return r->n_ready > 0 ? r->dag->level[r->ready[0]] : 0;
+}
+
+#endif
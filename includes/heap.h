@@ -0,0 +1,36 @@
+#ifndef HEAP_H
+#define HEAP_H
+
+/* Indexed binary heap over integer item ids.
+ *
+ * Every id in [0, cap) has at most one entry; pushing an id that is
+ * already queued updates its key in place.  Ties on the key are broken
+ * by tie[id] when a tie array is set, then by the lower id, so that pop
+ * order is fully deterministic. */
+typedef struct {
+    int *slots;     // heap array of item ids
+    int *pos;       // pos[id] = slot in heap, -1 when not queued
+    double *key;    // key[id]
+    const long long *tie; // optional secondary order, owned by the caller
+    int len;
+    int cap;        // number of addressable ids
+    int is_max;     // 1 = max-heap, 0 = min-heap
+} IndexedHeap;
+
+int  iheap_init(IndexedHeap *h, int cap, int is_max);
+void iheap_free(IndexedHeap *h);
+int  iheap_reserve(IndexedHeap *h, int cap);
+
+void iheap_push(IndexedHeap *h, int id, double key);
+void iheap_remove(IndexedHeap *h, int id);
+int  iheap_pop(IndexedHeap *h);
+
+static inline int iheap_top(const IndexedHeap *h) {
+    return h->len > 0 ? h->slots[0] : -1;
+}
+
+static inline int iheap_contains(const IndexedHeap *h, int id) {
+    return id >= 0 && id < h->cap && h->pos[id] >= 0;
+}
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+
+/* Log-linear (HDR-style) streaming histogram over non-negative values.
+ *
+ * Every power of two between 2^HIST_MIN_EXP and 2^HIST_MAX_EXP is split
+ * into HIST_SUB_BUCKETS equal buckets, so a quantile is reported to
+ * within 1/(2 * HIST_SUB_BUCKETS) relative error using a fixed 8 KB of
+ * counters, however many values are added.  Values outside the range
+ * land in the first or last bucket; the exact min and max are kept too
+ * and quantiles are clamped to them. */
+#define HIST_SUB_BUCKETS 32
+#define HIST_MIN_EXP     (-20)      // ~1e-6
+#define HIST_MAX_EXP     44         // ~1.8e13 (us: about 200 days)
+#define HIST_BUCKETS     ((HIST_MAX_EXP - HIST_MIN_EXP) * HIST_SUB_BUCKETS)
+
+typedef struct {
+    uint32_t counts[HIST_BUCKETS];
+    uint64_t total;
+    double min;
+    double max;
+} Histogram;
+
+void   hist_init(Histogram *h);
+void   hist_add(Histogram *h, double v);
+/* Value at quantile q in [0, 1]; 0 for an empty histogram. */
+double hist_quantile(const Histogram *h, double q);
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef HPS_KERNEL_H
+#define HPS_KERNEL_H
+
+/* Batch HPS scoring over structure-of-arrays columns.
+ *
+ * Four of the five HPS terms do not depend on time, so they are folded
+ * into per-job constants once, when a job is admitted.  Only the deadline
+ * term has to be recomputed at every pick:
+ *
+ *   score = ((head + w_deadline * pressure(deadline - now)) + fair) + bw
+ *
+ * The additions run in the same order as the scalar scorer in
+ * scheduler.c, and neither kernel fuses multiply-adds, so every kernel
+ * produces bit-identical scores. */
+
+/* Deadline slack is clamped to [0, HPS_SLACK_CAP_US] before scoring, so a
+ * job's score only moves while its deadline is less than this far away. */
+#define HPS_SLACK_CAP_US 20000.0
+
+typedef struct {
+    double *head;       // w_key_affinity * affinity + w_noise_urgency * urgency
+    double *fair;       // w_fairness * fairness
+    double *bw;         // w_bw_penalty * bandwidth penalty
+    double *deadline;   // deadline_us
+    int *slot;          // job table slot of each row
+    int len;
+    int cap;
+} HpsColumns;
+
+int  hps_columns_reserve(HpsColumns *c, int cap);
+void hps_columns_free(HpsColumns *c);
+
+/* Write the score of every row at `now_us` to out[0 .. c->len). */
+typedef void (*HpsScoreFn)(const HpsColumns *c, double w_deadline,
+                           double now_us, double *out);
+
+void hps_score_scalar(const HpsColumns *c, double w_deadline,
+                      double now_us, double *out);
+
+/* The widest kernel this CPU runs (AVX2 on x86-64 when available), or the
+ * scalar one when HPS_NO_SIMD is set in the environment. */
+HpsScoreFn  hps_score_kernel(void);
+const char *hps_score_kernel_name(void);
+
+#endif
@@ -5,4 +5,29 @@
 
 int read_hw_config(const char *path, HwConfig *cfg);
 
+/* Per-bootstrap cost models.
+ *
+ * HW_COST_STATIC (bootstrap_time_us) gives every engine a fixed
+ * 1/num_engines share of HBM bandwidth for the whole run and has no
+ * compute term.
+ *
+ * HW_COST_ROOFLINE takes the larger of a compute time and a memory time.
+ * The compute time is HW_CYCLES_PER_KEY_MB cycles per MB of bootstrapping
+ * key at freq_ghz.  The memory time is the key streamed from HBM, with the
+ * bandwidth split over the key streams active when the slice starts.  The
+ * slices of one batch run on the same key and share a single stream. */
+typedef enum {
+    HW_COST_STATIC,
+    HW_COST_ROOFLINE
+} HwCostModel;
+
+// external-product work per MB of bootstrapping key, on one engine
+#define HW_CYCLES_PER_KEY_MB 30000.0
+
+int hw_cost_parse_model(const char *name, HwCostModel *out);
+
+/* One bootstrap on a key of key_mb with `streams` key streams on HBM
+ * (itself included), under HW_COST_ROOFLINE. */
+double hw_roofline_us(const HwConfig *cfg, double key_mb, int streams);
+
 #endif
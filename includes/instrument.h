@@ -0,0 +1,82 @@
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+#include <stdint.h>
+#include <time.h>
+#include "types.h"
+#include "scheduler.h"
+
+/* Opt-in event-loop instrumentation.
+ *
+ * A run fills a SimCounters when SimParams.counters points at one and
+ * leaves the hot path untouched otherwise.  Phase timers read the TSC on
+ * x86 and a monotonic nanosecond clock elsewhere; ticks_per_us converts
+ * either to time using the run's own wall clock. */
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define INSTR_CLOCK "tsc"
+static inline uint64_t instr_ticks(void) { return __rdtsc(); }
+#else
+#define INSTR_CLOCK "ns"
+static inline uint64_t instr_ticks(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+#endif
+
+typedef enum {
+    SIM_PHASE_EVENT_SEARCH,     // popping the next event off the queue
+    SIM_PHASE_TRANSFERS,        // PCIe progress, completions, next deadline
+    SIM_PHASE_ARRIVALS,
+    SIM_PHASE_COMPLETIONS,      // engine completions
+    SIM_PHASE_ASSIGN,           // dispatch, excluding the scheduler itself
+    SIM_PHASE_PICK,             // scheduler calls
+    SIM_PHASE_FAST_FORWARD,
+    SIM_PHASES
+} SimPhase;
+
+typedef struct {
+    /* events by type */
+    long long loop_iterations;
+    long long arrivals;
+    long long engine_completions;   // bootstrap slices finished
+    long long pcie_completions;
+    long long ff_slices;            // slices issued by fast-forward
+
+    /* scheduler */
+    long long sched_calls;
+    long long sched_empty;          // calls that found nothing ready
+    long long wasted_picks;         // picked a job still waiting on PCIe
+    long long transfers_started;
+    long long key_waits;            // picks parked on a key being uploaded
+    SchedCounters sched;
+
+    /* engines */
+    long long idle_intervals;       // gaps between two slices on one engine
+    double idle_us;
+
+    /* PCIe bookkeeping */
+    long long transfer_scans;       // PCIe link steps: submits, setups, completions
+
+    uint64_t phase_ticks[SIM_PHASES];
+    uint64_t total_ticks;
+    double wall_us;
+} SimCounters;
+
+/* Charge the ticks since *mark to phase `p` and move the mark. */
+static inline void instr_phase(SimCounters *c, SimPhase p, uint64_t *mark) {
+    uint64_t t = instr_ticks();
+    c->phase_ticks[p] += t - *mark;
+    *mark = t;
+}
+
+const char *sim_phase_name(SimPhase p);
+
+/* Write one JSON document with the stats and counters of `n` runs.
+ * Returns -1 if the file cannot be written. */
+int instrument_write_report(const char *path, const char *const *labels,
+                            const SimStats *stats, const SimCounters *ctr,
+                            int n);
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef KEY_CACHE_H
+#define KEY_CACHE_H
+
+#include <stdio.h>
+
+/* Resident-key cache sized by HwConfig.key_mem_mb.
+ *
+ * Keys are identified by a 64-bit id (see key_cache_job_key).  An entry is
+ * pinned while any job using it is in flight; only unpinned, fully loaded
+ * entries are evicted, in the order given by the policy:
+ *   LRU  - least recently used
+ *   LFU  - fewest uses
+ *   GDSF - Greedy-Dual-Size-Frequency, priority L + uses / size_mb, so
+ *          large rarely-used keys go first */
+typedef enum { KEY_EVICT_LRU, KEY_EVICT_LFU, KEY_EVICT_GDSF } KeyEvictPolicy;
+
+/* How jobs without an explicit key_id map to key sets. */
+typedef enum { KEY_SHARE_JOB, KEY_SHARE_TENANT } KeySharing;
+
+/* Outcome of key_cache_acquire */
+enum {
+    KEY_HIT,        // resident, no transfer needed
+    KEY_LOADING,    // another job's upload of this key is in flight
+    KEY_MISS,       // space reserved, caller uploads then calls _loaded
+    KEY_BYPASS      // cannot be cached (pinned or too large), upload uncached
+};
+
+typedef struct {
+    long hits;          // includes hits on in-flight uploads
+    long misses;        // includes bypasses
+    long bypasses;
+    long evictions;
+    double evicted_mb;
+} KeyCacheStats;
+
+typedef struct KeyCache KeyCache;
+
+KeyCache *key_cache_create(double capacity_mb, KeyEvictPolicy policy);
+void key_cache_destroy(KeyCache *kc);
+
+/* Pin the entry for `key` and report via *status how it must be loaded.
+ * An entry loaded for fewer MB than `size_mb` is a miss: it is reloaded at
+ * the larger size, or bypassed while other jobs hold it.  Returns the
+ * entry id, or -1 for KEY_BYPASS.  Ids of entries that are neither
+ * resident nor pinned are reused for other keys. */
+int  key_cache_acquire(KeyCache *kc, long long key, double size_mb, int *status);
+void key_cache_loaded(KeyCache *kc, int entry);
+/* Whether acquiring `key` for `size_mb` now would find it resident, loaded
+ * or loading.  Pins nothing and counts nothing. */
+int  key_cache_resident(const KeyCache *kc, long long key, double size_mb);
+void key_cache_release(KeyCache *kc, int entry);
+
+KeyCacheStats key_cache_stats(const KeyCache *kc);
+
+/* Write every entry, pins included, to `f`, and read them back into a new
+ * cache; entry ids are kept.  The capacity and the eviction policy stay
+ * those the cache was created with.  0 on success. */
+int key_cache_save(const KeyCache *kc, FILE *f);
+int key_cache_load(KeyCache *kc, FILE *f);
+
+/* Key id used by a job: its explicit key_id when set, otherwise one key
+ * set per tenant or per job depending on `sharing`. */
+long long key_cache_job_key(int key_id, int tenant_id, long long job_seq,
+                            KeySharing sharing);
+
+int key_cache_parse_policy(const char *name, KeyEvictPolicy *out);
+int key_cache_parse_sharing(const char *name, KeySharing *out);
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef KS_PIPE_H
+#define KS_PIPE_H
+
+/* Key-switch stage behind the bootstrap engines.
+ *
+ * Every bootstrap ends with a key-switch back to the LWE key of the
+ * ciphertexts.  With key-switch units in hw.cfg that work leaves the
+ * engines: a finished blind rotation is handed to the stage and the
+ * engine is free for its next slice, while the bootstrap itself only
+ * counts as done once its key-switch has come out of the stage.
+ *
+ * The stage has `units` pipelined units.  A key-switch takes latency_us
+ * on a unit and a unit accepts a new one every latency_us / depth.  Work
+ * a unit cannot take at once waits in a FIFO queue of queue_cap entries
+ * shared by all units; when that is full the stage refuses the hand-off
+ * and the engine has to hold its result, stalled, until a place frees. */
+typedef struct {
+    int job;                // slot
+    int node;               // graph node (dag.h), -1 = none
+    int engine;             // the engine that ran the bootstrap
+} KsOp;
+
+typedef struct {
+    long long done;         // key-switches finished
+    double issue_us;        // unit time taken: latency / depth per key-switch
+    double queue_wait_us;   // summed over key-switches, queue to unit
+    int max_queue;
+} KsPipeStats;
+
+typedef struct KsPipe KsPipe;
+
+KsPipe *ks_pipe_create(int units, double latency_us, int depth, int queue_cap);
+void ks_pipe_destroy(KsPipe *p);
+
+/* Hand `op` to the stage at now_us (after advancing to it).  0 when the
+ * queue is full and the stage did not take it. */
+int  ks_pipe_offer(KsPipe *p, KsOp op, double now_us);
+
+/* Move the stage to now_us.  Key-switches finished by then are queued
+ * for ks_pipe_pop_done in completion order; pop them all before the
+ * stage moves again. */
+void ks_pipe_advance(KsPipe *p, double now_us);
+int  ks_pipe_pop_done(KsPipe *p, KsOp *op);    // 0 when none is left
+
+/* When the next key-switch finishes or starts, DBL_MAX if never. */
+double ks_pipe_next_event(const KsPipe *p);
+
+/* Key-switches taken and not yet finished. */
+int  ks_pipe_pending(const KsPipe *p);
+KsPipeStats ks_pipe_stats(const KsPipe *p);
+
+#endif
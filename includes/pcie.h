@@ -0,0 +1,51 @@
+#ifndef PCIE_H
+#define PCIE_H
+
+#include <stdio.h>
+
+/* Processor-sharing model of the host-to-device PCIe link.
+ *
+ * Every transfer on the link gets an equal share of its bandwidth.  The
+ * link keeps a virtual clock: the number of bits each transfer on it has
+ * moved so far, which advances at rate / n_on_link bits per us.  A
+ * transfer of S bits that gets on the link at virtual time V0 finishes when
+ * the clock reaches V0 + S.  That tag never changes, so transfers are kept
+ * in a min-heap of tags: submitting one and finding the next completion
+ * cost O(log n), and nothing walks the transfers as time passes.
+ *
+ * A transfer first spends setup_us in setup (descriptor fetch, doorbell)
+ * without using bandwidth.  At most dma_depth transfers (0 = no limit) are
+ * in setup or on the link at once; the rest wait in submission order. */
+typedef struct PcieLink PcieLink;
+
+PcieLink *pcie_link_create(double bits_per_us, int dma_depth, double setup_us);
+void pcie_link_destroy(PcieLink *l);
+/* Make room for transfer ids in [0, cap). */
+int  pcie_link_reserve(PcieLink *l, int cap);
+
+/* Change the link bandwidth from now_us on. */
+void pcie_link_set_rate(PcieLink *l, double now_us, double bits_per_us);
+
+/* Move the link to now_us.  Transfers finished by then are queued for
+ * pcie_link_pop_done in completion order. */
+void pcie_link_advance(PcieLink *l, double now_us);
+int  pcie_link_pop_done(PcieLink *l);  // -1 when none is left
+
+/* Start uploading `bits` for id at now_us (after advancing to it). */
+void pcie_link_submit(PcieLink *l, int id, double bits, double now_us);
+
+/* When the next transfer finishes or ends its setup, DBL_MAX if never. */
+double pcie_link_next_event(const PcieLink *l);
+
+/* Transfers submitted and not yet finished. */
+int  pcie_link_pending(const PcieLink *l);
+/* Setups, completions and waits handled so far. */
+long long pcie_link_steps(const PcieLink *l);
+
+/* Write the transfers and the link clock to `f`, and read them back into
+ * an idle link reserved for the same ids.  The rate, DMA depth and setup
+ * time stay those the link was created with.  0 on success. */
+int  pcie_link_save(const PcieLink *l, FILE *f);
+int  pcie_link_load(PcieLink *l, FILE *f);
+
+#endif
@@ -0,0 +1,128 @@
+#ifndef SCHED_PLUGIN_H
+#define SCHED_PLUGIN_H
+
+#include "types.h"
+#include "scheduler.h"
+
+/* Scheduler interface.
+ *
+ * A policy is a table of callbacks driven by the event loop.  init()
+ * creates the policy's state for one run; every other callback gets that
+ * state back.  The SchedContext passed to init() stays valid until
+ * destroy() and is updated in place when the job table grows, so a policy
+ * keeps the pointer and reads jobs through it.
+ *
+ * Jobs live in table slots.  A slot holds one job from on_arrival() until
+ * the job has finished; in --stream runs the slot is then reused for a
+ * later arrival with a higher seq.  ctx->jobs[slot] is the job as it
+ * arrived and is never updated; read its run state through the sched_job_*
+ * accessors below.  Slots with no remaining bootstraps never hold a
+ * runnable job.
+ *
+ * Shared libraries export a NULL-terminated array
+ *
+ *     const SchedulerOps *tfhe_schedulers[] = { &my_policy, NULL };
+ *
+ * and are loaded with --sched-plugin PATH (see sched_registry.h).  A
+ * plugin built against a different SCHED_PLUGIN_ABI is rejected. */
+#define SCHED_PLUGIN_ABI 2
+#define SCHED_PLUGIN_SYMBOL "tfhe_schedulers"
+
+/* What a pick may return as to keys (SchedContext.uploads, uploads.h).
+ * Picking a job whose keys are not on the device starts its upload. */
+enum {
+    SCHED_UPLOADS_CLOSED,       // jobs with their keys only
+    SCHED_UPLOADS_OPEN,         // any job
+    SCHED_UPLOADS_ONLY          // jobs without their keys only: no engines
+                                // are idle, the pick just starts an upload
+};
+
+typedef struct {
+    const HwConfig *cfg;
+    const HpsWeights *weights;
+    const TfheJob *jobs;        // indexed by slot, read-only input fields
+    const JobHot *hot;          // indexed by slot, run state
+    int n_slots;                // slots in use, [0, n_slots)
+    int cap;                    // slots allocated
+    const void *arg;            // policy argument (--scheduler NAME:ARG), or NULL
+    SchedCounters *counters;    // NULL unless the run is instrumented
+    const int *path;            // indexed by slot, NULL unless the run has graphs
+    int uploads;                // SCHED_UPLOADS_*, during pick_batch
+} SchedContext;
+
+/* Run state of the job in `slot`.  Both tables move when the table grows,
+ * so go through the context rather than keeping the pointers. */
+static inline int sched_job_remaining(const SchedContext *ctx, int slot) {
+    return ctx->hot[slot].remaining_bootstraps;
+}
+
+/* 0 = keys not on the device, -1 = upload in flight, 1 = uploaded. */
+static inline int sched_job_transferred(const SchedContext *ctx, int slot) {
+    return ctx->hot[slot].pcie_transferred;
+}
+
+static inline double sched_job_bootstrap_us(const SchedContext *ctx, int slot) {
+    return ctx->hot[slot].bootstrap_us;
+}
+
+/* Whether the job can take an engine now: it has bootstraps left, its keys
+ * are not on their way, its graph (dag.h) has one released, and not all of
+ * them are waiting on key-switch units (ks_pipe.h). */
+static inline int sched_job_runnable(const SchedContext *ctx, int slot) {
+    const JobHot *h = &ctx->hot[slot];
+    return h->remaining_bootstraps > 0 && h->pcie_transferred >= 0 && !h->blocked;
+}
+
+/* Bootstraps on the longest chain starting at the job's best released
+ * bootstrap: its level in the job's graph, 1 for a job without one. */
+static inline int sched_job_path(const SchedContext *ctx, int slot) {
+    if (ctx->path) return ctx->path[slot];
+    return ctx->hot[slot].remaining_bootstraps > 0;
+}
+
+typedef struct SchedulerOps {
+    int abi;                    // SCHED_PLUGIN_ABI
+    const char *name;           // for --scheduler and CSV file names
+    const char *label;          // heading in reports; NULL = name
+
+    /* Per-run state, NULL on failure. */
+    void *(*init)(const SchedContext *ctx);
+    void  (*destroy)(void *state);
+
+    /* ctx->jobs, ctx->hot or ctx->cap changed; grow per-slot arrays.
+     * Optional. */
+    int   (*on_resize)(void *state);
+
+    void  (*on_arrival)(void *state, int slot, long long seq, double now_us);
+    /* The job's keys are on the device and it may get engines.  Optional,
+     * but a policy without it has to notice the change in pick_batch. */
+    void  (*on_transfer_done)(void *state, int slot, double now_us);
+    /* One bootstrap slice ended on `engine` (with key-switch units, its
+     * key-switch has since finished too); the job is finished when
+     * sched_job_remaining() has reached 0.  It may also have released
+     * bootstraps of the job's graph.  Optional. */
+    void  (*on_bootstrap_done)(void *state, int slot, int engine, double now_us);
+
+    /* Next job to give engines to, or -1.  Called repeatedly while engines
+     * are idle.  *n_slices comes in as 0 (batch_size, capped by the job's
+     * remaining bootstraps and the idle engines); a policy may set it to
+     * issue fewer or more slices, within the same caps, and for a job with
+     * a graph also capped by its released bootstraps.  A job that is not
+     * sched_job_runnable() gets no engines: picking it ends the round, so
+     * pass it over for one that can run.  Picking a job whose keys are not
+     * on the device (sched_job_transferred() == 0) starts its upload, and
+     * ctx->uploads says whether the round allows that: under
+     * SCHED_UPLOADS_CLOSED such a job ends the round too, and under
+     * SCHED_UPLOADS_ONLY only such a job does anything. */
+    int   (*pick_batch)(void *state, double now_us, int idle_engines,
+                        int *n_slices);
+
+    /* Optional.  Time until which pick_batch cannot change its answer
+     * except through arrivals or jobs finishing.  Providing it lets the
+     * loop fast-forward steady bootstrap chains, during which slices are
+     * issued with the default batch rule and on_bootstrap_done is not
+     * called for the collapsed slices (the job cannot finish inside). */
+    double (*stable_until)(void *state, double now_us);
+} SchedulerOps;
+
+#endif
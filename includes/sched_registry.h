@@ -0,0 +1,33 @@
+#ifndef SCHED_REGISTRY_H
+#define SCHED_REGISTRY_H
+
+#include <stdio.h>
+#include "sched_plugin.h"
+
+/* Built-in policies, backed by the incremental ready set, critical path
+ * first for jobs with bootstrap graphs (dag.h), and earliest deadline and
+ * least laxity first for jobs with deadlines. */
+extern const SchedulerOps sched_fifo_ops;
+extern const SchedulerOps sched_hps_ops;
+extern const SchedulerOps sched_cp_ops;
+extern const SchedulerOps sched_edf_ops;
+extern const SchedulerOps sched_llf_ops;
+
+/* Process-wide table of policies by name.  It holds the built-ins from
+ * the start; fill it before starting runs, it is not locked. */
+const SchedulerOps *sched_registry_find(const char *name);
+/* -1 (with a message) on a duplicate name or an ABI mismatch. */
+int  sched_registry_add(const SchedulerOps *ops);
+/* dlopen `path` and add every policy in its SCHED_PLUGIN_SYMBOL array.
+ * Returns the number added, -1 on error. */
+int  sched_registry_load(const char *path);
+void sched_registry_list(FILE *f);
+
+/* Resolve NAME or NAME:ARG.  A name that is not registered but looks like
+ * a path (contains '/' or ends in ".so") is loaded first and its first
+ * policy is used.  *arg points into `spec` after the ':' (NULL without
+ * one) and must be copied if `spec` goes away. */
+const SchedulerOps *sched_registry_resolve(const char *spec, char *name_buf,
+                                           size_t name_len, const char **arg);
+
+#endif
@@ -3,16 +3,75 @@
 
 #include "types.h"
 
+/* HPS scoring weights */
+typedef struct {
+    double key_affinity;
+    double noise_urgency;
+    double bw_penalty;
+    double fairness;
+    double deadline;
+} HpsWeights;
+
+#define HPS_DEFAULT_WEIGHTS { 3.0, 4.0, 2.0, 1.5, 2.0 }
+
 int pick_job_fifo(const HwConfig *cfg, TfheJob *jobs, int n_jobs, double now_us);
 int pick_job_hps(const HwConfig *cfg, TfheJob *jobs, int n_jobs, double now_us);
 
+/* Incremental ready-set index for the built-in policies.  Jobs are
+ * admitted when they arrive and retired when they finish, so a pick costs
+ * O(log ready) instead of a walk over the whole job array.  Picks match
+ * pick_job_fifo / pick_job_hps exactly; ties go to the lower admission
+ * sequence number, which is the job index when jobs are admitted with
+ * seq = index.
+ *
+ * A job whose keys are still being uploaded (JobHot.pcie_transferred < 0),
+ * or whose released bootstraps are all running (JobHot.blocked), is never
+ * picked.  The pick that finds one parks it, and the best job that can run
+ * is returned instead; ready_set_unpark() puts it back once the upload is
+ * done or a bootstrap of it finishes.  Jobs whose keys are not on the
+ * device at all wait in a pool of their own, and `uploads`
+ * (SCHED_UPLOADS_*, sched_plugin.h) says which pools a pick may draw
+ * from, as picking such a job starts its upload. */
+typedef enum { READY_FIFO, READY_HPS } ReadyKind;
+typedef struct ReadySet ReadySet;
+
+/* Work done inside the scheduler, filled when instrumentation is on. */
+typedef struct {
+    long long examined;     // jobs looked at to make a pick
+    long long rescored;     // HPS scores recomputed at pick time
+    long long stale;        // stale CP keys pushed again
+    long long phase_moves;  // HPS jobs moved between phases by timers
+    long long parked;       // jobs set aside while they could not run
+} SchedCounters;
+
+ReadySet *ready_set_create(ReadyKind kind, const HwConfig *cfg,
+                           const HpsWeights *w,
+                           const TfheJob *jobs, const JobHot *hot,
+                           int n_jobs);
+/* Rebind to (possibly moved) job tables with room for `cap` slots. */
+int  ready_set_reserve(ReadySet *rs, const TfheJob *jobs, const JobHot *hot,
+                       int cap);
+void ready_set_destroy(ReadySet *rs);
+void ready_set_admit(ReadySet *rs, int j, long long seq, double now_us);
+void ready_set_retire(ReadySet *rs, int j);
+void ready_set_unpark(ReadySet *rs, int j, double now_us);
+int  ready_set_pick(ReadySet *rs, double now_us, int uploads);
+/* Count pick work into `c` (NULL to stop). */
+void ready_set_set_counters(ReadySet *rs, SchedCounters *c);
+
+/* Time until which picks can only change through arrivals or jobs
+ * finishing (now_us when the ordering may drift at any moment). */
+double ready_set_stable_until(const ReadySet *rs, double now_us);
+
 double bootstrap_time_us(const HwConfig *cfg, const TfheJob *job);
 
-/* Allow tuning HPS scoring weights at runtime. */
+/* Allow tuning HPS scoring weights at runtime.  These are the weights the
+ * stateless pick_job_hps uses and the defaults for new SimParams. */
 void scheduler_set_weights(double w_key_affinity,
 						   double w_noise_urgency,
 						   double w_bw_penalty,
 						   double w_fairness,
 						   double w_deadline);
+HpsWeights scheduler_get_weights(void);
 
 #endif
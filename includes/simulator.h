@@ -2,21 +2,211 @@
 #define SIMULATOR_H
 
 #include "types.h"
+#include "scheduler.h"
+#include "key_cache.h"
+#include "workload.h"
+#include "timeline.h"
+#include "instrument.h"
+#include "sched_plugin.h"
+#include "histogram.h"
+#include "hw_config.h"
+#include "dag.h"
+
+#define SIM_DEFAULT_OUT_DIR "examples/results"
 
 
 typedef int (*SchedulerFn)(const HwConfig *, TfheJob *, int, double);
 
+/* What a device reports at a cluster window boundary. */
+typedef struct {
+    double now_us;
+    double next_event_us;       // DBL_MAX when the device has nothing queued
+    int active_transfers;
+    long long in_flight;        // taken from the source and not finished
+} SimDeviceState;
+
+/* Conservative synchronisation for one device of a cluster (cluster.h).
+ * The run never processes an event at or past window_end_us: it settles
+ * its PCIe transfers up to the boundary and calls wait(), which returns
+ * once the coordinator has queued the jobs that reach the device before
+ * the next boundary and moved window_end_us forward.  Between windows the
+ * coordinator may also change the device's cfg->pcie_bandwidth_gbps (so
+ * each device needs its own HwConfig).  Once `closed` is set the run goes
+ * on to the end of its source without stopping. */
+typedef struct SimSync {
+    double window_end_us;
+    int closed;
+    void (*wait)(struct SimSync *sync, const SimDeviceState *state);
+} SimSync;
+
+/* Snapshots of a run over a preloaded trace.
+ *
+ * run_simulation_snapshot handles every event up to a chosen time and
+ * writes the run's state there: the job table, the engines, the PCIe
+ * transfers in flight, the key cache and the arrival cursor.  A run with
+ * SimParams.restore set starts from that state instead of time zero.  It
+ * must use the same trace, engine count and key cache mode.  The policy,
+ * weights, PCIe and cost model may all differ, so one warm-up can be
+ * forked into many what-if runs.  A loaded snapshot is read-only and can
+ * be shared by runs on different threads.
+ *
+ * The policy's own state is not saved.  At the snapshot time the restored
+ * policy is told about every admitted, unfinished job, in arrival order,
+ * through on_arrival(), and through on_transfer_done() for jobs whose
+ * keys are on the device.  This puts the built-in policies where a
+ * continuous run would have them.  A plugin that keeps history of its own
+ * starts that history afresh.  Prefetch accounting and instrumentation
+ * start at the snapshot, and the engine timeline holds only the slices
+ * issued after it. */
+typedef struct SimSnapshot SimSnapshot;
+
+SimSnapshot *sim_snapshot_load(const char *path);   // NULL with a message
+void sim_snapshot_free(SimSnapshot *s);
+double sim_snapshot_time(const SimSnapshot *s);
+
+/* What SimParams.stop sees.  The final makespan is at least
+ * now_us - first_arrival_us, and the final stats add n_jobs - finished
+ * more slowdowns to `slowdown`. */
+typedef struct {
+    double now_us;
+    double first_arrival_us;
+    long long finished;
+    long long n_jobs;           // jobs in the run, 0 when streamed
+    const Histogram *slowdown;  // of the finished jobs
+} SimProgress;
+
+/* Deadline admission control, applied as each job arrives.  The estimate
+ * of when the job would finish is the engine backlog (the slices left of
+ * every admitted, unfinished job, spread over all engines) plus its own
+ * slices and key upload, and never less than its slices on every engine
+ * at once.  A job with a deadline the estimate overshoots is turned away
+ * (ADMIT_REJECT), or held back (ADMIT_DEFER) until it fits or the
+ * admitted work has drained; held jobs go to the scheduler in arrival
+ * order and keep their deadline. */
+typedef enum {
+    ADMIT_ALL,
+    ADMIT_REJECT,
+    ADMIT_DEFER
+} AdmitPolicy;
+
+int sim_parse_admit(const char *name, AdmitPolicy *out);
+
+/* stop() is called about every SIM_STOP_CHECK finished jobs. */
+#define SIM_STOP_CHECK 64
+
+/* Per-run knobs.  Everything a run reads besides its HwConfig and jobs
+ * lives here, so independent runs can execute on different threads. */
+typedef struct {
+    double pcie_scale;       // multiply pcie bandwidth by this
+    double pcie_cap_mb;      // cap per-transfer size in MB (0 = no cap)
+    int pcie_dma_depth;      // uploads in setup or on the link at once (0 = no cap)
+    double pcie_setup_us;    // per-upload setup before it gets bandwidth
+    int show_progress;
+    const char *csv_prefix;  // NULL = no CSV dump
+    const char *out_dir;     // where CSV dumps go, NULL = SIM_DEFAULT_OUT_DIR
+    TimelineFormat timeline_format;
+    double timeline_merge_us; // idle gap joined by TIMELINE_MERGED
+    int fast_forward;        // collapse steady bootstrap chains (same results)
+    HwCostModel cost_model;  // per-bootstrap cost; roofline skips fast-forward
+    int key_cache;           // keep keys resident in key_mem_mb between jobs
+    KeyEvictPolicy key_policy;
+    KeySharing key_sharing;  // for jobs without an explicit key_id
+    /* Speculative key uploads for the next prefetch_depth jobs in arrival
+     * order that have no keys yet (0 = off), with at most
+     * prefetch_budget_mb of them in flight (0 = no cap). */
+    int prefetch_depth;
+    double prefetch_budget_mb;
+    HpsWeights weights;
+    SimCounters *counters;   // filled by the run when set, NULL = off
+    const char *sched_arg;   // SchedContext.arg for SchedulerOps policies
+    SimSync *sync;           // cluster device, NULL = standalone run
+    const SimSnapshot *restore; // start from this state, NULL = time zero
+    const JobDagSet *dags;   // bootstrap graphs by job id, NULL = none
+    AdmitPolicy admit;
+    /* Abandon the run when this returns nonzero; the stats then cover
+     * the partial run.  NULL = always run to the end. */
+    int (*stop)(void *ctx, const SimProgress *progress);
+    void *stop_ctx;
+} SimParams;
+
+/* Fill `p` from the process-wide defaults set below. */
+void sim_params_default(SimParams *p);
+
 SimStats run_simulation(const HwConfig *cfg,
                         TfheJob *jobs_original,
                         int n_jobs,
                         SchedulerFn pick_job);
 
+SimStats run_simulation_params(const HwConfig *cfg,
+                               TfheJob *jobs_original,
+                               int n_jobs,
+                               SchedulerFn pick_job,
+                               const SimParams *params);
+
+/* Run a SchedulerOps policy (built-in or from sched_registry.h).  The
+ * SchedulerFn entry points above map pick_job_fifo / pick_job_hps to the
+ * built-in policies and call any other picker over the whole job table. */
+SimStats run_simulation_ops(const HwConfig *cfg,
+                            TfheJob *jobs_original,
+                            int n_jobs,
+                            const SchedulerOps *ops,
+                            const SimParams *params);
+
+/* Run `ops` until every event up to at_us is handled and write the
+ * state there to `path`.  Returns -1 if the run finished earlier or the
+ * snapshot could not be written. */
+int run_simulation_snapshot(const HwConfig *cfg,
+                            TfheJob *jobs_original,
+                            int n_jobs,
+                            const SchedulerOps *ops,
+                            const SimParams *params,
+                            double at_us,
+                            const char *path);
+
+/* 0 if `params->restore` can be used with this hardware and trace,
+ * otherwise -1 with a message. */
+int sim_snapshot_check(const SimSnapshot *s, const HwConfig *cfg,
+                       const TfheJob *jobs, int n_jobs,
+                       const SimParams *params);
+
+/* Release the per-tenant and per-priority tables of a SimStats returned
+ * by a run. */
+void sim_stats_free(SimStats *s);
+
+/* Pull jobs from `src` as the simulation clock reaches them instead of
+ * taking a preloaded array.  Jobs must come in arrival order; finished
+ * jobs are folded into the stats and dropped, so memory follows the jobs
+ * in flight rather than the trace length.  On a sorted trace the results
+ * match run_simulation_params up to floating-point summation order.
+ * Returns -1 if the source failed or was out of order. */
+int run_simulation_stream(const HwConfig *cfg,
+                          JobSource *src,
+                          SchedulerFn pick_job,
+                          const SimParams *params,
+                          SimStats *out);
+int run_simulation_stream_ops(const HwConfig *cfg,
+                              JobSource *src,
+                              const SchedulerOps *ops,
+                              const SimParams *params,
+                              SimStats *out);
+
 /* Testing helpers: scale PCIe bandwidth and cap transfer sizes (MB)
  * Call before `run_simulation` to affect subsequent runs. */
 void simulator_set_pcie_scale(double scale);
 void simulator_set_pcie_cap_mb(double cap_mb);
+void simulator_set_pcie_dma(int depth, double setup_us);
 void simulator_set_show_progress(int show);
 void simulator_set_csv_prefix(const char *prefix);
+void simulator_set_out_dir(const char *dir);
+void simulator_set_timeline(TimelineFormat fmt, double merge_us);
+void simulator_set_fast_forward(int enable);
+void simulator_set_key_cache(int enable, KeyEvictPolicy policy,
+                             KeySharing sharing);
+void simulator_set_prefetch(int depth, double budget_mb);
+void simulator_set_cost_model(HwCostModel model);
+void simulator_set_restore(const SimSnapshot *snapshot);
+void simulator_set_dags(const JobDagSet *dags);
+void simulator_set_admit(AdmitPolicy policy);
 
 
 
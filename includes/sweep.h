@@ -0,0 +1,25 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include "types.h"
+
+/* Parameter sweep over one loaded workload.
+ *
+ * The grid spec has one axis per line, `name value [value ...]`, '#' for
+ * comments:
+ *
+ *   hw          examples/hw/hw1.cfg examples/hw/hw2.cfg
+ *   sched       fifo hps
+ *   hps-w1 .. hps-w5  <weights>
+ *   pcie-scale  1 10
+ *   pcie-cap-mb 0 50
+ *   threads     8
+ *
+ * Every point of the cartesian product runs on a worker thread pool and
+ * one results row per point is written as CSV to `out_path` (stdout when
+ * NULL).  Axes left out use the current defaults; FIFO points ignore the
+ * HPS weight axes.  `threads` <= 0 uses the grid value or all cores. */
+int run_sweep(const char *grid_path, TfheJob *jobs, int n_jobs,
+              int threads, const char *out_path);
+
+#endif
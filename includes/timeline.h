@@ -0,0 +1,44 @@
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+/* Engine timeline writer.
+ *
+ * Bootstrap slices are handed over as they are issued.  Back-to-back
+ * slices of the same job on one engine are folded into a single run, and
+ * each run is written out through a large buffer once it is closed, so
+ * memory stays at one open run per engine however long the simulation
+ * goes.  Rows come out in the order runs close, not grouped by engine.
+ *
+ *   CSV     engine,job_id,start_us,end_us,count
+ *   BIN     the same rows in blocks of columns (see below)
+ *   MERGED  engine,job_id,start_us,end_us,count,busy_us: busy periods
+ *           separated by less than merge_us of idle time are joined, so
+ *           the row count follows the time resolution instead of the
+ *           number of jobs; job_id is -1 when several jobs share a row
+ *
+ * Binary layout, little-endian:
+ *   header  char magic[8] = TIMELINE_BIN_MAGIC, uint32 version,
+ *           uint32 num_engines
+ *   blocks  uint32 n_rows, uint32 0, then double start_us[n],
+ *           double end_us[n], int32 engine[n], int32 job_id[n],
+ *           int32 count[n], zero padding to a multiple of 8 bytes */
+#define TIMELINE_BIN_MAGIC   "TFHETLB"
+#define TIMELINE_BIN_VERSION 1
+
+typedef enum { TIMELINE_CSV, TIMELINE_BIN, TIMELINE_MERGED } TimelineFormat;
+
+typedef struct Timeline Timeline;
+
+/* NULL (with a message) if `path` cannot be created. */
+Timeline *timeline_open(const char *path, TimelineFormat fmt,
+                        int num_engines, double merge_us);
+void timeline_slice(Timeline *tl, int engine, long long job_id,
+                    double start_us, double end_us);
+/* Flush open runs and close the file.  Returns -1 if a write failed. */
+int  timeline_close(Timeline *tl);
+
+/* File suffix for `fmt`, e.g. "engines.csv". */
+const char *timeline_suffix(TimelineFormat fmt);
+int timeline_parse_format(const char *name, TimelineFormat *out);
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef TRACE_BIN_H
+#define TRACE_BIN_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "types.h"
+
+/* Binary columnar workload format (.wlb).
+ *
+ * A fixed header followed by one array per job field, each 8-byte
+ * aligned and stored in host (little-endian) byte order.  Jobs are sorted
+ * by arrival time, so a mapped file can be fed to the simulator row by
+ * row without parsing or sorting.  The header also carries the job count
+ * and the value range of every field.
+ *
+ *   id, tenant, num_boot, priority, key_id        int32[n_jobs]
+ *   arrival, key_size, noise, deadline            double[n_jobs]
+ *
+ * Readers check magic, version and that every column lies inside the
+ * file; fields added in later versions go after the existing header. */
+#define TRACE_BIN_MAGIC   "TFHEWLB"
+#define TRACE_BIN_VERSION 1
+
+enum {
+    TRACE_COL_ID,
+    TRACE_COL_TENANT,
+    TRACE_COL_ARRIVAL,
+    TRACE_COL_NUM_BOOT,
+    TRACE_COL_KEY_SIZE,
+    TRACE_COL_NOISE,
+    TRACE_COL_PRIORITY,
+    TRACE_COL_DEADLINE,
+    TRACE_COL_KEY_ID,
+    TRACE_COLS
+};
+
+#define TRACE_BIN_SORTED 0x1u   // rows are in arrival order
+
+typedef struct {
+    char magic[8];              // TRACE_BIN_MAGIC, NUL padded
+    uint32_t version;
+    uint32_t header_size;       // sizeof(TraceBinHeader) when written
+    uint64_t n_jobs;
+    uint32_t flags;
+    uint32_t reserved;
+    uint64_t col_offset[TRACE_COLS];    // from the start of the file
+
+    /* value ranges over all rows (zero when n_jobs == 0) */
+    double arrival_min, arrival_max;
+    double key_size_min, key_size_max;
+    double deadline_min, deadline_max;
+    int32_t tenant_min, tenant_max;
+    int32_t num_boot_min, num_boot_max;
+    int32_t priority_min, priority_max;
+    int32_t key_id_min, key_id_max;
+    uint64_t total_bootstraps;
+} TraceBinHeader;
+
+/* 1 if `data` starts with a usable binary trace header, 0 if it is not a
+ * binary trace, -1 (with a message) if it is one but is truncated or from
+ * an unknown version. */
+int trace_bin_check(const void *data, size_t len);
+
+/* Row `k` of a checked trace, with the run-time fields reset. */
+void trace_bin_job(const void *data, uint64_t k, TfheJob *job);
+
+/* Drop the mapped pages of rows [from_row, to_row) from memory. */
+void trace_bin_release(void *data, uint64_t from_row, uint64_t to_row);
+
+/* Streaming writer.  The row count must be known up front; rows are
+ * added in arrival order and the header is written on close. */
+typedef struct TraceBinWriter TraceBinWriter;
+
+TraceBinWriter *trace_bin_writer_open(const char *path, uint64_t n_jobs);
+int  trace_bin_writer_add(TraceBinWriter *w, const TfheJob *job);
+/* Returns 0 when all n_jobs rows were written and flushed. */
+int  trace_bin_writer_close(TraceBinWriter *w);
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef TUNE_H
+#define TUNE_H
+
+#include "types.h"
+#include "scheduler.h"
+#include "simulator.h"
+
+/* HPS weight auto-tuner.
+ *
+ * Searches the five HPS weights for the lowest score on one loaded
+ * workload, evaluating candidates on a worker thread pool.  Scores are
+ * minimised:
+ *
+ *   p99-slowdown   P99 slowdown
+ *   makespan       makespan
+ *   fairness       1 - Jain fairness
+ *   mix:A,B,C      A * P99 slowdown + B * makespan + C * (1 - fairness),
+ *                  each relative to the default weights on the same jobs
+ *
+ * `random` evaluates `budget` candidates on the whole workload.  `halving`
+ * (successive halving) starts all of them on a prefix of the trace and
+ * keeps the best third of each rung on a three times longer prefix, up to
+ * the whole workload.  The default weights are run on every rung as the
+ * reference, and win if nothing beats them on the whole workload.
+ *
+ * With early_stop, a run is abandoned as soon as a lower bound on its
+ * score (makespan so far, P99 slowdown implied by the jobs finished so
+ * far) is already worse than the best finished run of its rung.  Fairness
+ * has no such bound, so pure fairness runs always finish. */
+typedef enum {
+    TUNE_P99_SLOWDOWN,
+    TUNE_MAKESPAN,
+    TUNE_FAIRNESS,
+    TUNE_MIX
+} TuneObjective;
+
+typedef enum {
+    TUNE_RANDOM,
+    TUNE_HALVING
+} TuneMethod;
+
+typedef struct {
+    TuneObjective objective;
+    double mix[3];          // TUNE_MIX: P99 slowdown, makespan, unfairness
+    TuneMethod method;
+    int budget;             // candidates, including the defaults
+    int threads;            // <= 0 = all cores
+    unsigned long long seed;
+    double w_max;           // weights are drawn from [0, w_max]
+    int early_stop;
+} TuneOptions;
+
+void tune_options_default(TuneOptions *o);
+/* p99-slowdown, makespan, fairness or mix:A,B,C. */
+int  tune_parse_objective(const char *s, TuneOptions *o);
+int  tune_parse_method(const char *s, TuneMethod *out);
+
+/* One CSV row per evaluation goes to `out_path` (stdout when NULL); the
+ * winner is stored in *best and reported on stderr.  `base` supplies
+ * every other run setting. */
+int run_tune(const HwConfig *cfg, TfheJob *jobs, int n_jobs,
+             const TuneOptions *opt, const SimParams *base,
+             const char *out_path, HpsWeights *best);
+
+#endif
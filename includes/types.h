@@ -9,6 +9,13 @@ typedef struct {
     double freq_ghz;
     double ctx_switch_overhead_us;
     int batch_size;
+
+    /* key-switch stage (ks_pipe.h); 0 units = key-switching is part of
+     * the slice overhead above */
+    int ks_units;
+    double ks_latency_us;
+    int ks_depth;           // key-switches in flight per unit
+    int ks_queue;           // finished bootstraps waiting for a unit
 } HwConfig;
 
 typedef struct {
@@ -21,6 +28,7 @@ typedef struct {
     double noise_budget;
     int priority;
     double deadline_us;
+    int key_id;     // explicit key set identifier, -1 = none
 
     int remaining_bootstraps;
     double start_time_us;
@@ -29,28 +37,106 @@ typedef struct {
     int pcie_transferred; // 0 = not transferred, -1 = transfer in-progress, 1 = transfer complete
 } TfheJob;
 
+/* A run never writes its TfheJob records; they are shared by every run
+ * over the same trace.  What a run changes lives in per-slot tables: the
+ * state the event loop and the schedulers read on every event, packed
+ * four to a cache line, and the times that only the reports need. */
 typedef struct {
-    int job_id;
-    double start_us;
-    double end_us;
-} EngineLogEntry;
+    int remaining_bootstraps;
+    signed char pcie_transferred;   // as in TfheJob
+    unsigned char started;
+    unsigned char staged;           // picked, its upload counts against the
+                                    // cap on picks' uploads until the keys land
+    unsigned char blocked;          // every released bootstrap is running (dag.h)
+                                    // or waiting for its key-switch (ks_pipe.h)
+    double bootstrap_us;            // bootstrap_time_us() on the run's hardware
+} JobHot;
+
+typedef struct {
+    double start_us;                // first engine grant, < 0 until then
+    double completion_us;
+} JobTimes;
 
 typedef struct {
     int job_id;
     double busy_until_us;
-
-    // NEW: timeline log
-    EngineLogEntry *log;
-    int log_len;
-    int log_cap;
+    double busy_us;     // total length of slices issued to this engine
 } Engine;
 
+/* Tail summary of one latency or slowdown distribution. */
 typedef struct {
+    double p50, p90, p99, p999;
+} Percentiles;
+
+/* How a group of jobs fared against their deadlines.  Only jobs with
+ * deadline_us > 0 can miss; rejected jobs never run and are left out of
+ * every other figure. */
+typedef struct {
+    long with_deadline;         // jobs that ran and had one
+    long missed;                // finished after it
+    long rejected;              // turned away by admission control
+    long deferred;              // held back by admission control, then run
+    Percentiles lateness_us;    // completion - deadline, missed jobs only
+} DeadlineStats;
+
+typedef struct {
+    int tenant_id;
+    long n_jobs;
+    double avg_slowdown;
+    Percentiles response_us;    // completion - arrival
+    Percentiles queue_us;       // first dispatch - arrival
+    Percentiles slowdown;
+    DeadlineStats deadlines;
+} TenantStats;
+
+typedef struct {
+    int priority;
+    long n_jobs;
+    DeadlineStats deadlines;
+} PriorityStats;
+
+typedef struct {
+    long n_jobs;
     double makespan_us;
     double avg_completion_time_us;
     double avg_slowdown;
     double engine_utilization;
     double fairness; // Jain's fairness index over per-tenant average slowdown (0..1)
+    double first_arrival_us;    // the window makespan_us covers
+    double last_finish_us;
+
+    double pcie_mb_moved;   // key data uploaded over PCIe
+    long key_hits;          // key cache (zero when disabled)
+    long key_misses;
+    long key_evictions;
+    double key_evicted_mb;
+
+    /* speculative key uploads (zero when prefetch is off) */
+    long prefetches;
+    long prefetch_accurate;     // job dispatched within the lookahead depth
+    double prefetch_mb;
+    double prefetch_wasted_mb;  // uploaded for the inaccurate ones
+
+    /* key-switch stage (zero without key-switch units) */
+    long long key_switches;
+    double ks_utilization;      // unit issue slots taken over the makespan
+    double ks_queue_wait_us;    // summed, bootstrap handed off to unit start
+    int ks_queue_peak;
+    double engine_stall_us;     // summed, engines holding a bootstrap the
+                                // full key-switch queue would not take
+
+    long long n_events;     // event-loop iterations
+    long long n_picks;      // scheduler picks that returned a job
+
+    Percentiles response_us;    // from streaming histograms, all jobs
+    Percentiles queue_us;
+    Percentiles slowdown;
+    TenantStats *tenants;       // tenants with jobs, by id; sim_stats_free
+    int n_tenants;
+
+    DeadlineStats deadlines;
+    PriorityStats *priorities;  // priorities with jobs, ascending; sim_stats_free
+    int n_priorities;
 } SimStats;
 
 #endif
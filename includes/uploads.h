@@ -0,0 +1,44 @@
+#ifndef UPLOADS_H
+#define UPLOADS_H
+
+#include "sched_plugin.h"
+
+/* Cap on the key uploads that picks start, shared by the simulator's
+ * assignment rounds and the daemon's.
+ *
+ * Picking a job whose keys are not on the device starts its upload, and
+ * SchedContext.uploads tells the policy whether it may pick one:
+ *   - while engines are idle, as long as fewer uploads started by picks
+ *     are in flight than there are engines, so that a backlog of jobs
+ *     without keys does not put them all on the link at once; past that,
+ *     only jobs with their keys get picked;
+ *   - once no job with keys is left for the idle engines, one more upload
+ *     per idle engine, so that they wait on an upload rather than on the
+ *     cap;
+ *   - with no engine idle, one upload at a time ahead of them, so that the
+ *     next job's keys move while the engines are busy.
+ * The link is shared by the uploads on it (pcie.h), so the first of them
+ * lands sooner the fewer there are. */
+typedef struct {
+    int in_flight;          // started by picks, keys not on the device yet
+    int engines;            // one upload each, set by upload_cap_begin
+    int spare;              // idle engines the round had no job with keys for
+} UploadCap;
+
+/* Start of an assignment round. */
+void upload_cap_begin(UploadCap *u, SchedContext *ctx, int num_engines);
+
+/* The policy had nothing for the `idle` engines left.  Returns 1 if that
+ * opened uploads for them, so that the round should pick again. */
+int  upload_cap_spare(UploadCap *u, SchedContext *ctx, int idle);
+
+/* After the engines are handed out: returns 1 if one pick may start an
+ * upload ahead of them, with ctx->uploads set for it. */
+int  upload_cap_ahead(UploadCap *u, SchedContext *ctx);
+
+/* A pick started an upload. */
+void upload_cap_started(UploadCap *u, SchedContext *ctx);
+/* An upload a pick started has landed. */
+void upload_cap_landed(UploadCap *u);
+
+#endif
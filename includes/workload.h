@@ -3,6 +3,31 @@
 
 #include "types.h"
 
+/* Load a whole workload, text or binary (see trace_bin.h), sorted by
+ * arrival time. */
 int read_workload(const char *path, TfheJob **jobs_out, int *n_jobs_out);
 
+/* Parse one workload line, [line, eol), into `job`.  Returns 1 for a job,
+ * 0 for a blank or comment line and -1 (with a message) for a malformed
+ * one. */
+int workload_parse_line(const char *line, const char *eol, TfheJob *job);
+
+/* Write the text workload at `in_path` as a binary trace.  Sorted inputs
+ * are converted in two passes over the mapping without holding the jobs
+ * in memory. */
+int workload_convert(const char *in_path, const char *out_path);
+
+/* Pull-based job feed.  next() fills `job` and returns 1, returns 0 at the
+ * end of the trace and -1 on error.  Jobs come out in arrival order. */
+typedef struct JobSource {
+    int (*next)(struct JobSource *src, TfheJob *job);
+    void *ctx;
+} JobSource;
+
+/* Stream jobs straight out of a memory-mapped trace, one row at a time.
+ * The trace must already be sorted by arrival time; next() fails on the
+ * first job that arrives before its predecessor. */
+int  workload_stream_open(const char *path, JobSource *src);
+void workload_stream_close(JobSource *src);
+
 #endif
@@ -8,6 +8,7 @@ Plotter for TFHE hardware scheduler:
 import csv
 import sys
 import os
+import struct
 import matplotlib.pyplot as plt
 import numpy as np
 
@@ -44,7 +45,9 @@ def load_job_csv(path):
 
 def load_engine_csv(path):
     """
-    Columns: engine, job_id, start_us, end_us
+    Columns: engine, job_id, start_us, end_us[, count[, busy_us]]
+    Each row may cover `count` back-to-back slices of the same job, or with
+    --timeline merged a busy period of several jobs (job_id -1).
     """
     events = []
     with open(path, newline='') as f:
@@ -59,6 +62,59 @@ def load_engine_csv(path):
     return events
 
 
+def load_engine_tlb(path):
+    """
+    Binary engine timeline (tfhe_sim --timeline bin), see includes/timeline.h:
+    a 16-byte header, then blocks of columns
+    (n_rows, start_us[], end_us[], engine[], job_id[], count[]).
+    """
+    with open(path, 'rb') as f:
+        data = f.read()
+    if data[:8] != b'TFHETLB\0':
+        raise ValueError(f"{path}: not a binary engine timeline")
+    version, _ = struct.unpack_from('<II', data, 8)
+    if version != 1:
+        raise ValueError(f"{path}: unsupported timeline version {version}")
+
+    def column(fmt, off, n):
+        return struct.unpack_from(f'<{n}{fmt}', data, off), off + n * struct.calcsize(fmt)
+
+    events = []
+    off = 16
+    while off < len(data):
+        n, _ = struct.unpack_from('<II', data, off)
+        off += 8
+        start, off = column('d', off, n)
+        end, off = column('d', off, n)
+        eng, off = column('i', off, n)
+        job, off = column('i', off, n)
+        _, off = column('i', off, n)          # count
+        off += (8 - (12 * n) % 8) % 8
+        for k in range(n):
+            events.append({
+                'engine': eng[k],
+                'job_id': job[k],
+                'start_us': start[k],
+                'end_us': end[k]
+            })
+    return events
+
+
+def load_engine_log(path):
+    if path.endswith('.tlb'):
+        return load_engine_tlb(path)
+    return load_engine_csv(path)
+
+
+def find_engine_log(prefix, label):
+    """First timeline written for <prefix>-<label>: CSV, binary or merged."""
+    for suffix in ('engines.csv', 'engines.tlb', 'engines-merged.csv'):
+        path = f"{prefix}-{label}-{suffix}"
+        if os.path.exists(path):
+            return path
+    return f"{prefix}-{label}-engines.csv"
+
+
 # =====================================================
 # PLOTTING HELPERS
 # =====================================================
@@ -195,9 +251,9 @@ def main():
         print("Usage: python3 plotter.py <prefix> [--out-prefix X]")
         print("Expected files:")
         print("  <prefix>-fifo.csv")
-        print("  <prefix>-fifo-engines.csv")
+        print("  <prefix>-fifo-engines.csv (or .tlb / -engines-merged.csv)")
         print("  <prefix>-hps.csv")
-        print("  <prefix>-hps-engines.csv")
+        print("  <prefix>-hps-engines.csv (or .tlb / -engines-merged.csv)")
         sys.exit(1)
 
     prefix = args[0]
@@ -210,9 +266,9 @@ def main():
 
     # Expected input files
     fifo_jobs_path = f"{prefix}-fifo.csv"
-    fifo_eng_path  = f"{prefix}-fifo-engines.csv"
+    fifo_eng_path  = find_engine_log(prefix, "fifo")
     hps_jobs_path  = f"{prefix}-hps.csv"
-    hps_eng_path   = f"{prefix}-hps-engines.csv"
+    hps_eng_path   = find_engine_log(prefix, "hps")
 
     for p in [fifo_jobs_path, fifo_eng_path, hps_jobs_path, hps_eng_path]:
         if not os.path.exists(p):
@@ -220,9 +276,9 @@ def main():
             sys.exit(1)
 
     fifo_jobs = load_job_csv(fifo_jobs_path)
-    fifo_engs = load_engine_csv(fifo_eng_path)
+    fifo_engs = load_engine_log(fifo_eng_path)
     hps_jobs  = load_job_csv(hps_jobs_path)
-    hps_engs  = load_engine_csv(hps_eng_path)
+    hps_engs  = load_engine_log(hps_eng_path)
 
     # =====================================================
     #  FIGURE: parallel Gantt + CDF
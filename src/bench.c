@@ -0,0 +1,265 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "../includes/types.h"
+#include "../includes/scheduler.h"
+#include "../includes/simulator.h"
+
+/* Simulator benchmark (`make bench`).
+ *
+ * Every case generates a synthetic workload in-process and runs it with
+ * both schedulers, each run in a forked child so that peak RSS belongs to
+ * that run alone.  One CSV row per run goes to stdout; progress goes to
+ * stderr.  Arrival rates are derived from the hardware so that cases run
+ * at a comparable offered load and the numbers follow the job count rather
+ * than an ever-growing backlog. */
+
+#define BENCH_SEED 0x5eed1234u
+#define BENCH_LOAD 0.8          // offered load on the busier of engines / PCIe
+#define BENCH_TENANTS 8
+
+typedef struct {
+    const char *name;
+    long n_jobs;
+    int stream;                 // run_simulation_stream instead of an array
+    int num_engines;
+    int batch_size;
+    double pcie_gbps;
+    int boot_max;               // bootstraps per job, uniform in [1, boot_max]
+} BenchCase;
+
+static const BenchCase cases[] = {
+    /* scaling with the job count */
+    { "scale",   1000L,     0, 8, 4, 64, 64 },
+    { "scale",   10000L,    0, 8, 4, 64, 64 },
+    { "scale",   100000L,   0, 8, 4, 64, 64 },
+    { "scale",   1000000L,  0, 8, 4, 64, 64 },
+    { "scale",   1000L,     1, 8, 4, 64, 64 },
+    { "scale",   10000L,    1, 8, 4, 64, 64 },
+    { "scale",   100000L,   1, 8, 4, 64, 64 },
+    { "scale",   1000000L,  1, 8, 4, 64, 64 },
+    { "scale",   10000000L, 1, 8, 4, 64, 64 },
+
+    /* one knob at a time around the scaling point */
+    { "engines", 100000L,   0, 1, 4, 64, 64 },
+    { "engines", 100000L,   0, 64, 4, 64, 64 },
+    { "batch",   100000L,   0, 8, 1, 64, 64 },
+    { "batch",   100000L,   0, 8, 16, 64, 64 },
+    { "pcie",    100000L,   0, 8, 4, 8, 64 },
+    { "pcie",    100000L,   0, 8, 4, 256, 64 },
+    { "boots",   100000L,   0, 8, 4, 64, 4 },
+    { "boots",   100000L,   0, 8, 4, 64, 1024 },
+};
+
+#define N_CASES ((int)(sizeof(cases) / sizeof(cases[0])))
+
+/* ===================== WORKLOAD ===================== */
+
+typedef struct {
+    uint64_t rng;
+    const BenchCase *bc;
+    const HwConfig *cfg;
+    double mean_gap_us;
+    double now_us;
+    long next_id;
+} Gen;
+
+static uint64_t gen_u64(Gen *g) {
+    // splitmix64
+    uint64_t z = (g->rng += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+static double gen_unit(Gen *g) {
+    return (gen_u64(g) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static int gen_int(Gen *g, int lo, int hi) {
+    return lo + (int)(gen_u64(g) % (uint64_t)(hi - lo + 1));
+}
+
+/* Job fields except the arrival time, shaped like gen_random.py output:
+ * mostly small keys with a tail of large ones. */
+static void gen_body(Gen *g, TfheJob *job) {
+    memset(job, 0, sizeof(*job));
+    job->id = (int)g->next_id++;
+    job->tenant_id = gen_int(g, 0, BENCH_TENANTS - 1);
+    job->num_bootstraps = gen_int(g, 1, g->bc->boot_max);
+    job->key_size_mb = gen_unit(g) < 0.8 ? gen_int(g, 1, 16) : gen_int(g, 16, 256);
+    job->noise_budget = 1.0 + 99.0 * gen_unit(g);
+    job->priority = gen_int(g, 0, 2);
+    job->deadline_us = -1.0;
+    job->key_id = -1;
+
+    job->remaining_bootstraps = job->num_bootstraps;
+    job->start_time_us = -1.0;
+    job->completion_time_us = -1.0;
+}
+
+static void gen_init(Gen *g, const BenchCase *bc, const HwConfig *cfg) {
+    memset(g, 0, sizeof(*g));
+    g->rng = BENCH_SEED;
+    g->bc = bc;
+    g->cfg = cfg;
+
+    // calibrate the arrival rate on a sample of jobs
+    double engine_us = 0.0, pcie_us = 0.0;
+    const int n = 4096;
+    for (int i = 0; i < n; i++) {
+        TfheJob job;
+        gen_body(g, &job);
+        engine_us += job.num_bootstraps *
+                     (bootstrap_time_us(cfg, &job) + cfg->ctx_switch_overhead_us);
+        pcie_us += job.key_size_mb * 8.0 * 1e6 / (cfg->pcie_bandwidth_gbps * 1e3);
+    }
+    engine_us /= n * (double)cfg->num_engines;
+    pcie_us /= n;
+    g->mean_gap_us = (engine_us > pcie_us ? engine_us : pcie_us) / BENCH_LOAD;
+
+    g->rng = BENCH_SEED ^ 0xa5a5a5a5u;
+    g->next_id = 0;
+}
+
+static void gen_job(Gen *g, TfheJob *job) {
+    g->now_us += -g->mean_gap_us * log1p(-gen_unit(g));
+    gen_body(g, job);
+    job->arrival_time_us = g->now_us;
+    if (gen_unit(g) < 0.2)
+        job->deadline_us = job->arrival_time_us +
+                           5.0 * job->num_bootstraps * bootstrap_time_us(g->cfg, job);
+}
+
+static int gen_next(JobSource *src, TfheJob *job) {
+    Gen *g = src->ctx;
+    if (g->next_id >= g->bc->n_jobs) return 0;
+    gen_job(g, job);
+    return 1;
+}
+
+/* ===================== RUNNER ===================== */
+
+static double wall_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void bench_hw(const BenchCase *bc, HwConfig *cfg) {
+    cfg->num_engines = bc->num_engines;
+    cfg->hbm_bandwidth_gbps = 1024.0;
+    cfg->key_mem_mb = 4096.0;
+    cfg->pcie_bandwidth_gbps = bc->pcie_gbps;
+    cfg->freq_ghz = 1.5;
+    cfg->ctx_switch_overhead_us = 1.0;
+    cfg->batch_size = bc->batch_size;
+    cfg->ks_units = 0;
+}
+
+/* Runs in the child.  Returns 0 and prints one row on success. */
+static int run_case(const BenchCase *bc, int hps) {
+    HwConfig cfg;
+    bench_hw(bc, &cfg);
+    SchedulerFn fn = hps ? (SchedulerFn)pick_job_hps : (SchedulerFn)pick_job_fifo;
+
+    SimParams params;
+    sim_params_default(&params);
+
+    Gen g;
+    gen_init(&g, bc, &cfg);
+
+    SimStats s;
+    double t0, t1;
+    if (bc->stream) {
+        JobSource src = { gen_next, &g };
+        t0 = wall_s();
+        int rc = run_simulation_stream(&cfg, &src, fn, &params, &s);
+        t1 = wall_s();
+        if (rc != 0) return -1;
+    } else {
+        TfheJob *jobs = malloc(bc->n_jobs * sizeof(TfheJob));
+        if (!jobs) return -1;
+        for (long i = 0; i < bc->n_jobs; i++)
+            gen_job(&g, &jobs[i]);
+        t0 = wall_s();
+        s = run_simulation_params(&cfg, jobs, (int)bc->n_jobs, fn, &params);
+        t1 = wall_s();
+        free(jobs);
+    }
+
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+
+    double wall = t1 - t0;
+    printf("%s,%s,%s,%ld,%d,%d,%g,%d,%lld,%lld,%.4f,%.0f,%.0f,%ld,%.2f,%.4f\n",
+           bc->name, bc->stream ? "stream" : "array", hps ? "hps" : "fifo",
+           bc->n_jobs, bc->num_engines, bc->batch_size, bc->pcie_gbps,
+           bc->boot_max, s.n_events, s.n_picks, wall,
+           wall > 0 ? s.n_events / wall : 0.0,
+           wall > 0 ? s.n_picks / wall : 0.0,
+           ru.ru_maxrss, s.makespan_us, s.engine_utilization);
+    fflush(stdout);
+    sim_stats_free(&s);
+    return 0;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr, "Usage: %s [--max-jobs N] [--only NAME]\n", argv0);
+}
+
+int main(int argc, char **argv) {
+    long max_jobs = 0;          // 0 = no limit
+    const char *only = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--max-jobs") == 0 && i + 1 < argc) {
+            max_jobs = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--only") == 0 && i + 1 < argc) {
+            only = argv[++i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    printf("case,mode,sched,n_jobs,engines,batch,pcie_gbps,boot_max,"
+           "events,picks,wall_s,events_per_s,picks_per_s,peak_rss_kb,"
+           "makespan_us,utilization\n");
+    fflush(stdout);
+
+    int failed = 0;
+    for (int c = 0; c < N_CASES; c++) {
+        const BenchCase *bc = &cases[c];
+        if (max_jobs > 0 && bc->n_jobs > max_jobs) continue;
+        if (only && strcmp(only, bc->name) != 0) continue;
+
+        for (int hps = 0; hps < 2; hps++) {
+            fprintf(stderr, "bench: %s %s %s n=%ld\n", bc->name,
+                    bc->stream ? "stream" : "array", hps ? "hps" : "fifo",
+                    bc->n_jobs);
+
+            pid_t pid = fork();
+            if (pid < 0) {
+                perror("fork");
+                return 1;
+            }
+            if (pid == 0)
+                _exit(run_case(bc, hps) == 0 ? 0 : 1);
+
+            int status;
+            if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+                WEXITSTATUS(status) != 0) {
+                fprintf(stderr, "bench: %s n=%ld failed\n", bc->name, bc->n_jobs);
+                failed = 1;
+            }
+        }
+    }
+    return failed;
+}
@@ -0,0 +1,550 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <pthread.h>
+#include "../includes/cluster.h"
+#include "../includes/hw_config.h"
+
+/* ===================== CLUSTER CONFIG ===================== */
+
+int dispatch_parse_policy(const char *name, DispatchPolicy *out) {
+    if (strcmp(name, "least-loaded") == 0) *out = DISPATCH_LEAST_LOADED;
+    else if (strcmp(name, "key-locality") == 0) *out = DISPATCH_KEY_LOCALITY;
+    else if (strcmp(name, "tenant-pinned") == 0) *out = DISPATCH_TENANT_PINNED;
+    else return -1;
+    return 0;
+}
+
+void cluster_config_free(ClusterConfig *c) {
+    free(c->pin);
+    c->pin = NULL;
+    c->n_pin = 0;
+}
+
+static int add_pin(ClusterConfig *c, int tenant, int device) {
+    if (tenant >= c->n_pin) {
+        int n = 2 * tenant + 8;
+        int *pin = realloc(c->pin, n * sizeof(int));
+        if (!pin) return -1;
+        for (int t = c->n_pin; t < n; t++) pin[t] = -1;
+        c->pin = pin;
+        c->n_pin = n;
+    }
+    c->pin[tenant] = device;
+    return 0;
+}
+
+int read_cluster_config(const char *path, ClusterConfig *c) {
+    memset(c, 0, sizeof(*c));
+    c->window_us = -1.0;
+    c->locality_slack = 1.0;
+
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror("fopen cluster config");
+        return -1;
+    }
+
+    char line[4096];
+    while (fgets(line, sizeof(line), f)) {
+        char *save = NULL;
+        char *name = strtok_r(line, " \t\r\n", &save);
+        if (!name || name[0] == '#') continue;
+        char *a = strtok_r(NULL, " \t\r\n", &save);
+        char *b = strtok_r(NULL, " \t\r\n", &save);
+        if (b && b[0] == '#') b = NULL;
+        if (!a || a[0] == '#') {
+            fprintf(stderr, "Cluster setting %s needs a value\n", name);
+            goto fail;
+        }
+
+        if (strcmp(name, "device") == 0) {
+            int count = 1;
+            if (b && (b[0] != 'x' || (count = atoi(b + 1)) < 1)) {
+                fprintf(stderr, "Bad device count: %s\n", b);
+                goto fail;
+            }
+            if (c->n_devices + count > CLUSTER_MAX_DEVICES) {
+                fprintf(stderr, "Too many devices (max %d)\n", CLUSTER_MAX_DEVICES);
+                goto fail;
+            }
+            HwConfig hw;
+            if (read_hw_config(a, &hw) != 0) goto fail;
+            while (count-- > 0) c->hw[c->n_devices++] = hw;
+        } else if (strcmp(name, "root_pcie_gbps") == 0) {
+            c->root_pcie_gbps = atof(a);
+        } else if (strcmp(name, "link_latency_us") == 0) {
+            c->link_latency_us = atof(a);
+        } else if (strcmp(name, "window_us") == 0) {
+            c->window_us = atof(a);
+        } else if (strcmp(name, "dispatch") == 0) {
+            if (dispatch_parse_policy(a, &c->dispatch) != 0) {
+                fprintf(stderr, "Unknown dispatch policy: %s\n", a);
+                goto fail;
+            }
+        } else if (strcmp(name, "locality_slack") == 0) {
+            c->locality_slack = atof(a);
+        } else if (strcmp(name, "pin") == 0) {
+            if (!b || atoi(a) < 0 || add_pin(c, atoi(a), atoi(b)) != 0) {
+                fprintf(stderr, "Usage: pin TENANT DEVICE\n");
+                goto fail;
+            }
+        } else {
+            fprintf(stderr, "Unknown cluster setting: %s\n", name);
+            goto fail;
+        }
+    }
+    fclose(f);
+
+    if (c->n_devices == 0) {
+        fprintf(stderr, "Cluster config has no devices\n");
+        goto fail_closed;
+    }
+    if (c->link_latency_us <= 0.0) {
+        fprintf(stderr, "link_latency_us must be positive: it is the sync lookahead\n");
+        goto fail_closed;
+    }
+    if (c->window_us < 0.0) c->window_us = c->link_latency_us;
+    if (c->window_us <= 0.0 || c->window_us > c->link_latency_us) {
+        fprintf(stderr, "window_us must be in (0, link_latency_us]\n");
+        goto fail_closed;
+    }
+    for (int t = 0; t < c->n_pin; t++) {
+        if (c->pin[t] >= c->n_devices) {
+            fprintf(stderr, "Tenant %d pinned to missing device %d\n", t, c->pin[t]);
+            goto fail_closed;
+        }
+    }
+    return 0;
+
+fail:
+    fclose(f);
+fail_closed:
+    cluster_config_free(c);
+    return -1;
+}
+
+/* ===================== DEVICES ===================== */
+
+struct Cluster;
+
+typedef struct {
+    SimSync sync;           // first, so the wait callback can find the device
+    struct Cluster *cl;
+    HwConfig cfg;           // pcie_bandwidth_gbps is rewritten every window
+    double link_gbps;
+    SimParams params;
+    char csv_prefix[256];
+
+    /* jobs dispatched but not yet taken by the device; the host only
+     * appends between the two barriers, the device only pops outside */
+    TfheJob *queue;
+    long head, len, cap;
+
+    SimDeviceState state;   // as of the last boundary
+    JobSource src;
+    SimStats stats;
+    int rc;
+    int done;               // run returned (error or closed)
+} Device;
+
+typedef struct Cluster {
+    const ClusterConfig *cfg;
+    const SchedulerOps *ops;
+    Device *dev;
+    int n;
+    pthread_mutex_t start;      // held by the host while it starts threads
+    int abort;                  // a device thread did not start
+    pthread_barrier_t report;   // devices have stopped at the boundary
+    pthread_barrier_t release;  // the host has dispatched the next window
+} Cluster;
+
+static int queue_push(Device *d, const TfheJob *job) {
+    if (d->head + d->len == d->cap) {
+        if (d->head > 0) {
+            memmove(d->queue, d->queue + d->head, d->len * sizeof(TfheJob));
+            d->head = 0;
+        } else {
+            long cap = d->cap ? 2 * d->cap : 256;
+            TfheJob *q = realloc(d->queue, cap * sizeof(TfheJob));
+            if (!q) return -1;
+            d->queue = q;
+            d->cap = cap;
+        }
+    }
+    d->queue[d->head + d->len++] = *job;
+    return 0;
+}
+
+/* The device's JobSource.  An empty queue is "nothing yet": the run asks
+ * again after the next boundary. */
+static int device_next(JobSource *src, TfheJob *job) {
+    Device *d = src->ctx;
+    if (d->len == 0) return 0;
+    *job = d->queue[d->head++];
+    d->len--;
+    if (d->len == 0) d->head = 0;
+    return 1;
+}
+
+static void device_wait(SimSync *sync, const SimDeviceState *state) {
+    Device *d = (Device *)sync;
+    d->state = *state;
+    pthread_barrier_wait(&d->cl->report);
+    pthread_barrier_wait(&d->cl->release);
+}
+
+static void *device_thread(void *arg) {
+    Device *d = arg;
+
+    // the barriers need every device; leave if one could not start
+    pthread_mutex_lock(&d->cl->start);
+    int abort = d->cl->abort;
+    pthread_mutex_unlock(&d->cl->start);
+    if (abort) return NULL;
+
+    d->rc = run_simulation_stream_ops(&d->cfg, &d->src, d->cl->ops, &d->params,
+                                      &d->stats);
+
+    // a run that stopped early still has to show up at every boundary
+    d->done = 1;
+    SimDeviceState idle = { .now_us = d->sync.window_end_us,
+                            .next_event_us = DBL_MAX };
+    while (!d->sync.closed)
+        device_wait(&d->sync, &idle);
+    return NULL;
+}
+
+/* ===================== HOST ===================== */
+
+typedef struct {
+    int *home;              // device per key, -1 = none yet
+    int n_home;
+} KeyHomes;
+
+static int *key_home(KeyHomes *k, const TfheJob *job) {
+    // explicit key sets and per-tenant keys share one table
+    int idx = job->key_id >= 0 ? 2 * job->key_id : 2 * job->tenant_id + 1;
+    if (idx < 0) return NULL;
+    if (idx >= k->n_home) {
+        int n = 2 * idx + 8;
+        int *home = realloc(k->home, n * sizeof(int));
+        if (!home) return NULL;
+        for (int i = k->n_home; i < n; i++) home[i] = -1;
+        k->home = home;
+        k->n_home = n;
+    }
+    return &k->home[idx];
+}
+
+static int least_loaded(const double *load, int n) {
+    int best = 0;
+    for (int d = 1; d < n; d++)
+        if (load[d] < load[best]) best = d;
+    return best;
+}
+
+static int pick_device(const ClusterConfig *cfg, KeyHomes *homes,
+                       const double *load, const TfheJob *job)
+{
+    int n = cfg->n_devices;
+    switch (cfg->dispatch) {
+    case DISPATCH_TENANT_PINNED: {
+        int t = job->tenant_id;
+        if (t >= 0 && t < cfg->n_pin && cfg->pin[t] >= 0) return cfg->pin[t];
+        return t >= 0 ? t % n : 0;
+    }
+    case DISPATCH_KEY_LOCALITY: {
+        int best = least_loaded(load, n);
+        int *home = key_home(homes, job);
+        if (!home) return best;
+        if (*home < 0 || load[*home] > load[best] + cfg->locality_slack)
+            *home = best;
+        return *home;
+    }
+    case DISPATCH_LEAST_LOADED:
+    default:
+        return least_loaded(load, n);
+    }
+}
+
+/* Hold each device's link rate for the next window: its own link, capped
+ * by its share of the root complex.  Shares follow the transfers active
+ * at the boundary; a device with none is sized as if it started one. */
+static void share_root_complex(Cluster *cl) {
+    double root = cl->cfg->root_pcie_gbps;
+    int active = 0;
+    for (int d = 0; d < cl->n; d++) active += cl->dev[d].state.active_transfers;
+
+    for (int d = 0; d < cl->n; d++) {
+        Device *dev = &cl->dev[d];
+        double gbps = dev->link_gbps;
+        if (root > 0.0) {
+            int a = dev->state.active_transfers;
+            double share = a > 0 ? root * a / active : root / (active + 1);
+            if (share < gbps) gbps = share;
+        }
+        dev->cfg.pcie_bandwidth_gbps = gbps;
+    }
+}
+
+/* Sum the devices into out->total; -1 when out of memory. */
+static int merge_stats(ClusterStats *out, const ClusterConfig *cfg) {
+    SimStats *t = &out->total;
+    memset(t, 0, sizeof(*t));
+
+    double first = DBL_MAX, last = -DBL_MAX, busy = 0.0, ks_busy = 0.0;
+    int engines = 0, ks_units = 0;
+    double *sum_slow_t = NULL;
+    long *cnt_t = NULL;
+    int n_tenants = 0;
+
+    for (int d = 0; d < out->n_devices; d++) {
+        const SimStats *s = &out->dev[d];
+        engines += cfg->hw[d].num_engines;
+        ks_units += cfg->hw[d].ks_units;
+        // lateness percentiles do not merge; the total has counts only
+        t->deadlines.with_deadline += s->deadlines.with_deadline;
+        t->deadlines.missed += s->deadlines.missed;
+        t->deadlines.rejected += s->deadlines.rejected;
+        t->deadlines.deferred += s->deadlines.deferred;
+        if (s->n_jobs == 0) continue;
+
+        t->n_jobs += s->n_jobs;
+        t->avg_completion_time_us += s->avg_completion_time_us * s->n_jobs;
+        t->avg_slowdown += s->avg_slowdown * s->n_jobs;
+        t->pcie_mb_moved += s->pcie_mb_moved;
+        t->key_hits += s->key_hits;
+        t->key_misses += s->key_misses;
+        t->key_evictions += s->key_evictions;
+        t->key_evicted_mb += s->key_evicted_mb;
+        t->prefetches += s->prefetches;
+        t->prefetch_accurate += s->prefetch_accurate;
+        t->prefetch_mb += s->prefetch_mb;
+        t->prefetch_wasted_mb += s->prefetch_wasted_mb;
+        t->n_events += s->n_events;
+        t->n_picks += s->n_picks;
+        busy += s->engine_utilization * s->makespan_us * cfg->hw[d].num_engines;
+        t->key_switches += s->key_switches;
+        t->ks_queue_wait_us += s->ks_queue_wait_us;
+        t->engine_stall_us += s->engine_stall_us;
+        if (s->ks_queue_peak > t->ks_queue_peak) t->ks_queue_peak = s->ks_queue_peak;
+        ks_busy += s->ks_utilization * s->makespan_us * cfg->hw[d].ks_units;
+        if (s->first_arrival_us < first) first = s->first_arrival_us;
+        if (s->last_finish_us > last) last = s->last_finish_us;
+
+        for (int k = 0; k < s->n_tenants; k++) {
+            const TenantStats *ts = &s->tenants[k];
+            if (ts->tenant_id >= n_tenants) {
+                int n = 2 * ts->tenant_id + 8;
+                double *slow = realloc(sum_slow_t, n * sizeof(double));
+                if (slow) sum_slow_t = slow;
+                long *cnt = realloc(cnt_t, n * sizeof(long));
+                if (cnt) cnt_t = cnt;
+                if (!slow || !cnt) {
+                    free(sum_slow_t);
+                    free(cnt_t);
+                    return -1;
+                }
+                for (int i = n_tenants; i < n; i++) {
+                    sum_slow_t[i] = 0.0;
+                    cnt_t[i] = 0;
+                }
+                n_tenants = n;
+            }
+            sum_slow_t[ts->tenant_id] += ts->avg_slowdown * ts->n_jobs;
+            cnt_t[ts->tenant_id] += ts->n_jobs;
+        }
+    }
+
+    if (t->n_jobs > 0) {
+        t->avg_completion_time_us /= t->n_jobs;
+        t->avg_slowdown /= t->n_jobs;
+        t->first_arrival_us = first;
+        t->last_finish_us = last;
+        t->makespan_us = last - first;
+        t->engine_utilization =
+            t->makespan_us > 0 ? busy / (t->makespan_us * engines) : 0.0;
+        if (ks_units > 0 && t->makespan_us > 0)
+            t->ks_utilization = ks_busy / (t->makespan_us * ks_units);
+    }
+
+    /* Jain's index over the per-tenant average slowdown */
+    double sum_x = 0, sum_x2 = 0;
+    int present = 0;
+    for (int k = 0; k < n_tenants; k++) {
+        if (cnt_t[k] > 0) {
+            double avg = sum_slow_t[k] / cnt_t[k];
+            sum_x += avg;
+            sum_x2 += avg * avg;
+            present++;
+        }
+    }
+    t->fairness = present > 1 ? (sum_x * sum_x) / (present * sum_x2) : 1.0;
+
+    free(sum_slow_t);
+    free(cnt_t);
+    return 0;
+}
+
+int run_cluster(const ClusterConfig *c, JobSource *src,
+                const SchedulerOps *ops, const SimParams *params,
+                ClusterStats *out)
+{
+    memset(out, 0, sizeof(*out));
+    int n = c->n_devices;
+
+    Cluster cl = { .cfg = c, .ops = ops, .n = n };
+    cl.dev = calloc(n, sizeof(Device));
+    out->dev = calloc(n, sizeof(SimStats));
+    if (!cl.dev || !out->dev) {
+        free(cl.dev);
+        free(out->dev);
+        out->dev = NULL;
+        return -1;
+    }
+    out->n_devices = n;
+
+    pthread_t *threads = malloc(n * sizeof(pthread_t));
+    double *load = malloc(n * sizeof(double));
+    if (!threads || !load) {
+        free(threads);
+        free(load);
+        free(cl.dev);
+        free(out->dev);
+        out->dev = NULL;
+        out->n_devices = 0;
+        return -1;
+    }
+    pthread_mutex_init(&cl.start, NULL);
+    pthread_barrier_init(&cl.report, NULL, n + 1);
+    pthread_barrier_init(&cl.release, NULL, n + 1);
+
+    for (int d = 0; d < n; d++) {
+        Device *dev = &cl.dev[d];
+        dev->cl = &cl;
+        dev->cfg = c->hw[d];
+        dev->link_gbps = c->hw[d].pcie_bandwidth_gbps;
+        dev->sync.wait = device_wait;
+        dev->src = (JobSource){ .next = device_next, .ctx = dev };
+        dev->params = *params;
+        dev->params.sync = &dev->sync;
+        dev->params.counters = NULL;
+        dev->params.show_progress = 0;
+        if (params->csv_prefix) {
+            snprintf(dev->csv_prefix, sizeof(dev->csv_prefix), "%s-dev%d",
+                     params->csv_prefix, d);
+            dev->params.csv_prefix = dev->csv_prefix;
+        }
+    }
+    pthread_mutex_lock(&cl.start);
+    int started = 0;
+    while (started < n &&
+           pthread_create(&threads[started], NULL, device_thread, &cl.dev[started]) == 0)
+        started++;
+    cl.abort = started < n;
+    pthread_mutex_unlock(&cl.start);
+    if (cl.abort) {
+        fprintf(stderr, "Could not start a thread for device %d\n", started);
+        for (int d = 0; d < started; d++) pthread_join(threads[d], NULL);
+        pthread_mutex_destroy(&cl.start);
+        pthread_barrier_destroy(&cl.report);
+        pthread_barrier_destroy(&cl.release);
+        free(load);
+        free(threads);
+        free(cl.dev);
+        free(out->dev);
+        out->dev = NULL;
+        out->n_devices = 0;
+        return -1;
+    }
+
+    KeyHomes homes = { NULL, 0 };
+    TfheJob next;
+    int have = src->next(src, &next);
+    double last_arrival = -DBL_MAX;
+    int rc = 0;
+
+    for (;;) {
+        pthread_barrier_wait(&cl.report);
+        out->windows++;
+
+        // every device is parked at window_end; jump over idle stretches
+        double start = DBL_MAX;
+        int failed = 0;
+        for (int d = 0; d < n; d++) {
+            if (cl.dev[d].state.next_event_us < start)
+                start = cl.dev[d].state.next_event_us;
+            if (cl.dev[d].done) failed = 1;
+        }
+        if (have > 0 && next.arrival_time_us < start) start = next.arrival_time_us;
+        if (have < 0 || failed) rc = -1;
+
+        if (rc != 0 || start == DBL_MAX) {
+            // the trace is drained and every device is idle
+            for (int d = 0; d < n; d++) cl.dev[d].sync.closed = 1;
+            pthread_barrier_wait(&cl.release);
+            break;
+        }
+        double end = start + c->window_us;
+
+        // jobs the host sees before the next boundary reach their device
+        // a link latency later, which is never inside this window; those
+        // still in a queue count towards its load as well
+        for (int d = 0; d < n; d++)
+            load[d] = (double)(cl.dev[d].state.in_flight + cl.dev[d].len) /
+                      c->hw[d].num_engines;
+        while (have > 0 && next.arrival_time_us < end) {
+            if (next.arrival_time_us < last_arrival) {
+                fprintf(stderr, "Job %d arrives before its predecessor: "
+                                "stream is not arrival-sorted\n", next.id);
+                have = -1;
+                break;
+            }
+            last_arrival = next.arrival_time_us;
+
+            int d = pick_device(c, &homes, load, &next);
+            next.arrival_time_us += c->link_latency_us;
+            if (queue_push(&cl.dev[d], &next) != 0) {
+                fprintf(stderr, "Out of memory queueing jobs for device %d\n", d);
+                have = -1;
+                break;
+            }
+            load[d] += 1.0 / c->hw[d].num_engines;
+            have = src->next(src, &next);
+        }
+
+        share_root_complex(&cl);
+        for (int d = 0; d < n; d++) cl.dev[d].sync.window_end_us = end;
+        pthread_barrier_wait(&cl.release);
+    }
+
+    for (int d = 0; d < n; d++) {
+        pthread_join(threads[d], NULL);
+        if (cl.dev[d].rc != 0) rc = -1;
+        out->dev[d] = cl.dev[d].stats;
+        free(cl.dev[d].queue);
+    }
+    if (merge_stats(out, c) != 0) {
+        fprintf(stderr, "Out of memory merging device stats\n");
+        rc = -1;
+    }
+
+    pthread_mutex_destroy(&cl.start);
+    pthread_barrier_destroy(&cl.report);
+    pthread_barrier_destroy(&cl.release);
+    free(homes.home);
+    free(load);
+    free(threads);
+    free(cl.dev);
+    return rc;
+}
+
+void cluster_stats_free(ClusterStats *s) {
+    for (int d = 0; d < s->n_devices; d++)
+        sim_stats_free(&s->dev[d]);
+    free(s->dev);
+    s->dev = NULL;
+    s->n_devices = 0;
+}
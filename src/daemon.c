@@ -0,0 +1,451 @@
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "../includes/daemon.h"
+#include "../includes/scheduler.h"
+#include "../includes/uploads.h"
+#include "../includes/workload.h"
+
+/* Session state.  Jobs live in slots, recycled once they have finished, as
+ * in a streamed simulation; the hardware names them by job id, which the
+ * id map turns back into slots. */
+typedef struct {
+    const HwConfig *cfg;
+    FILE *out;
+    double now_us;
+
+    TfheJob *jobs;
+    JobHot *hot;
+    int *running;           // slices of the job on engines
+    int *free_slots;
+    int n_free;
+    int n_slots;
+    int cap;
+    int live;               // jobs arrived and not finished
+    long long seq;
+
+    /* job id -> slot, open addressing with linear probing */
+    int *map_id;
+    int *map_slot;          // -1 = empty
+    int map_cap;
+
+    int *engine_job;        // slot, -1 = idle
+    int busy;
+    UploadCap uploads;      // keys asked for and not resident yet (uploads.h)
+
+    const SchedulerOps *ops;
+    void *sched;
+    SchedContext sctx;
+
+    long long decisions;    // of the current line
+} Daemon;
+
+/* ===================== JOB IDS ===================== */
+
+static unsigned map_hash(const Daemon *d, int id) {
+    return ((unsigned)id * 2654435761u) & (d->map_cap - 1);
+}
+
+static int map_find(const Daemon *d, int id) {
+    for (unsigned h = map_hash(d, id); d->map_slot[h] >= 0; h = (h + 1) & (d->map_cap - 1))
+        if (d->map_id[h] == id) return d->map_slot[h];
+    return -1;
+}
+
+static void map_put(Daemon *d, int id, int slot) {
+    unsigned h = map_hash(d, id);
+    while (d->map_slot[h] >= 0) h = (h + 1) & (d->map_cap - 1);
+    d->map_id[h] = id;
+    d->map_slot[h] = slot;
+}
+
+/* Backward-shift deletion keeps every probe chain unbroken. */
+static void map_del(Daemon *d, int id) {
+    unsigned mask = d->map_cap - 1;
+    unsigned h = map_hash(d, id);
+    while (d->map_slot[h] >= 0 && d->map_id[h] != id) h = (h + 1) & mask;
+    if (d->map_slot[h] < 0) return;
+
+    for (unsigned k = (h + 1) & mask; d->map_slot[k] >= 0; k = (k + 1) & mask) {
+        unsigned home = map_hash(d, d->map_id[k]);
+        // move k into the hole unless its home lies between the two
+        if (((k - home) & mask) >= ((k - h) & mask)) {
+            d->map_id[h] = d->map_id[k];
+            d->map_slot[h] = d->map_slot[k];
+            h = k;
+        }
+    }
+    d->map_slot[h] = -1;
+}
+
+/* ===================== JOB TABLE ===================== */
+
+static int table_grow(Daemon *d, int cap) {
+    TfheJob *jobs = realloc(d->jobs, cap * sizeof(TfheJob));
+    if (jobs) d->jobs = jobs;
+    JobHot *hot = realloc(d->hot, cap * sizeof(JobHot));
+    if (hot) d->hot = hot;
+    int *running = realloc(d->running, cap * sizeof(int));
+    if (running) d->running = running;
+    int *free_slots = realloc(d->free_slots, cap * sizeof(int));
+    if (free_slots) d->free_slots = free_slots;
+    if (!jobs || !hot || !running || !free_slots) return -1;
+
+    // at most half full
+    int map_cap = 2 * cap;
+    int *map_id = malloc(map_cap * sizeof(int));
+    int *map_slot = malloc(map_cap * sizeof(int));
+    if (!map_id || !map_slot) {
+        free(map_id);
+        free(map_slot);
+        return -1;
+    }
+    for (int h = 0; h < map_cap; h++) map_slot[h] = -1;
+    int *old_id = d->map_id, *old_slot = d->map_slot, old_cap = d->map_cap;
+    d->map_id = map_id;
+    d->map_slot = map_slot;
+    d->map_cap = map_cap;
+    for (int h = 0; h < old_cap; h++)
+        if (old_slot[h] >= 0) map_put(d, old_id[h], old_slot[h]);
+    free(old_id);
+    free(old_slot);
+
+    d->cap = cap;
+    d->sctx.jobs = d->jobs;
+    d->sctx.hot = d->hot;
+    d->sctx.cap = cap;
+    if (d->sched && d->ops->on_resize && d->ops->on_resize(d->sched) != 0)
+        return -1;
+    return 0;
+}
+
+static void table_free(Daemon *d) {
+    free(d->jobs);
+    free(d->hot);
+    free(d->running);
+    free(d->free_slots);
+    free(d->map_id);
+    free(d->map_slot);
+    free(d->engine_job);
+}
+
+/* ===================== EVENTS ===================== */
+
+static void reply_error(Daemon *d, const char *msg) {
+    fprintf(d->out, "error %s\n", msg);
+}
+
+static void on_arrive(Daemon *d, const char *line, const char *eol) {
+    TfheJob job;
+    if (workload_parse_line(line, eol, &job) != 1 || job.num_bootstraps < 1) {
+        reply_error(d, "bad job");
+        return;
+    }
+    if (map_find(d, job.id) >= 0) {
+        reply_error(d, "job id already in flight");
+        return;
+    }
+    if (job.arrival_time_us > d->now_us) d->now_us = job.arrival_time_us;
+
+    int j;
+    if (d->n_free > 0) {
+        j = d->free_slots[--d->n_free];
+    } else {
+        if (d->n_slots == d->cap && table_grow(d, 2 * d->cap) != 0) {
+            reply_error(d, "out of memory");
+            return;
+        }
+        j = d->n_slots++;
+        d->sctx.n_slots = d->n_slots;
+    }
+
+    d->jobs[j] = job;
+    d->hot[j] = (JobHot){
+        .remaining_bootstraps = job.num_bootstraps,
+        .pcie_transferred = d->cfg->pcie_bandwidth_gbps <= 0.0 ? 1 : 0,
+        .bootstrap_us = bootstrap_time_us(d->cfg, &job)
+    };
+    d->running[j] = 0;
+    map_put(d, job.id, j);
+    d->live++;
+    d->ops->on_arrival(d->sched, j, d->seq++, d->now_us);
+}
+
+static void on_keys(Daemon *d, int id) {
+    int j = map_find(d, id);
+    if (j < 0 || d->hot[j].pcie_transferred >= 0) {
+        reply_error(d, "no upload for that job");
+        return;
+    }
+    d->hot[j].pcie_transferred = 1;
+    upload_cap_landed(&d->uploads);
+    if (d->ops->on_transfer_done)
+        d->ops->on_transfer_done(d->sched, j, d->now_us);
+}
+
+static void on_done(Daemon *d, int e) {
+    if (e < 0 || e >= d->cfg->num_engines || d->engine_job[e] < 0) {
+        reply_error(d, "engine is idle");
+        return;
+    }
+    int j = d->engine_job[e];
+    JobHot *h = &d->hot[j];
+    d->engine_job[e] = -1;
+    d->busy--;
+    d->running[j]--;
+    h->remaining_bootstraps--;
+    h->blocked = h->remaining_bootstraps > 0 && h->remaining_bootstraps <= d->running[j];
+    if (d->ops->on_bootstrap_done)
+        d->ops->on_bootstrap_done(d->sched, j, e, d->now_us);
+
+    if (h->remaining_bootstraps == 0) {
+        fprintf(d->out, "finished %d\n", d->jobs[j].id);
+        map_del(d, d->jobs[j].id);
+        d->free_slots[d->n_free++] = j;
+        d->live--;
+    }
+}
+
+static void request_keys(Daemon *d, int j) {
+    d->hot[j].pcie_transferred = -1;
+    upload_cap_started(&d->uploads, &d->sctx);
+    fprintf(d->out, "upload %d\n", d->jobs[j].id);
+    d->decisions++;
+}
+
+/* The simulator's assignment round, with engines and uploads reported
+ * back instead of modelled. */
+static void assign(Daemon *d) {
+    const HwConfig *cfg = d->cfg;
+    int idle = cfg->num_engines - d->busy;
+    int attempts = 0;
+    int attempt_cap = d->live + cfg->num_engines;
+
+    upload_cap_begin(&d->uploads, &d->sctx, cfg->num_engines);
+    while (idle > 0 && attempts++ < attempt_cap) {
+        int n_slices = 0;
+        int j = d->ops->pick_batch(d->sched, d->now_us, idle, &n_slices);
+        if (j < 0) {
+            // no job with keys for the idle engines (uploads.h)
+            if (upload_cap_spare(&d->uploads, &d->sctx, idle)) continue;
+            break;
+        }
+
+        // the policy had nothing it could run
+        JobHot *h = &d->hot[j];
+        if (h->pcie_transferred < 0 || h->blocked || h->remaining_bootstraps <= 0)
+            break;
+        if (!h->pcie_transferred) {
+            if (d->sctx.uploads != SCHED_UPLOADS_OPEN) break;
+            request_keys(d, j);
+            continue;
+        }
+        h->started = 1;
+
+        // engines for bootstraps not yet running only
+        int batch = n_slices > 0 ? n_slices : cfg->batch_size;
+        if (batch > h->remaining_bootstraps - d->running[j])
+            batch = h->remaining_bootstraps - d->running[j];
+        if (batch > idle)
+            batch = idle;
+        for (int e = 0; e < cfg->num_engines && batch > 0; e++) {
+            if (d->engine_job[e] >= 0) continue;
+            d->engine_job[e] = j;
+            d->running[j]++;
+            d->busy++;
+            idle--;
+            batch--;
+            fprintf(d->out, "assign %d %d\n", e, d->jobs[j].id);
+            d->decisions++;
+        }
+        h->blocked = h->remaining_bootstraps <= d->running[j];
+    }
+
+    // the next job's keys, while the engines are busy
+    while (cfg->pcie_bandwidth_gbps > 0.0 && attempts++ < attempt_cap &&
+           upload_cap_ahead(&d->uploads, &d->sctx)) {
+        int n_slices = 0;
+        int j = d->ops->pick_batch(d->sched, d->now_us, idle, &n_slices);
+        if (j < 0 || d->hot[j].pcie_transferred) break;
+        request_keys(d, j);
+    }
+}
+
+/* ===================== SESSION ===================== */
+
+static double elapsed_us(const struct timespec *a, const struct timespec *b) {
+    return (b->tv_sec - a->tv_sec) * 1e6 + (b->tv_nsec - a->tv_nsec) * 1e-3;
+}
+
+/* Event time of "CMD T ARG", moving the clock forward; the hardware's
+ * clock may run a little behind the daemon's view, so it never goes back. */
+static int read_event(Daemon *d, const char *args, int *arg) {
+    double t;
+    if (sscanf(args, "%lf %d", &t, arg) != 2) return -1;
+    if (t > d->now_us) d->now_us = t;
+    return 0;
+}
+
+int daemon_session(const HwConfig *cfg, const SchedulerOps *ops,
+                   const void *sched_arg, FILE *in, FILE *out,
+                   DaemonStats *stats)
+{
+    HpsWeights weights = scheduler_get_weights();
+    Daemon d = { .cfg = cfg, .out = out, .ops = ops };
+    d.sctx.cfg = cfg;
+    d.sctx.weights = &weights;
+    d.sctx.arg = sched_arg;
+    d.engine_job = malloc(cfg->num_engines * sizeof(int));
+    if (!d.engine_job || table_grow(&d, 256) != 0) {
+        table_free(&d);
+        return -1;
+    }
+    for (int e = 0; e < cfg->num_engines; e++) d.engine_job[e] = -1;
+
+    d.sched = ops->init(&d.sctx);
+    if (!d.sched) {
+        fprintf(stderr, "Scheduler %s failed to start\n", ops->name);
+        table_free(&d);
+        return -1;
+    }
+
+    DaemonStats local;
+    if (!stats) stats = &local;
+    memset(stats, 0, sizeof(*stats));
+
+    char *line = NULL;
+    size_t line_cap = 0;
+    ssize_t len;
+    int rc = 0;
+    while ((len = getline(&line, &line_cap, in)) > 0) {
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+            line[--len] = '\0';
+        char *args = line;
+        while (*args && *args != ' ' && *args != '\t') args++;
+        size_t cmd_len = args - line;
+        int arg;
+
+        d.decisions = 0;
+        if (cmd_len == 0) {
+            continue;
+        } else if (cmd_len == 6 && strncmp(line, "arrive", 6) == 0) {
+            on_arrive(&d, args, line + len);
+        } else if (cmd_len == 4 && strncmp(line, "keys", 4) == 0) {
+            if (read_event(&d, args, &arg) == 0) on_keys(&d, arg);
+            else reply_error(&d, "usage: keys T ID");
+        } else if (cmd_len == 4 && strncmp(line, "done", 4) == 0) {
+            if (read_event(&d, args, &arg) == 0) on_done(&d, arg);
+            else reply_error(&d, "usage: done T ENGINE");
+        } else if (cmd_len == 5 && strncmp(line, "stats", 5) == 0) {
+            const Histogram *h = &stats->latency_us;
+            fprintf(out, "stats %lld %.3f %.3f %.3f %.3f\n", stats->lines,
+                    hist_quantile(h, 0.50), hist_quantile(h, 0.90),
+                    hist_quantile(h, 0.99), hist_quantile(h, 0.999));
+            fprintf(out, ".\n");
+            fflush(out);
+            continue;
+        } else if (cmd_len == 4 && strncmp(line, "quit", 4) == 0) {
+            break;
+        } else if (cmd_len == 8 && strncmp(line, "shutdown", 8) == 0) {
+            rc = 1;
+            break;
+        } else {
+            reply_error(&d, "unknown command");
+        }
+        assign(&d);
+        fputs(".\n", out);
+
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        stats->lines++;
+        stats->decisions += d.decisions;
+        hist_add(&stats->latency_us, elapsed_us(&t0, &t1));
+        if (fflush(out) != 0) break;
+    }
+
+    free(line);
+    ops->destroy(d.sched);
+    table_free(&d);
+    return rc;
+}
+
+static void print_summary(const DaemonStats *st) {
+    const Histogram *h = &st->latency_us;
+    fprintf(stderr, "Daemon: %lld events, %lld decisions, decision latency "
+                    "P50/P90/P99/P99.9: %.3f / %.3f / %.3f / %.3f us\n",
+            st->lines, st->decisions,
+            hist_quantile(h, 0.50), hist_quantile(h, 0.90),
+            hist_quantile(h, 0.99), hist_quantile(h, 0.999));
+}
+
+int daemon_serve(const HwConfig *cfg, const SchedulerOps *ops,
+                 const void *sched_arg, const char *path)
+{
+    DaemonStats *st = malloc(sizeof(DaemonStats));
+    if (!st) return -1;
+
+    if (strcmp(path, "-") == 0) {
+        setvbuf(stdout, NULL, _IOFBF, 1 << 16);
+        int rc = daemon_session(cfg, ops, sched_arg, stdin, stdout, st);
+        if (rc >= 0) print_summary(st);
+        free(st);
+        return rc < 0 ? -1 : 0;
+    }
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        free(st);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(path);
+    if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(fd, 4) != 0) {
+        perror("daemon socket");
+        if (fd >= 0) close(fd);
+        free(st);
+        return -1;
+    }
+    // a client that goes away mid-reply ends its session, not the daemon
+    signal(SIGPIPE, SIG_IGN);
+    fprintf(stderr, "Listening on %s\n", path);
+
+    int rc = 0;
+    for (;;) {
+        int c = accept(fd, NULL, NULL);
+        if (c < 0) {
+            perror("accept");
+            rc = -1;
+            break;
+        }
+        FILE *in = fdopen(c, "r");
+        int c2 = dup(c);
+        FILE *out = c2 >= 0 ? fdopen(c2, "w") : NULL;
+        int done = 0;
+        if (in && out) {
+            int s = daemon_session(cfg, ops, sched_arg, in, out, st);
+            if (s >= 0) print_summary(st);
+            done = s != 0;
+        } else if (c2 >= 0) {
+            close(c2);
+        }
+        if (in) fclose(in);
+        else close(c);
+        if (out) fclose(out);
+        if (done) break;
+    }
+    close(fd);
+    unlink(path);
+    free(st);
+    return rc;
+}
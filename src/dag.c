@@ -0,0 +1,309 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../includes/dag.h"
+
+typedef struct {
+    int id;
+    JobDag dag;
+} IdDag;
+
+/* Sorted by job id once loaded; job ids are arbitrary ints. */
+struct JobDagSet {
+    IdDag *graphs;
+    int n, cap;
+};
+
+static int cmp_id(const void *a, const void *b) {
+    int x = ((const IdDag *)a)->id, y = ((const IdDag *)b)->id;
+    return (x > y) - (x < y);
+}
+
+/* An edge list being collected for one job. */
+typedef struct {
+    int *src, *dst;
+    long len, cap;
+} Edges;
+
+static int edges_add(Edges *e, int a, int b) {
+    if (e->len == e->cap) {
+        long cap = e->cap ? 2 * e->cap : 256;
+        int *src = realloc(e->src, cap * sizeof(int));
+        if (src) e->src = src;
+        int *dst = realloc(e->dst, cap * sizeof(int));
+        if (dst) e->dst = dst;
+        if (!src || !dst) return -1;
+        e->cap = cap;
+    }
+    e->src[e->len] = a;
+    e->dst[e->len] = b;
+    e->len++;
+    return 0;
+}
+
+static void dag_free(JobDag *d) {
+    free(d->level);
+    free(d->n_preds);
+    free(d->succ_off);
+    free(d->succ);
+    memset(d, 0, sizeof(*d));
+}
+
+/* Lay out `e` as successor lists and work out the levels.  -1 if the
+ * graph has a cycle. */
+static int dag_build(JobDag *d, int n, const Edges *e) {
+    d->n_nodes = n;
+    d->level = calloc(n, sizeof(int));
+    d->n_preds = calloc(n, sizeof(int));
+    d->succ_off = calloc(n + 1, sizeof(int));
+    d->succ = malloc((e->len > 0 ? e->len : 1) * sizeof(int));
+    int *order = malloc(n * sizeof(int));
+    if (!d->level || !d->n_preds || !d->succ_off || !d->succ || !order) {
+        free(order);
+        return -1;
+    }
+
+    for (long i = 0; i < e->len; i++) {
+        d->succ_off[e->src[i] + 1]++;
+        d->n_preds[e->dst[i]]++;
+    }
+    for (int v = 0; v < n; v++)
+        d->succ_off[v + 1] += d->succ_off[v];
+    // order doubles as the fill cursor of each list until the sort below
+    for (int v = 0; v < n; v++)
+        order[v] = d->succ_off[v];
+    for (long i = 0; i < e->len; i++)
+        d->succ[order[e->src[i]]++] = e->dst[i];
+
+    // topological order (Kahn), with d->level as the countdown of preds
+    int len = 0;
+    for (int v = 0; v < n; v++) {
+        d->level[v] = d->n_preds[v];
+        if (d->level[v] == 0) order[len++] = v;
+    }
+    for (int i = 0; i < len; i++) {
+        int v = order[i];
+        for (int k = d->succ_off[v]; k < d->succ_off[v + 1]; k++)
+            if (--d->level[d->succ[k]] == 0) order[len++] = d->succ[k];
+    }
+    if (len < n) {
+        free(order);
+        return -1;
+    }
+
+    // levels from the sinks back
+    for (int i = n - 1; i >= 0; i--) {
+        int v = order[i];
+        int best = 0;
+        for (int k = d->succ_off[v]; k < d->succ_off[v + 1]; k++)
+            if (d->level[d->succ[k]] > best) best = d->level[d->succ[k]];
+        d->level[v] = best + 1;
+    }
+    free(order);
+    return 0;
+}
+
+/* Parse the rest of a line after "ID kind" into `e`; returns the node
+ * count, or -1 with a message. */
+static int parse_levels(char **save, Edges *e, int id) {
+    int n = 0, prev_start = 0, prev_width = 0;
+    char *tok;
+    while ((tok = strtok_r(NULL, " \t\r\n", save)) && tok[0] != '#') {
+        int w = atoi(tok);
+        if (w < 1) {
+            fprintf(stderr, "Job %d: bad level width %s\n", id, tok);
+            return -1;
+        }
+        for (int b = n; b < n + w; b++)
+            for (int a = prev_start; a < prev_start + prev_width; a++)
+                if (edges_add(e, a, b) != 0) return -1;
+        prev_start = n;
+        prev_width = w;
+        n += w;
+    }
+    return n;
+}
+
+static int parse_edges(char **save, Edges *e, int id) {
+    char *tok = strtok_r(NULL, " \t\r\n", save);
+    int n = tok ? atoi(tok) : 0;
+    if (n < 1) {
+        fprintf(stderr, "Job %d: edges needs a bootstrap count\n", id);
+        return -1;
+    }
+    while ((tok = strtok_r(NULL, " \t\r\n", save)) && tok[0] != '#') {
+        int a, b;
+        if (sscanf(tok, "%d>%d", &a, &b) != 2 || a < 0 || b < 0 ||
+            a >= n || b >= n || a == b) {
+            fprintf(stderr, "Job %d: bad edge %s\n", id, tok);
+            return -1;
+        }
+        if (edges_add(e, a, b) != 0) return -1;
+    }
+    return n;
+}
+
+JobDagSet *dag_set_load(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror("fopen dag file");
+        return NULL;
+    }
+    JobDagSet *s = calloc(1, sizeof(JobDagSet));
+    Edges e = {0};
+    char *line = NULL;
+    size_t line_cap = 0;
+    if (!s) goto fail;
+
+    while (getline(&line, &line_cap, f) > 0) {
+        char *save = NULL;
+        char *tok = strtok_r(line, " \t\r\n", &save);
+        if (!tok || tok[0] == '#') continue;
+        int id = atoi(tok);
+        char *kind = strtok_r(NULL, " \t\r\n", &save);
+        if (id < 0 || !kind) {
+            fprintf(stderr, "Bad dag line for job %s\n", tok);
+            goto fail;
+        }
+
+        if (s->n == s->cap) {
+            int cap = s->cap ? 2 * s->cap : 64;
+            IdDag *graphs = realloc(s->graphs, cap * sizeof(IdDag));
+            if (!graphs) goto fail;
+            s->graphs = graphs;
+            s->cap = cap;
+        }
+        IdDag *g = &s->graphs[s->n];
+        memset(g, 0, sizeof(*g));
+        g->id = id;
+
+        e.len = 0;
+        int n;
+        if (strcmp(kind, "levels") == 0) {
+            n = parse_levels(&save, &e, id);
+        } else if (strcmp(kind, "edges") == 0) {
+            n = parse_edges(&save, &e, id);
+        } else {
+            fprintf(stderr, "Job %d: unknown graph kind %s\n", id, kind);
+            goto fail;
+        }
+        if (n < 0) goto fail;
+        if (n == 0) {
+            fprintf(stderr, "Job %d: empty graph\n", id);
+            goto fail;
+        }
+        s->n++;
+        if (dag_build(&g->dag, n, &e) != 0) {
+            fprintf(stderr, "Job %d: graph has a cycle\n", id);
+            goto fail;
+        }
+    }
+
+    qsort(s->graphs, s->n, sizeof(IdDag), cmp_id);
+    for (int i = 1; i < s->n; i++) {
+        if (s->graphs[i].id == s->graphs[i - 1].id) {
+            fprintf(stderr, "Job %d has two graphs\n", s->graphs[i].id);
+            goto fail;
+        }
+    }
+    fclose(f);
+    free(line);
+    free(e.src);
+    free(e.dst);
+    return s;
+
+fail:
+    fclose(f);
+    free(line);
+    free(e.src);
+    free(e.dst);
+    dag_set_free(s);
+    return NULL;
+}
+
+void dag_set_free(JobDagSet *s) {
+    if (!s) return;
+    for (int i = 0; i < s->n; i++)
+        dag_free(&s->graphs[i].dag);
+    free(s->graphs);
+    free(s);
+}
+
+const JobDag *dag_set_find(const JobDagSet *s, int job_id) {
+    if (!s) return NULL;
+    IdDag key = { .id = job_id };
+    const IdDag *hit = bsearch(&key, s->graphs, s->n, sizeof(IdDag), cmp_id);
+    return hit ? &hit->dag : NULL;
+}
+
+int dag_set_check(const JobDagSet *s, const TfheJob *jobs, int n_jobs) {
+    for (int i = 0; i < n_jobs; i++) {
+        const JobDag *d = dag_set_find(s, jobs[i].id);
+        if (d && d->n_nodes != jobs[i].num_bootstraps) {
+            fprintf(stderr, "Job %d: graph has %d bootstraps, the job %d\n",
+                    jobs[i].id, d->n_nodes, jobs[i].num_bootstraps);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* ready[] is a max-heap on level; ties go to the lower bootstrap. */
+static int ready_before(const DagRun *r, int a, int b) {
+    int la = r->dag->level[a], lb = r->dag->level[b];
+    return la != lb ? la > lb : a < b;
+}
+
+static void ready_push(DagRun *r, int v) {
+    int i = r->n_ready++;
+    while (i > 0 && ready_before(r, v, r->ready[(i - 1) / 2])) {
+        r->ready[i] = r->ready[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    r->ready[i] = v;
+}
+
+int dag_run_init(DagRun *r, const JobDag *dag) {
+    int n = dag->n_nodes;
+    r->dag = dag;
+    r->n_ready = 0;
+    r->preds_left = malloc(n * sizeof(int));
+    r->ready = malloc(n * sizeof(int));
+    if (!r->preds_left || !r->ready) {
+        dag_run_free(r);
+        return -1;
+    }
+    memcpy(r->preds_left, dag->n_preds, n * sizeof(int));
+    for (int v = 0; v < n; v++)
+        if (dag->n_preds[v] == 0) ready_push(r, v);
+    return 0;
+}
+
+void dag_run_free(DagRun *r) {
+    free(r->preds_left);
+    free(r->ready);
+    memset(r, 0, sizeof(*r));
+}
+
+int dag_run_take(DagRun *r) {
+    if (r->n_ready == 0) return -1;
+    int top = r->ready[0];
+    int last = r->ready[--r->n_ready];
+    int i = 0;
+    for (;;) {
+        int c = 2 * i + 1;
+        if (c >= r->n_ready) break;
+        if (c + 1 < r->n_ready && ready_before(r, r->ready[c + 1], r->ready[c])) c++;
+        if (!ready_before(r, r->ready[c], last)) break;
+        r->ready[i] = r->ready[c];
+        i = c;
+    }
+    if (r->n_ready > 0) r->ready[i] = last;
+    return top;
+}
+
+void dag_run_done(DagRun *r, int node) {
+    const JobDag *d = r->dag;
+    for (int k = d->succ_off[node]; k < d->succ_off[node + 1]; k++)
+        if (--r->preds_left[d->succ[k]] == 0) ready_push(r, d->succ[k]);
+}
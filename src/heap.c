@@ -0,0 +1,115 @@
+#include <stdlib.h>
+#include "../includes/heap.h"
+
+/* a should sit above b */
+static int before(const IndexedHeap *h, int a, int b) {
+    double ka = h->key[a], kb = h->key[b];
+    if (ka != kb) return h->is_max ? ka > kb : ka < kb;
+    if (h->tie && h->tie[a] != h->tie[b]) return h->tie[a] < h->tie[b];
+    return a < b;
+}
+
+static void place(IndexedHeap *h, int slot, int id) {
+    h->slots[slot] = id;
+    h->pos[id] = slot;
+}
+
+static void sift_up(IndexedHeap *h, int slot) {
+    int id = h->slots[slot];
+    while (slot > 0) {
+        int parent = (slot - 1) / 2;
+        if (!before(h, id, h->slots[parent])) break;
+        place(h, slot, h->slots[parent]);
+        slot = parent;
+    }
+    place(h, slot, id);
+}
+
+static void sift_down(IndexedHeap *h, int slot) {
+    int id = h->slots[slot];
+    for (;;) {
+        int child = 2 * slot + 1;
+        if (child >= h->len) break;
+        if (child + 1 < h->len && before(h, h->slots[child + 1], h->slots[child]))
+            child++;
+        if (!before(h, h->slots[child], id)) break;
+        place(h, slot, h->slots[child]);
+        slot = child;
+    }
+    place(h, slot, id);
+}
+
+int iheap_init(IndexedHeap *h, int cap, int is_max) {
+    h->slots = NULL;
+    h->pos = NULL;
+    h->key = NULL;
+    h->tie = NULL;
+    h->len = 0;
+    h->cap = 0;
+    h->is_max = is_max;
+    return iheap_reserve(h, cap);
+}
+
+void iheap_free(IndexedHeap *h) {
+    free(h->slots);
+    free(h->pos);
+    free(h->key);
+    h->slots = h->pos = NULL;
+    h->key = NULL;
+    h->len = h->cap = 0;
+}
+
+int iheap_reserve(IndexedHeap *h, int cap) {
+    if (cap <= h->cap) return 0;
+
+    int *slots = realloc(h->slots, cap * sizeof(int));
+    if (!slots) return -1;
+    h->slots = slots;
+
+    int *pos = realloc(h->pos, cap * sizeof(int));
+    if (!pos) return -1;
+    h->pos = pos;
+
+    double *key = realloc(h->key, cap * sizeof(double));
+    if (!key) return -1;
+    h->key = key;
+
+    for (int i = h->cap; i < cap; i++) h->pos[i] = -1;
+    h->cap = cap;
+    return 0;
+}
+
+void iheap_push(IndexedHeap *h, int id, double key) {
+    int slot = h->pos[id];
+    if (slot < 0) {
+        h->key[id] = key;
+        slot = h->len++;
+        place(h, slot, id);
+        sift_up(h, slot);
+        return;
+    }
+
+    double old = h->key[id];
+    h->key[id] = key;
+    if (h->is_max ? key > old : key < old) sift_up(h, slot);
+    else sift_down(h, slot);
+}
+
+void iheap_remove(IndexedHeap *h, int id) {
+    int slot = h->pos[id];
+    if (slot < 0) return;
+
+    h->pos[id] = -1;
+    int last = h->slots[--h->len];
+    if (slot == h->len) return;
+
+    place(h, slot, last);
+    sift_up(h, slot);
+    sift_down(h, h->pos[last]);
+}
+
+int iheap_pop(IndexedHeap *h) {
+    int top = iheap_top(h);
+    if (top >= 0) iheap_remove(h, top);
+    return top;
+}
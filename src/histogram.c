@@ -0,0 +1,54 @@
+#include <math.h>
+#include <string.h>
+#include "../includes/histogram.h"
+
+void hist_init(Histogram *h) {
+    memset(h, 0, sizeof(*h));
+}
+
+static int bucket_of(double v) {
+    if (!(v > 0.0)) return 0;
+
+    int e;
+    double m = frexp(v, &e);        // v = m * 2^e, m in [0.5, 1)
+    if (e <= HIST_MIN_EXP) return 0;
+    if (e > HIST_MAX_EXP) return HIST_BUCKETS - 1;
+
+    int sub = (int)((m - 0.5) * (2 * HIST_SUB_BUCKETS));
+    return (e - 1 - HIST_MIN_EXP) * HIST_SUB_BUCKETS + sub;
+}
+
+/* Midpoint of bucket b. */
+static double bucket_value(int b) {
+    int e = b / HIST_SUB_BUCKETS + HIST_MIN_EXP + 1;
+    double m = 0.5 + (b % HIST_SUB_BUCKETS + 0.5) / (2 * HIST_SUB_BUCKETS);
+    return ldexp(m, e);
+}
+
+void hist_add(Histogram *h, double v) {
+    if (h->total == 0 || v < h->min) h->min = v;
+    if (h->total == 0 || v > h->max) h->max = v;
+    h->counts[bucket_of(v)]++;
+    h->total++;
+}
+
+double hist_quantile(const Histogram *h, double q) {
+    if (h->total == 0) return 0.0;
+    if (q <= 0.0) return h->min;
+    if (q >= 1.0) return h->max;
+
+    uint64_t rank = (uint64_t)ceil(q * h->total);
+    if (rank < 1) rank = 1;
+
+    uint64_t seen = 0;
+    for (int b = 0; b < HIST_BUCKETS; b++) {
+        seen += h->counts[b];
+        if (seen >= rank) {
+            double v = bucket_value(b);
+            if (v < h->min) v = h->min;
+            if (v > h->max) v = h->max;
+            return v;
+        }
+    }
+    return h->max;
+}
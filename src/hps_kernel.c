@@ -0,0 +1,113 @@
+#include <stdlib.h>
+#include <pthread.h>
+#include "../includes/hps_kernel.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define HPS_HAVE_AVX2 1
+#endif
+
+int hps_columns_reserve(HpsColumns *c, int cap) {
+    if (cap <= c->cap) return 0;
+
+    double **cols[] = { &c->head, &c->fair, &c->bw, &c->deadline };
+    for (int i = 0; i < 4; i++) {
+        double *p = realloc(*cols[i], cap * sizeof(double));
+        if (!p) return -1;
+        *cols[i] = p;
+    }
+    int *slot = realloc(c->slot, cap * sizeof(int));
+    if (!slot) return -1;
+    c->slot = slot;
+    c->cap = cap;
+    return 0;
+}
+
+void hps_columns_free(HpsColumns *c) {
+    free(c->head);
+    free(c->fair);
+    free(c->bw);
+    free(c->deadline);
+    free(c->slot);
+    c->head = c->fair = c->bw = c->deadline = NULL;
+    c->slot = NULL;
+    c->len = c->cap = 0;
+}
+
+void hps_score_scalar(const HpsColumns *c, double w_deadline,
+                      double now_us, double *out)
+{
+    for (int i = 0; i < c->len; i++) {
+        double slack = c->deadline[i] - now_us;
+        if (slack < 0) slack = 0;
+        if (slack > HPS_SLACK_CAP_US) slack = HPS_SLACK_CAP_US;
+        double pressure = 1.0 - slack / (slack + 500.0);
+        out[i] = c->head[i] + w_deadline * pressure + c->fair[i] + c->bw[i];
+    }
+}
+
+#ifdef HPS_HAVE_AVX2
+/* Four rows per step.  "avx2" alone does not enable FMA, so the compiler
+ * cannot contract the multiply-add and change the rounding. */
+__attribute__((target("avx2")))
+static void hps_score_avx2(const HpsColumns *c, double w_deadline,
+                           double now_us, double *out)
+{
+    const __m256d now = _mm256_set1_pd(now_us);
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d cap = _mm256_set1_pd(HPS_SLACK_CAP_US);
+    const __m256d half_ms = _mm256_set1_pd(500.0);
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d w = _mm256_set1_pd(w_deadline);
+
+    int i = 0;
+    for (; i + 4 <= c->len; i += 4) {
+        __m256d slack = _mm256_sub_pd(_mm256_loadu_pd(c->deadline + i), now);
+        slack = _mm256_min_pd(_mm256_max_pd(slack, zero), cap);
+        __m256d pressure = _mm256_sub_pd(one,
+            _mm256_div_pd(slack, _mm256_add_pd(slack, half_ms)));
+
+        __m256d s = _mm256_add_pd(_mm256_loadu_pd(c->head + i),
+                                  _mm256_mul_pd(w, pressure));
+        s = _mm256_add_pd(s, _mm256_loadu_pd(c->fair + i));
+        s = _mm256_add_pd(s, _mm256_loadu_pd(c->bw + i));
+        _mm256_storeu_pd(out + i, s);
+    }
+
+    // the last few rows
+    HpsColumns tail = *c;
+    tail.head += i;
+    tail.fair += i;
+    tail.bw += i;
+    tail.deadline += i;
+    tail.len -= i;
+    hps_score_scalar(&tail, w_deadline, now_us, out + i);
+}
+#endif
+
+static HpsScoreFn g_kernel;
+static const char *g_kernel_name;
+static pthread_once_t g_kernel_once = PTHREAD_ONCE_INIT;
+
+static void pick_kernel(void) {
+    g_kernel = hps_score_scalar;
+    g_kernel_name = "scalar";
+    if (getenv("HPS_NO_SIMD")) return;
+#ifdef HPS_HAVE_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        g_kernel = hps_score_avx2;
+        g_kernel_name = "avx2";
+    }
+#endif
+}
+
+HpsScoreFn hps_score_kernel(void) {
+    pthread_once(&g_kernel_once, pick_kernel);
+    return g_kernel;
+}
+
+const char *hps_score_kernel_name(void) {
+    pthread_once(&g_kernel_once, pick_kernel);
+    return g_kernel_name;
+}
@@ -2,6 +2,18 @@
 #include <string.h>
 #include "../includes/hw_config.h"
 
+/* `keyswitch UNITS LATENCY_US [DEPTH [QUEUE]]` */
+static int parse_keyswitch(const char *line, HwConfig *cfg) {
+    int n = sscanf(line, "keyswitch %d %lf %d %d",
+                   &cfg->ks_units, &cfg->ks_latency_us,
+                   &cfg->ks_depth, &cfg->ks_queue);
+    if (n < 2 || cfg->ks_units < 0 || cfg->ks_latency_us <= 0.0) return -1;
+    if (n < 3 || cfg->ks_depth < 1) cfg->ks_depth = 1;
+    if (n < 4) cfg->ks_queue = cfg->num_engines;
+    if (cfg->ks_queue < 0) cfg->ks_queue = 0;
+    return 0;
+}
+
 int read_hw_config(const char *path, HwConfig *cfg) {
     FILE *f = fopen(path, "r");
     if (!f) {
@@ -9,10 +21,26 @@ int read_hw_config(const char *path, HwConfig *cfg) {
         return -1;
     }
 
+    cfg->ks_units = 0;
+    cfg->ks_latency_us = 0.0;
+    cfg->ks_depth = 1;
+    cfg->ks_queue = 0;
+
     char line[512];
+    int have_engines = 0;
     while (fgets(line, sizeof(line), f)) {
         if (line[0] == '#' || line[0] == '\n') continue;
 
+        // after the engine line only the keyswitch line is read
+        if (have_engines) {
+            if (strncmp(line, "keyswitch", 9) == 0 && parse_keyswitch(line, cfg) != 0) {
+                fprintf(stderr, "Invalid hw config line: %s\n", line);
+                fclose(f);
+                return -1;
+            }
+            continue;
+        }
+
         int n = sscanf(line, "%d %lf %lf %lf %lf %lf %d",
                            &cfg->num_engines,
                            &cfg->hbm_bandwidth_gbps,
@@ -34,11 +62,34 @@ int read_hw_config(const char *path, HwConfig *cfg) {
                 cfg->batch_size = 1;
             }
 
-            fclose(f);
-            return 0;
+            have_engines = 1;
     }
 
     fclose(f);
-    fprintf(stderr, "Empty hw config\n");
-    return -1;
+    if (!have_engines) {
+        fprintf(stderr, "Empty hw config\n");
+        return -1;
+    }
+    return 0;
+}
+
+int hw_cost_parse_model(const char *name, HwCostModel *out) {
+    if (strcmp(name, "static") == 0) *out = HW_COST_STATIC;
+    else if (strcmp(name, "roofline") == 0) *out = HW_COST_ROOFLINE;
+    else return -1;
+    return 0;
+}
+
+double hw_roofline_us(const HwConfig *cfg, double key_mb, int streams) {
+    double compute_us = 0.0;
+    if (cfg->freq_ghz > 0.0)
+        compute_us = key_mb * HW_CYCLES_PER_KEY_MB / (cfg->freq_ghz * 1e3);
+
+    if (streams < 1) streams = 1;
+    double bw_per_stream = cfg->hbm_bandwidth_gbps / streams;
+    double memory_us = (key_mb * 8.0 / (bw_per_stream * 1000)) * 1e6;
+
+    double time_us = compute_us > memory_us ? compute_us : memory_us;
+    if (time_us < 1.0) time_us = 1.0;
+    return time_us;
 }
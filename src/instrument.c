@@ -0,0 +1,98 @@
+#include <stdio.h>
+#include "../includes/instrument.h"
+
+static const char *phase_names[SIM_PHASES] = {
+    [SIM_PHASE_EVENT_SEARCH] = "event_search",
+    [SIM_PHASE_TRANSFERS] = "transfers",
+    [SIM_PHASE_ARRIVALS] = "arrivals",
+    [SIM_PHASE_COMPLETIONS] = "completions",
+    [SIM_PHASE_ASSIGN] = "assign",
+    [SIM_PHASE_PICK] = "pick",
+    [SIM_PHASE_FAST_FORWARD] = "fast_forward"
+};
+
+const char *sim_phase_name(SimPhase p) {
+    return p >= 0 && p < SIM_PHASES ? phase_names[p] : "?";
+}
+
+static void write_percentiles(FILE *f, const char *name, const Percentiles *p) {
+    fprintf(f, "      \"%s\": {\"p50\": %.6f, \"p90\": %.6f, \"p99\": %.6f, "
+               "\"p999\": %.6f},\n",
+            name, p->p50, p->p90, p->p99, p->p999);
+}
+
+static void write_run(FILE *f, const char *label, const SimStats *s,
+                      const SimCounters *c)
+{
+    fprintf(f, "  {\n    \"scheduler\": \"%s\",\n", label);
+
+    fprintf(f, "    \"stats\": {\n");
+    fprintf(f, "      \"n_jobs\": %ld,\n", s->n_jobs);
+    fprintf(f, "      \"makespan_us\": %.6f,\n", s->makespan_us);
+    fprintf(f, "      \"avg_completion_us\": %.6f,\n", s->avg_completion_time_us);
+    fprintf(f, "      \"avg_slowdown\": %.6f,\n", s->avg_slowdown);
+    fprintf(f, "      \"utilization\": %.6f,\n", s->engine_utilization);
+    fprintf(f, "      \"fairness\": %.6f,\n", s->fairness);
+    write_percentiles(f, "response_us", &s->response_us);
+    write_percentiles(f, "queue_us", &s->queue_us);
+    write_percentiles(f, "slowdown", &s->slowdown);
+    fprintf(f, "      \"pcie_mb_moved\": %.6f\n", s->pcie_mb_moved);
+    fprintf(f, "    },\n");
+
+    fprintf(f, "    \"events\": {\"loop_iterations\": %lld, \"arrivals\": %lld, "
+               "\"engine_completions\": %lld, \"pcie_completions\": %lld, "
+               "\"fast_forward_slices\": %lld},\n",
+            c->loop_iterations, c->arrivals, c->engine_completions,
+            c->pcie_completions, c->ff_slices);
+
+    fprintf(f, "    \"scheduler_calls\": {\"calls\": %lld, \"empty\": %lld, "
+               "\"picks\": %lld, \"wasted_picks\": %lld, "
+               "\"transfers_started\": %lld, \"key_waits\": %lld, "
+               "\"jobs_examined\": %lld, \"rescored\": %lld, "
+               "\"stale_entries\": %lld, \"phase_moves\": %lld, "
+               "\"parked\": %lld},\n",
+            c->sched_calls, c->sched_empty, s->n_picks, c->wasted_picks,
+            c->transfers_started, c->key_waits, c->sched.examined,
+            c->sched.rescored, c->sched.stale, c->sched.phase_moves,
+            c->sched.parked);
+
+    fprintf(f, "    \"engines\": {\"idle_intervals\": %lld, \"idle_us\": %.6f},\n",
+            c->idle_intervals, c->idle_us);
+    fprintf(f, "    \"pcie\": {\"transfer_slot_scans\": %lld},\n",
+            c->transfer_scans);
+
+    double ticks_per_us = c->wall_us > 0.0 ? c->total_ticks / c->wall_us : 0.0;
+    fprintf(f, "    \"timers\": {\n");
+    fprintf(f, "      \"clock\": \"%s\",\n", INSTR_CLOCK);
+    fprintf(f, "      \"ticks_per_us\": %.3f,\n", ticks_per_us);
+    fprintf(f, "      \"wall_us\": %.3f,\n", c->wall_us);
+    fprintf(f, "      \"total_ticks\": %llu,\n", (unsigned long long)c->total_ticks);
+    fprintf(f, "      \"phases\": {\n");
+    for (int p = 0; p < SIM_PHASES; p++) {
+        double share = c->total_ticks ? (double)c->phase_ticks[p] / c->total_ticks : 0.0;
+        fprintf(f, "        \"%s\": {\"ticks\": %llu, \"share\": %.4f}%s\n",
+                sim_phase_name(p), (unsigned long long)c->phase_ticks[p], share,
+                p + 1 < SIM_PHASES ? "," : "");
+    }
+    fprintf(f, "      }\n    }\n  }");
+}
+
+int instrument_write_report(const char *path, const char *const *labels,
+                            const SimStats *stats, const SimCounters *ctr,
+                            int n)
+{
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        perror("fopen instrumentation report");
+        return -1;
+    }
+
+    fprintf(f, "{\"runs\": [\n");
+    for (int i = 0; i < n; i++) {
+        write_run(f, labels[i], &stats[i], &ctr[i]);
+        fprintf(f, "%s\n", i + 1 < n ? "," : "");
+    }
+    fprintf(f, "]}\n");
+
+    return fclose(f) == 0 ? 0 : -1;
+}
@@ -0,0 +1,347 @@
+#include <stdlib.h>
+#include <string.h>
+#include "../includes/key_cache.h"
+#include "../includes/heap.h"
+
+typedef struct {
+    long long key;
+    double size_mb;
+    double prio;        // GDSF priority at last use
+    long uses;
+    long last_use;
+    int refs;           // jobs currently holding the entry
+    int resident;       // space reserved on device (loaded or loading)
+    int loaded;
+    int next_free;      // -2 while in use, else the next free entry or -1
+} KeyEntry;
+
+struct KeyCache {
+    KeyEvictPolicy policy;
+    double capacity_mb;
+    double used_mb;
+    double gdsf_clock;  // GDSF inflation value L
+    long tick;
+
+    /* Entries that are neither resident nor pinned go back on the free
+     * list, so the table follows the keys in use rather than every key
+     * ever seen. */
+    KeyEntry *entries;
+    int n_entries, cap_entries;     // ids handed out so far, allocated
+    int n_live;                     // in the table
+    int free_head;
+
+    int *table;         // open addressing: entry id or -1
+    int table_size;     // power of two
+
+    IndexedHeap victims; // resident, loaded, unpinned entries
+    KeyCacheStats stats;
+};
+
+/* ===================== KEY -> ENTRY MAP ===================== */
+
+static unsigned long long hash_key(long long key) {
+    unsigned long long x = (unsigned long long)key;
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+static int table_find_slot(const KeyCache *kc, long long key) {
+    unsigned long long mask = kc->table_size - 1;
+    unsigned long long i = hash_key(key) & mask;
+    while (kc->table[i] >= 0 && kc->entries[kc->table[i]].key != key)
+        i = (i + 1) & mask;
+    return (int)i;
+}
+
+static int table_grow(KeyCache *kc) {
+    int old_size = kc->table_size;
+    int *old = kc->table;
+    int size = old_size ? old_size * 2 : 64;
+
+    int *table = malloc(size * sizeof(int));
+    if (!table) return -1;
+    memset(table, -1, size * sizeof(int));
+    kc->table = table;
+    kc->table_size = size;
+
+    for (int i = 0; i < old_size; i++)
+        if (old[i] >= 0)
+            kc->table[table_find_slot(kc, kc->entries[old[i]].key)] = old[i];
+    free(old);
+    return 0;
+}
+
+/* Backward-shift deletion: later entries of the probe chain move up into
+ * the hole, so lookups never need tombstones. */
+static void table_remove(KeyCache *kc, long long key) {
+    unsigned long long mask = kc->table_size - 1;
+    unsigned long long i = (unsigned long long)table_find_slot(kc, key);
+    if (kc->table[i] < 0) return;
+
+    for (unsigned long long k = (i + 1) & mask; kc->table[k] >= 0; k = (k + 1) & mask) {
+        unsigned long long home = hash_key(kc->entries[kc->table[k]].key) & mask;
+        // move k into the hole unless its home lies between the two
+        if (((k - home) & mask) >= ((k - i) & mask)) {
+            kc->table[i] = kc->table[k];
+            i = k;
+        }
+    }
+    kc->table[i] = -1;
+}
+
+/* Entry id for `key`, added if needed; -1 when out of memory. */
+static int lookup_or_add(KeyCache *kc, long long key, double size_mb) {
+    int slot = table_find_slot(kc, key);
+    if (kc->table[slot] >= 0) return kc->table[slot];
+
+    // keep the load factor under 1/2
+    if (2 * (kc->n_live + 1) > kc->table_size) {
+        if (table_grow(kc) != 0) return -1;
+        slot = table_find_slot(kc, key);
+    }
+
+    int id = kc->free_head;
+    if (id >= 0) {
+        kc->free_head = kc->entries[id].next_free;
+    } else {
+        if (kc->n_entries == kc->cap_entries) {
+            int cap = kc->cap_entries ? kc->cap_entries * 2 : 64;
+            if (iheap_reserve(&kc->victims, cap) != 0) return -1;
+            KeyEntry *entries = realloc(kc->entries, cap * sizeof(KeyEntry));
+            if (!entries) return -1;
+            kc->entries = entries;
+            kc->cap_entries = cap;
+        }
+        id = kc->n_entries++;
+    }
+
+    KeyEntry *en = &kc->entries[id];
+    memset(en, 0, sizeof(*en));
+    en->key = key;
+    en->size_mb = size_mb;
+    en->next_free = -2;
+    kc->table[slot] = id;
+    kc->n_live++;
+    return id;
+}
+
+/* An entry that is neither resident nor pinned holds nothing worth
+ * keeping; its id goes back on the free list. */
+static void reclaim(KeyCache *kc, int id) {
+    KeyEntry *en = &kc->entries[id];
+    if (en->resident || en->refs > 0 || en->next_free != -2) return;
+    table_remove(kc, en->key);
+    kc->n_live--;
+    en->next_free = kc->free_head;
+    kc->free_head = id;
+}
+
+/* ===================== EVICTION ===================== */
+
+static double victim_key(const KeyCache *kc, const KeyEntry *en) {
+    switch (kc->policy) {
+    case KEY_EVICT_LFU:  return (double)en->uses;
+    case KEY_EVICT_GDSF: return en->prio;
+    default:             return (double)en->last_use;
+    }
+}
+
+static void touch(KeyCache *kc, KeyEntry *en) {
+    en->uses++;
+    en->last_use = kc->tick++;
+    en->prio = kc->gdsf_clock + (double)en->uses /
+               (en->size_mb > 0.0 ? en->size_mb : 1.0);
+}
+
+static int make_room(KeyCache *kc, double size_mb) {
+    while (kc->used_mb + size_mb > kc->capacity_mb) {
+        int v = iheap_pop(&kc->victims);
+        if (v < 0) return -1;
+
+        KeyEntry *en = &kc->entries[v];
+        if (kc->policy == KEY_EVICT_GDSF) kc->gdsf_clock = en->prio;
+        kc->used_mb -= en->size_mb;
+        en->resident = en->loaded = 0;
+
+        kc->stats.evictions++;
+        kc->stats.evicted_mb += en->size_mb;
+        reclaim(kc, v);
+    }
+    return 0;
+}
+
+/* ===================== API ===================== */
+
+KeyCache *key_cache_create(double capacity_mb, KeyEvictPolicy policy) {
+    KeyCache *kc = calloc(1, sizeof(KeyCache));
+    if (!kc) return NULL;
+    kc->policy = policy;
+    kc->capacity_mb = capacity_mb;
+    kc->free_head = -1;
+    if (iheap_init(&kc->victims, 64, 0) != 0 || table_grow(kc) != 0) {
+        key_cache_destroy(kc);
+        return NULL;
+    }
+    return kc;
+}
+
+void key_cache_destroy(KeyCache *kc) {
+    if (!kc) return;
+    iheap_free(&kc->victims);
+    free(kc->entries);
+    free(kc->table);
+    free(kc);
+}
+
+int key_cache_acquire(KeyCache *kc, long long key, double size_mb, int *status) {
+    int id = lookup_or_add(kc, key, size_mb);
+    if (id < 0) {
+        kc->stats.misses++;
+        kc->stats.bypasses++;
+        *status = KEY_BYPASS;
+        return -1;
+    }
+    KeyEntry *en = &kc->entries[id];
+
+    if (en->resident && size_mb <= en->size_mb) {
+        iheap_remove(&kc->victims, id);
+        en->refs++;
+        touch(kc, en);
+        kc->stats.hits++;
+        *status = en->loaded ? KEY_HIT : KEY_LOADING;
+        return id;
+    }
+
+    kc->stats.misses++;
+    if (en->resident) {
+        // a larger key set under the same id: reload it, unless jobs
+        // still hold the smaller one
+        if (en->refs > 0) {
+            kc->stats.bypasses++;
+            *status = KEY_BYPASS;
+            return -1;
+        }
+        iheap_remove(&kc->victims, id);
+        kc->used_mb -= en->size_mb;
+        en->resident = en->loaded = 0;
+    }
+    en->size_mb = size_mb;
+    if (size_mb > kc->capacity_mb || make_room(kc, size_mb) != 0) {
+        kc->stats.bypasses++;
+        reclaim(kc, id);
+        *status = KEY_BYPASS;
+        return -1;
+    }
+
+    kc->used_mb += size_mb;
+    en->resident = 1;
+    en->loaded = 0;
+    en->refs++;
+    touch(kc, en);
+    *status = KEY_MISS;
+    return id;
+}
+
+int key_cache_resident(const KeyCache *kc, long long key, double size_mb) {
+    int id = kc->table[table_find_slot(kc, key)];
+    return id >= 0 && kc->entries[id].resident && size_mb <= kc->entries[id].size_mb;
+}
+
+void key_cache_loaded(KeyCache *kc, int entry) {
+    if (entry < 0) return;
+    KeyEntry *en = &kc->entries[entry];
+    en->loaded = 1;
+    if (en->refs == 0) iheap_push(&kc->victims, entry, victim_key(kc, en));
+}
+
+void key_cache_release(KeyCache *kc, int entry) {
+    if (entry < 0) return;
+    KeyEntry *en = &kc->entries[entry];
+    if (en->refs > 0) en->refs--;
+    if (en->refs == 0 && en->loaded)
+        iheap_push(&kc->victims, entry, victim_key(kc, en));
+}
+
+KeyCacheStats key_cache_stats(const KeyCache *kc) {
+    return kc->stats;
+}
+
+typedef struct {
+    double used_mb;
+    double gdsf_clock;
+    long tick;
+    int n_entries;
+    int free_head;
+    KeyCacheStats stats;
+} SavedCache;
+
+int key_cache_save(const KeyCache *kc, FILE *f) {
+    SavedCache h = { kc->used_mb, kc->gdsf_clock, kc->tick, kc->n_entries,
+                     kc->free_head, kc->stats };
+    if (fwrite(&h, sizeof(h), 1, f) != 1) return -1;
+    if (kc->n_entries > 0 &&
+        fwrite(kc->entries, sizeof(KeyEntry), kc->n_entries, f) != (size_t)kc->n_entries)
+        return -1;
+    return 0;
+}
+
+int key_cache_load(KeyCache *kc, FILE *f) {
+    SavedCache h;
+    if (kc->n_entries > 0 || fread(&h, sizeof(h), 1, f) != 1) return -1;
+
+    if (h.n_entries > kc->cap_entries) {
+        if (iheap_reserve(&kc->victims, h.n_entries) != 0) return -1;
+        KeyEntry *entries = realloc(kc->entries, h.n_entries * sizeof(KeyEntry));
+        if (!entries) return -1;
+        kc->entries = entries;
+        kc->cap_entries = h.n_entries;
+    }
+    if (h.n_entries > 0 &&
+        fread(kc->entries, sizeof(KeyEntry), h.n_entries, f) != (size_t)h.n_entries)
+        return -1;
+    kc->n_entries = h.n_entries;
+    kc->free_head = h.free_head;
+
+    // ids and the free list come back as saved; the table is rebuilt
+    for (int id = 0; id < h.n_entries; id++) {
+        KeyEntry *en = &kc->entries[id];
+        if (en->next_free != -2) continue;
+        if (2 * (kc->n_live + 1) > kc->table_size && table_grow(kc) != 0) return -1;
+        kc->table[table_find_slot(kc, en->key)] = id;
+        kc->n_live++;
+        if (en->resident && en->loaded && en->refs == 0)
+            iheap_push(&kc->victims, id, victim_key(kc, en));
+    }
+    kc->used_mb = h.used_mb;
+    kc->gdsf_clock = h.gdsf_clock;
+    kc->tick = h.tick;
+    kc->stats = h.stats;
+    return 0;
+}
+
+long long key_cache_job_key(int key_id, int tenant_id, long long job_seq,
+                            KeySharing sharing)
+{
+    if (key_id >= 0) return key_id;
+    if (sharing == KEY_SHARE_TENANT) return (1LL << 40) + tenant_id;
+    return (2LL << 40) + job_seq;
+}
+
+int key_cache_parse_policy(const char *name, KeyEvictPolicy *out) {
+    if (strcmp(name, "lru") == 0) *out = KEY_EVICT_LRU;
+    else if (strcmp(name, "lfu") == 0) *out = KEY_EVICT_LFU;
+    else if (strcmp(name, "gdsf") == 0) *out = KEY_EVICT_GDSF;
+    else return -1;
+    return 0;
+}
+
+int key_cache_parse_sharing(const char *name, KeySharing *out) {
+    if (strcmp(name, "job") == 0) *out = KEY_SHARE_JOB;
+    else if (strcmp(name, "tenant") == 0) *out = KEY_SHARE_TENANT;
+    else return -1;
+    return 0;
+}
@@ -0,0 +1,193 @@
+#include <float.h>
+#include <stdlib.h>
+#include "../includes/ks_pipe.h"
+
+/* A key-switch and the time it finishes (in a unit) or was queued. */
+typedef struct {
+    KsOp op;
+    double t;
+} KsEntry;
+
+/* FIFO of entries. */
+typedef struct {
+    KsEntry *buf;
+    int head;
+    int len;
+    int cap;
+} KsRing;
+
+typedef struct {
+    KsRing in_flight;       // finish in ring order: one latency, FIFO starts
+    double next_accept;
+} KsUnit;
+
+struct KsPipe {
+    double latency_us;
+    double interval_us;     // between two starts on one unit
+    int queue_cap;
+
+    KsUnit *units;
+    int n_units;
+    KsRing queue;
+    KsRing done;
+    KsPipeStats stats;
+};
+
+static int ring_reserve(KsRing *r, int cap) {
+    if (cap <= r->cap) return 0;
+    KsEntry *buf = malloc(cap * sizeof(KsEntry));
+    if (!buf) return -1;
+    for (int i = 0; i < r->len; i++)
+        buf[i] = r->buf[(r->head + i) % r->cap];
+    free(r->buf);
+    r->buf = buf;
+    r->head = 0;
+    r->cap = cap;
+    return 0;
+}
+
+static void ring_push(KsRing *r, KsOp op, double t) {
+    r->buf[(r->head + r->len++) % r->cap] = (KsEntry){ op, t };
+}
+
+static KsEntry ring_pop(KsRing *r) {
+    KsEntry e = r->buf[r->head];
+    r->head = (r->head + 1) % r->cap;
+    r->len--;
+    return e;
+}
+
+KsPipe *ks_pipe_create(int units, double latency_us, int depth, int queue_cap) {
+    if (units < 1 || latency_us <= 0.0) return NULL;
+    if (depth < 1) depth = 1;
+    if (queue_cap < 0) queue_cap = 0;
+
+    KsPipe *p = calloc(1, sizeof(KsPipe));
+    if (!p) return NULL;
+    p->latency_us = latency_us;
+    p->interval_us = latency_us / depth;
+    p->queue_cap = queue_cap;
+    p->n_units = units;
+    p->units = calloc(units, sizeof(KsUnit));
+    if (!p->units) goto fail;
+    // starts are interval_us apart, so a unit never holds more than depth
+    // (one spare for rounding)
+    for (int u = 0; u < units; u++)
+        if (ring_reserve(&p->units[u].in_flight, depth + 1) != 0) goto fail;
+    if (ring_reserve(&p->queue, queue_cap > 0 ? queue_cap : 1) != 0 ||
+        ring_reserve(&p->done, units * (depth + 1)) != 0)
+        goto fail;
+    return p;
+
+fail:
+    ks_pipe_destroy(p);
+    return NULL;
+}
+
+void ks_pipe_destroy(KsPipe *p) {
+    if (!p) return;
+    if (p->units) {
+        for (int u = 0; u < p->n_units; u++) free(p->units[u].in_flight.buf);
+        free(p->units);
+    }
+    free(p->queue.buf);
+    free(p->done.buf);
+    free(p);
+}
+
+/* Unit whose oldest key-switch finishes first, -1 if all are empty. */
+static int first_done(const KsPipe *p) {
+    int best = -1;
+    double t = DBL_MAX;
+    for (int u = 0; u < p->n_units; u++) {
+        const KsRing *r = &p->units[u].in_flight;
+        if (r->len > 0 && r->buf[r->head].t < t) {
+            t = r->buf[r->head].t;
+            best = u;
+        }
+    }
+    return best;
+}
+
+/* Unit that can take a key-switch soonest. */
+static int first_free(const KsPipe *p) {
+    int best = 0;
+    for (int u = 1; u < p->n_units; u++)
+        if (p->units[u].next_accept < p->units[best].next_accept) best = u;
+    return best;
+}
+
+static void start(KsPipe *p, int u, KsOp op, double at_us) {
+    KsUnit *unit = &p->units[u];
+    ring_push(&unit->in_flight, op, at_us + p->latency_us);
+    unit->next_accept = at_us + p->interval_us;
+    p->stats.issue_us += p->interval_us;
+}
+
+void ks_pipe_advance(KsPipe *p, double now_us) {
+    for (;;) {
+        int u_done = first_done(p);
+        int u_free = first_free(p);
+        double t_done = u_done >= 0 ? p->units[u_done].in_flight.buf[
+                                          p->units[u_done].in_flight.head].t
+                                    : DBL_MAX;
+        double t_start = p->queue.len > 0 ? p->units[u_free].next_accept : DBL_MAX;
+        if (t_done > now_us && t_start > now_us) break;
+
+        // a unit's depth frees up as its oldest key-switch finishes
+        if (t_done <= t_start) {
+            // the caller pops after each advance; leave the rest for then
+            if (p->done.len == p->done.cap) break;
+            KsEntry e = ring_pop(&p->units[u_done].in_flight);
+            ring_push(&p->done, e.op, e.t);
+            p->stats.done++;
+        } else {
+            KsEntry e = ring_pop(&p->queue);
+            p->stats.queue_wait_us += t_start - e.t;
+            start(p, u_free, e.op, t_start);
+        }
+    }
+}
+
+int ks_pipe_offer(KsPipe *p, KsOp op, double now_us) {
+    ks_pipe_advance(p, now_us);
+
+    // a queued key-switch means no unit is free
+    int u = first_free(p);
+    if (p->queue.len == 0 && p->units[u].next_accept <= now_us) {
+        start(p, u, op, now_us);
+        return 1;
+    }
+    if (p->queue.len >= p->queue_cap) return 0;
+
+    ring_push(&p->queue, op, now_us);
+    if (p->queue.len > p->stats.max_queue) p->stats.max_queue = p->queue.len;
+    return 1;
+}
+
+int ks_pipe_pop_done(KsPipe *p, KsOp *op) {
+    if (p->done.len == 0) return 0;
+    *op = ring_pop(&p->done).op;
+    return 1;
+}
+
+double ks_pipe_next_event(const KsPipe *p) {
+    double t = DBL_MAX;
+    int u = first_done(p);
+    if (u >= 0) t = p->units[u].in_flight.buf[p->units[u].in_flight.head].t;
+    if (p->queue.len > 0) {
+        double t_start = p->units[first_free(p)].next_accept;
+        if (t_start < t) t = t_start;
+    }
+    return t;
+}
+
+int ks_pipe_pending(const KsPipe *p) {
+    int n = p->queue.len;
+    for (int u = 0; u < p->n_units; u++) n += p->units[u].in_flight.len;
+    return n;
+}
+
+KsPipeStats ks_pipe_stats(const KsPipe *p) {
+    return p->stats;
+}
@@ -1,40 +1,224 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 
 #include "../includes/types.h"
 #include "../includes/hw_config.h"
 #include "../includes/workload.h"
 #include "../includes/scheduler.h"
 #include "../includes/simulator.h"
+#include "../includes/sweep.h"
+#include "../includes/sched_registry.h"
+#include "../includes/cluster.h"
+#include "../includes/tune.h"
+#include "../includes/daemon.h"
+
+#define MAX_SCHEDULERS 16
+
+static void print_percentiles(const char *name, const Percentiles *p,
+                              const char *unit)
+{
+    printf("%s P50/P90/P99/P99.9: %.2f / %.2f / %.2f / %.2f%s\n",
+           name, p->p50, p->p90, p->p99, p->p999, unit);
+}
+
+/* Deadline and admission lines, only for jobs that had a deadline or
+ * were turned away. */
+static void print_deadlines(const char *indent, const DeadlineStats *d)
+{
+    if (d->with_deadline > 0) {
+        printf("%sDeadlines: %ld of %ld met (miss rate %.3f)\n", indent,
+               d->with_deadline - d->missed, d->with_deadline,
+               (double)d->missed / d->with_deadline);
+        // a cluster total has no lateness percentiles
+        if (d->missed > 0 && d->lateness_us.p999 > 0.0) {
+            char name[64];
+            snprintf(name, sizeof(name), "%sLateness", indent);
+            print_percentiles(name, &d->lateness_us, " us");
+        }
+    }
+    if (d->rejected > 0 || d->deferred > 0)
+        printf("%sAdmission: %ld rejected, %ld deferred\n", indent,
+               d->rejected, d->deferred);
+}
 
 static void print_stats(const char *label, const HwConfig *cfg,
-                        const SimStats *s, int n_jobs)
+                        const SimStats *s, long n_jobs, int per_tenant)
 {
     printf("=== %s ===\n", label);
     printf("Engines: %d | HBM: %.1f Gbps | Key Mem: %.1f MB\n",
            cfg->num_engines, cfg->hbm_bandwidth_gbps, cfg->key_mem_mb);
 
-    printf("Jobs: %d\n", n_jobs);
+    printf("Jobs: %ld\n", n_jobs);
     printf("Makespan: %.2f us\n", s->makespan_us);
     printf("Avg Completion: %.2f us\n", s->avg_completion_time_us);
     printf("Avg Slowdown: %.3f\n", s->avg_slowdown);
     printf("Utilization: %.3f\n", s->engine_utilization);
-    printf("Fairness (Jain over tenant avg slowdown): %.4f\n\n", s->fairness);
+    printf("Fairness (Jain over tenant avg slowdown): %.4f\n", s->fairness);
+    print_percentiles("Response", &s->response_us, " us");
+    print_percentiles("Queueing", &s->queue_us, " us");
+    print_percentiles("Slowdown", &s->slowdown, "");
+    print_deadlines("", &s->deadlines);
+    // per priority once there is more than one
+    for (int p = 0; s->n_priorities > 1 && p < s->n_priorities; p++) {
+        const PriorityStats *ps = &s->priorities[p];
+        if (ps->deadlines.with_deadline == 0 && ps->deadlines.rejected == 0)
+            continue;
+        char name[32];
+        snprintf(name, sizeof(name), "  Priority %d ", ps->priority);
+        print_deadlines(name, &ps->deadlines);
+    }
+
+    for (int t = 0; per_tenant && t < s->n_tenants; t++) {
+        const TenantStats *ts = &s->tenants[t];
+        printf("  Tenant %d (%ld jobs)\n", ts->tenant_id, ts->n_jobs);
+        print_percentiles("    Response", &ts->response_us, " us");
+        print_percentiles("    Queueing", &ts->queue_us, " us");
+        print_percentiles("    Slowdown", &ts->slowdown, "");
+        print_deadlines("    ", &ts->deadlines);
+    }
+
+    long lookups = s->key_hits + s->key_misses;
+    if (lookups > 0) {
+        printf("Key cache: %ld hits / %ld lookups (hit rate %.3f), "
+               "%ld evictions (%.1f MB)\n",
+               s->key_hits, lookups, (double)s->key_hits / lookups,
+               s->key_evictions, s->key_evicted_mb);
+        printf("PCIe moved: %.1f MB\n", s->pcie_mb_moved);
+    }
+    if (s->prefetches > 0) {
+        printf("Prefetch: %ld uploads (accuracy %.3f), %.1f MB, %.1f MB wasted\n",
+               s->prefetches, (double)s->prefetch_accurate / s->prefetches,
+               s->prefetch_mb, s->prefetch_wasted_mb);
+    }
+    if (s->key_switches > 0) {
+        double engine_us = s->makespan_us * cfg->num_engines;
+        printf("Key-switch: %lld ops on %d units, utilization %.3f, "
+               "queue wait avg %.2f us (peak %d of %d)\n",
+               s->key_switches, cfg->ks_units, s->ks_utilization,
+               s->ks_queue_wait_us / s->key_switches, s->ks_queue_peak,
+               cfg->ks_queue);
+        printf("Engine stall on key-switch queue: %.3f of engine time\n",
+               engine_us > 0 ? s->engine_stall_us / engine_us : 0.0);
+    }
+    printf("\n");
+}
+
+/* Runs forked from one snapshot, spread over worker threads. */
+typedef struct {
+    const HwConfig *cfg;
+    TfheJob *jobs;
+    int n_jobs;
+    const SchedulerOps **scheds;
+    SimParams *params;          // one per run
+    SimStats *stats;
+    int n_runs;
+    int next;
+    pthread_mutex_t lock;
+} ForkRuns;
+
+static void *fork_worker(void *arg) {
+    ForkRuns *f = arg;
+    for (;;) {
+        pthread_mutex_lock(&f->lock);
+        int k = f->next++;
+        pthread_mutex_unlock(&f->lock);
+        if (k >= f->n_runs) return NULL;
+        f->stats[k] = run_simulation_ops(f->cfg, f->jobs, f->n_jobs, f->scheds[k],
+                                         &f->params[k]);
+    }
+}
+
+static void print_cluster_stats(const char *label, const ClusterConfig *c,
+                                const ClusterStats *cs, int per_tenant)
+{
+    static const char *dispatch_names[] = {
+        [DISPATCH_LEAST_LOADED] = "least-loaded",
+        [DISPATCH_KEY_LOCALITY] = "key-locality",
+        [DISPATCH_TENANT_PINNED] = "tenant-pinned"
+    };
+    const SimStats *s = &cs->total;
+
+    printf("=== %s (cluster) ===\n", label);
+    printf("Devices: %d | Dispatch: %s | Link latency: %.2f us | Windows: %lld\n",
+           c->n_devices, dispatch_names[c->dispatch], c->link_latency_us,
+           cs->windows);
+    printf("Jobs: %ld\n", s->n_jobs);
+    printf("Makespan: %.2f us\n", s->makespan_us);
+    printf("Avg Completion: %.2f us\n", s->avg_completion_time_us);
+    printf("Avg Slowdown: %.3f\n", s->avg_slowdown);
+    printf("Utilization: %.3f\n", s->engine_utilization);
+    printf("Fairness (Jain over tenant avg slowdown): %.4f\n", s->fairness);
+    print_deadlines("", &s->deadlines);
+    printf("\n");
+
+    for (int d = 0; d < cs->n_devices; d++) {
+        char dev_label[256];
+        snprintf(dev_label, sizeof(dev_label), "%s / device %d", label, d);
+        if (cs->dev[d].n_jobs == 0) {
+            printf("=== %s ===\nJobs: 0\n\n", dev_label);
+            continue;
+        }
+        print_stats(dev_label, &c->hw[d], &cs->dev[d], cs->dev[d].n_jobs,
+                    per_tenant);
+    }
 }
 
 int main(int argc, char **argv) {
     if (argc < 3) {
-        printf("Usage: %s [--pcie-scale SCALE] [--pcie-cap-mb CAP] [--progress] [--dump-csv PREFIX] [--hps-w1 w1 --hps-w2 w2 --hps-w3 w3 --hps-w4 w4 --hps-w5 w5] <hw.cfg> <workload.txt>\n", argv[0]);
+        printf("Usage: %s [--pcie-scale SCALE] [--pcie-cap-mb CAP] [--pcie-dma-depth N] [--pcie-setup-us US] [--cost-model static|roofline] [--prefetch N] [--prefetch-budget-mb MB] [--dag GRAPHS] [--admit all|reject|defer] [--progress] [--no-fast-forward] [--stream] [--tenant-stats] [--instrument REPORT.json] [--scheduler NAME[:ARG]]... [--sched-plugin LIB.so]... [--key-cache lru|lfu|gdsf] [--key-sharing job|tenant] [--dump-csv PREFIX] [--out-dir DIR] [--timeline csv|bin|merged] [--timeline-merge-us US] [--hps-w1 w1 --hps-w2 w2 --hps-w3 w3 --hps-w4 w4 --hps-w5 w5] <hw.cfg> <workload.txt>\n", argv[0]);
+        printf("       %s --cluster CLUSTER.cfg [--scheduler NAME[:ARG]]... <workload.txt>\n", argv[0]);
+        printf("       %s --tune p99-slowdown|makespan|fairness|mix:A,B,C [--tune-method random|halving] [--tune-budget N] [--tune-seed S] [--tune-out OUT.csv] [--no-early-stop] [--threads N] <hw.cfg> <workload.txt>\n", argv[0]);
+        printf("       %s --sweep GRID [--threads N] [--sweep-out OUT.csv] <workload.txt>\n", argv[0]);
+        printf("       %s --snapshot-at US --snapshot-out SNAP [--scheduler NAME[:ARG]] [options] <hw.cfg> <workload.txt>\n", argv[0]);
+        printf("       %s --restore SNAP [--threads N] [--scheduler NAME[:ARG]]... [options] <hw.cfg> <workload.txt>\n", argv[0]);
+        printf("       %s --daemon SOCKET|- [--scheduler NAME[:ARG]] <hw.cfg>\n", argv[0]);
+        printf("       %s --replay SOCKET|- [--scheduler NAME[:ARG]] <hw.cfg> <workload.txt>\n", argv[0]);
+        printf("       %s --convert OUT.wlb <workload.txt>\n", argv[0]);
+        printf("       %s [--sched-plugin LIB.so]... --list-schedulers\n", argv[0]);
         return 1;
     }
 
     double pcie_scale = 1.0;
     double pcie_cap_mb = 0.0;
+    int pcie_dma_depth = 0;
+    double pcie_setup_us = 0.0;
+    HwCostModel cost_model = HW_COST_STATIC;
+    int prefetch_depth = 0;
+    double prefetch_budget_mb = 0.0;
     int show_progress = 0;
     const char *hw_path = NULL;
     const char *wl_path = NULL;
     const char *csv_prefix = NULL;
+    const char *out_dir = NULL;
+    TimelineFormat timeline_format = TIMELINE_CSV;
+    double timeline_merge_us = 0.0;
+    const char *sweep_path = NULL;
+    const char *cluster_path = NULL;
+    int tune = 0;
+    const char *tune_out = NULL;
+    TuneOptions tune_opt;
+    tune_options_default(&tune_opt);
+    const char *sweep_out = NULL;
+    const char *convert_out = NULL;
+    int threads = 0;
+    double snapshot_at_us = -1.0;
+    const char *snapshot_out = NULL;
+    const char *restore_path = NULL;
+    const char *dag_path = NULL;
+    AdmitPolicy admit = ADMIT_ALL;
+    const char *daemon_path = NULL;
+    const char *replay_path = NULL;
+    int stream = 0;
+    int per_tenant = 0;
+    const char *instrument_path = NULL;
+    const char *sched_specs[MAX_SCHEDULERS];
+    int n_sched_specs = 0;
+    int list_schedulers = 0;
+    int key_cache = 0;
+    KeyEvictPolicy key_policy = KEY_EVICT_LRU;
+    KeySharing key_sharing = KEY_SHARE_TENANT;
     double hps_w1 = -1.0, hps_w2 = -1.0, hps_w3 = -1.0, hps_w4 = -1.0, hps_w5 = -1.0;
 
     // simple CLI parsing
@@ -43,8 +227,47 @@ int main(int argc, char **argv) {
             pcie_scale = atof(argv[++i]);
         } else if (strcmp(argv[i], "--progress") == 0) {
             show_progress = 1;
+        } else if (strcmp(argv[i], "--no-fast-forward") == 0) {
+            simulator_set_fast_forward(0);
+        } else if (strcmp(argv[i], "--stream") == 0) {
+            stream = 1;
+        } else if (strcmp(argv[i], "--tenant-stats") == 0) {
+            per_tenant = 1;
+        } else if (strcmp(argv[i], "--instrument") == 0 && i + 1 < argc) {
+            instrument_path = argv[++i];
+        } else if (strcmp(argv[i], "--scheduler") == 0 && i + 1 < argc) {
+            if (n_sched_specs == MAX_SCHEDULERS) {
+                printf("At most %d schedulers per run\n", MAX_SCHEDULERS);
+                return 1;
+            }
+            sched_specs[n_sched_specs++] = argv[++i];
+        } else if (strcmp(argv[i], "--sched-plugin") == 0 && i + 1 < argc) {
+            if (sched_registry_load(argv[++i]) < 0)
+                return 1;
+        } else if (strcmp(argv[i], "--list-schedulers") == 0) {
+            list_schedulers = 1;
+        } else if (strcmp(argv[i], "--key-cache") == 0 && i + 1 < argc) {
+            if (key_cache_parse_policy(argv[++i], &key_policy) != 0) {
+                printf("Unknown key cache policy: %s\n", argv[i]);
+                return 1;
+            }
+            key_cache = 1;
+        } else if (strcmp(argv[i], "--key-sharing") == 0 && i + 1 < argc) {
+            if (key_cache_parse_sharing(argv[++i], &key_sharing) != 0) {
+                printf("Unknown key sharing mode: %s\n", argv[i]);
+                return 1;
+            }
         } else if (strcmp(argv[i], "--dump-csv") == 0 && i + 1 < argc) {
             csv_prefix = argv[++i];
+        } else if (strcmp(argv[i], "--out-dir") == 0 && i + 1 < argc) {
+            out_dir = argv[++i];
+        } else if (strcmp(argv[i], "--timeline") == 0 && i + 1 < argc) {
+            if (timeline_parse_format(argv[++i], &timeline_format) != 0) {
+                printf("Unknown timeline format: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--timeline-merge-us") == 0 && i + 1 < argc) {
+            timeline_merge_us = atof(argv[++i]);
         } else if (strcmp(argv[i], "--hps-w1") == 0 && i + 1 < argc) {
             hps_w1 = atof(argv[++i]);
         } else if (strcmp(argv[i], "--hps-w2") == 0 && i + 1 < argc) {
@@ -57,6 +280,65 @@ int main(int argc, char **argv) {
             hps_w5 = atof(argv[++i]);
         } else if (strcmp(argv[i], "--pcie-cap-mb") == 0 && i + 1 < argc) {
             pcie_cap_mb = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--pcie-dma-depth") == 0 && i + 1 < argc) {
+            pcie_dma_depth = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--pcie-setup-us") == 0 && i + 1 < argc) {
+            pcie_setup_us = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--cost-model") == 0 && i + 1 < argc) {
+            if (hw_cost_parse_model(argv[++i], &cost_model) != 0) {
+                printf("Unknown cost model: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--prefetch") == 0 && i + 1 < argc) {
+            prefetch_depth = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--prefetch-budget-mb") == 0 && i + 1 < argc) {
+            prefetch_budget_mb = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--sweep") == 0 && i + 1 < argc) {
+            sweep_path = argv[++i];
+        } else if (strcmp(argv[i], "--cluster") == 0 && i + 1 < argc) {
+            cluster_path = argv[++i];
+        } else if (strcmp(argv[i], "--tune") == 0 && i + 1 < argc) {
+            if (tune_parse_objective(argv[++i], &tune_opt) != 0) {
+                printf("Unknown tuning objective: %s\n", argv[i]);
+                return 1;
+            }
+            tune = 1;
+        } else if (strcmp(argv[i], "--tune-method") == 0 && i + 1 < argc) {
+            if (tune_parse_method(argv[++i], &tune_opt.method) != 0) {
+                printf("Unknown tuning method: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--tune-budget") == 0 && i + 1 < argc) {
+            tune_opt.budget = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--tune-seed") == 0 && i + 1 < argc) {
+            tune_opt.seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--tune-out") == 0 && i + 1 < argc) {
+            tune_out = argv[++i];
+        } else if (strcmp(argv[i], "--no-early-stop") == 0) {
+            tune_opt.early_stop = 0;
+        } else if (strcmp(argv[i], "--sweep-out") == 0 && i + 1 < argc) {
+            sweep_out = argv[++i];
+        } else if (strcmp(argv[i], "--convert") == 0 && i + 1 < argc) {
+            convert_out = argv[++i];
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--snapshot-at") == 0 && i + 1 < argc) {
+            snapshot_at_us = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--snapshot-out") == 0 && i + 1 < argc) {
+            snapshot_out = argv[++i];
+        } else if (strcmp(argv[i], "--restore") == 0 && i + 1 < argc) {
+            restore_path = argv[++i];
+        } else if (strcmp(argv[i], "--dag") == 0 && i + 1 < argc) {
+            dag_path = argv[++i];
+        } else if (strcmp(argv[i], "--daemon") == 0 && i + 1 < argc) {
+            daemon_path = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replay_path = argv[++i];
+        } else if (strcmp(argv[i], "--admit") == 0 && i + 1 < argc) {
+            if (sim_parse_admit(argv[++i], &admit) != 0) {
+                printf("Unknown admission policy: %s\n", argv[i]);
+                return 1;
+            }
         } else if (argv[i][0] == '-') {
             printf("Unknown option: %s\n", argv[i]);
             return 1;
@@ -70,25 +352,125 @@ int main(int argc, char **argv) {
         }
     }
 
-    if (!hw_path || !wl_path) {
+    if (list_schedulers) {
+        sched_registry_list(stdout);
+        return 0;
+    }
+
+    // text-to-binary conversion needs no hw config
+    if (convert_out) {
+        if (!hw_path || wl_path) {
+            printf("Usage: %s --convert OUT.wlb <workload.txt>\n", argv[0]);
+            return 1;
+        }
+        return workload_convert(hw_path, convert_out) == 0 ? 0 : 1;
+    }
+
+    // sweep and cluster modes take their hw configs from their own files:
+    // the only positional argument is the workload
+    if ((sweep_path || cluster_path) && hw_path && !wl_path) {
+        wl_path = hw_path;
+        hw_path = NULL;
+    }
+
+    if (cluster_path && (hw_path || !wl_path || sweep_path)) {
+        printf("Usage: %s --cluster CLUSTER.cfg [--scheduler NAME[:ARG]]... <workload.txt>\n", argv[0]);
+        return 1;
+    }
+
+    if (cluster_path && instrument_path) {
+        printf("--instrument covers single-device runs; it cannot be combined with --cluster\n");
+        return 1;
+    }
+
+    // the daemon gets its jobs from the hardware, not a trace
+    if (daemon_path) {
+        if (!hw_path || wl_path || replay_path || sweep_path || cluster_path ||
+            tune || stream || snapshot_out || restore_path || n_sched_specs > 1) {
+            printf("Usage: %s --daemon SOCKET|- [--scheduler NAME[:ARG]] <hw.cfg>\n", argv[0]);
+            return 1;
+        }
+    } else if (!sweep_path && !cluster_path && (!hw_path || !wl_path)) {
         printf("Usage: %s [--pcie-scale SCALE] [--pcie-cap-mb CAP] <hw.cfg> <workload.txt>\n", argv[0]);
         return 1;
     }
 
+    if (sweep_path && (hw_path || !wl_path)) {
+        printf("Usage: %s --sweep GRID [--threads N] [--sweep-out OUT.csv] <workload.txt>\n", argv[0]);
+        return 1;
+    }
+
+    if (replay_path && (sweep_path || cluster_path || tune || stream ||
+                        snapshot_out || restore_path || n_sched_specs > 1)) {
+        printf("--replay drives one daemon with one trace; it cannot be combined with --sweep, --cluster, --tune, --stream or snapshots\n");
+        return 1;
+    }
+
+    if (tune && (sweep_path || cluster_path || stream)) {
+        printf("--tune runs on one loaded workload; it cannot be combined with --sweep, --cluster or --stream\n");
+        return 1;
+    }
+
+    if ((snapshot_out != NULL) != (snapshot_at_us >= 0.0)) {
+        printf("--snapshot-at and --snapshot-out go together\n");
+        return 1;
+    }
+
+    if ((snapshot_out || restore_path) && (cluster_path || stream || tune)) {
+        printf("Snapshots need one device and the whole trace loaded; they cannot be combined with --cluster, --stream or --tune\n");
+        return 1;
+    }
+
+    if ((snapshot_out || restore_path) && dag_path) {
+        printf("Snapshots do not cover bootstrap graphs; drop --dag\n");
+        return 1;
+    }
+
+    if ((snapshot_out || restore_path) && admit != ADMIT_ALL) {
+        printf("Snapshots do not cover admission control; drop --admit\n");
+        return 1;
+    }
+
+    if (snapshot_out && sweep_path) {
+        printf("--snapshot-out runs one scheduler; take the snapshot first, then --restore it in the sweep\n");
+        return 1;
+    }
+
+    if (sweep_path && stream) {
+        printf("--stream runs one simulation at a time; it cannot be combined with --sweep\n");
+        return 1;
+    }
+
     HwConfig cfg;
-    if (read_hw_config(hw_path, &cfg) != 0)
+    if (!sweep_path && !cluster_path && read_hw_config(hw_path, &cfg) != 0)
         return 1;
 
-    TfheJob *jobs;
-    int n_jobs;
-    if (read_workload(wl_path, &jobs, &n_jobs) != 0)
+    if (!sweep_path && (snapshot_out || restore_path) && cfg.ks_units > 0) {
+        printf("Snapshots do not cover key-switch units; drop the keyswitch line from %s\n",
+               hw_path);
         return 1;
+    }
 
     // apply testing knobs
     if (pcie_scale != 1.0) simulator_set_pcie_scale(pcie_scale);
     if (pcie_cap_mb > 0.0) simulator_set_pcie_cap_mb(pcie_cap_mb);
+    simulator_set_pcie_dma(pcie_dma_depth, pcie_setup_us);
+    simulator_set_prefetch(prefetch_depth, prefetch_budget_mb);
+    simulator_set_cost_model(cost_model);
     if (show_progress) simulator_set_show_progress(1);
     if (csv_prefix) simulator_set_csv_prefix(csv_prefix);
+    if (out_dir) simulator_set_out_dir(out_dir);
+    simulator_set_timeline(timeline_format, timeline_merge_us);
+    if (key_cache) simulator_set_key_cache(1, key_policy, key_sharing);
+    simulator_set_admit(admit);
+
+    JobDagSet *dags = NULL;
+    if (dag_path) {
+        dags = dag_set_load(dag_path);
+        if (!dags)
+            return 1;
+        simulator_set_dags(dags);
+    }
 
     // Apply HPS weight overrides if provided
     if (hps_w1 >= 0.0 || hps_w2 >= 0.0 || hps_w3 >= 0.0 || hps_w4 >= 0.0 || hps_w5 >= 0.0) {
@@ -101,15 +483,206 @@ int main(int argc, char **argv) {
         scheduler_set_weights(w1, w2, w3, w4, w5);
     }
 
-    SimStats fifo_stats = run_simulation(&cfg, jobs, n_jobs,
-        (SchedulerFn)pick_job_fifo);
+    // FIFO and HPS unless --scheduler picked others
+    const SchedulerOps *scheds[MAX_SCHEDULERS] = { &sched_fifo_ops, &sched_hps_ops };
+    const char *sched_args[MAX_SCHEDULERS] = { NULL, NULL };
+    int n_scheds = 2;
+    if (n_sched_specs > 0) {
+        if (sweep_path) {
+            printf("--scheduler cannot be combined with --sweep; use the grid's sched axis\n");
+            return 1;
+        }
+        for (int k = 0; k < n_sched_specs; k++) {
+            char name[256];
+            scheds[k] = sched_registry_resolve(sched_specs[k], name, sizeof(name),
+                                               &sched_args[k]);
+            if (!scheds[k])
+                return 1;
+        }
+        n_scheds = n_sched_specs;
+    }
+
+    const char *labels[MAX_SCHEDULERS];
+    const char *sched_names[MAX_SCHEDULERS];
+    for (int k = 0; k < n_scheds; k++) {
+        labels[k] = scheds[k]->label ? scheds[k]->label : scheds[k]->name;
+        sched_names[k] = scheds[k]->name;
+    }
+
+    // online mode runs HPS unless --scheduler picked another
+    if (daemon_path || replay_path) {
+        const SchedulerOps *ops = n_sched_specs > 0 ? scheds[0] : &sched_hps_ops;
+        if (daemon_path)
+            return daemon_serve(&cfg, ops, sched_args[0], daemon_path) == 0 ? 0 : 1;
+
+        TfheJob *jobs;
+        int n_jobs;
+        if (read_workload(wl_path, &jobs, &n_jobs) != 0)
+            return 1;
+        int rc = daemon_replay(&cfg, ops, sched_args[0], replay_path, jobs, n_jobs);
+        free(jobs);
+        return rc == 0 ? 0 : 1;
+    }
 
-    SimStats hps_stats = run_simulation(&cfg, jobs, n_jobs,
-        (SchedulerFn)pick_job_hps);
+    if (cluster_path) {
+        // devices are fed as the host reads the trace, so it is streamed
+        ClusterConfig cc;
+        if (read_cluster_config(cluster_path, &cc) != 0)
+            return 1;
+        SimParams params;
+        sim_params_default(&params);
+
+        int rc = 0;
+        for (int k = 0; k < n_scheds && rc == 0; k++) {
+            JobSource src;
+            ClusterStats cs;
+            params.sched_arg = sched_args[k];
+            if (workload_stream_open(wl_path, &src) != 0) {
+                rc = 1;
+                break;
+            }
+            if (run_cluster(&cc, &src, scheds[k], &params, &cs) != 0)
+                rc = 1;
+            else
+                print_cluster_stats(labels[k], &cc, &cs, per_tenant);
+            workload_stream_close(&src);
+            cluster_stats_free(&cs);
+        }
+        cluster_config_free(&cc);
+        return rc;
+    }
+
+    if (stream) {
+        // one pass over the trace per scheduler; nothing is kept in memory
+        // beyond the jobs in flight
+        SimStats stats[MAX_SCHEDULERS];
+        SimCounters counters[MAX_SCHEDULERS];
+        SimParams params;
+        sim_params_default(&params);
+
+        for (int k = 0; k < n_scheds; k++) {
+            JobSource src;
+            params.counters = instrument_path ? &counters[k] : NULL;
+            params.sched_arg = sched_args[k];
+            if (workload_stream_open(wl_path, &src) != 0)
+                return 1;
+            int rc = run_simulation_stream_ops(&cfg, &src, scheds[k], &params,
+                                               &stats[k]);
+            workload_stream_close(&src);
+            if (rc != 0)
+                return 1;
+        }
+        // jobs read, as for a loaded trace, rejected ones included
+        for (int k = 0; k < n_scheds; k++)
+            print_stats(labels[k], &cfg, &stats[k],
+                        stats[k].n_jobs + stats[k].deadlines.rejected, per_tenant);
+        int rc = 0;
+        if (instrument_path &&
+            instrument_write_report(instrument_path, sched_names, stats,
+                                    counters, n_scheds) != 0)
+            rc = 1;
+        for (int k = 0; k < n_scheds; k++)
+            sim_stats_free(&stats[k]);
+        return rc;
+    }
+
+    TfheJob *jobs;
+    int n_jobs;
+    if (read_workload(wl_path, &jobs, &n_jobs) != 0)
+        return 1;
+    if (dags && dag_set_check(dags, jobs, n_jobs) != 0) {
+        free(jobs);
+        return 1;
+    }
+
+    SimSnapshot *snap = NULL;
+    if (restore_path) {
+        SimParams check;
+        sim_params_default(&check);
+        snap = sim_snapshot_load(restore_path);
+        if (!snap || (!sweep_path &&
+                      sim_snapshot_check(snap, &cfg, jobs, n_jobs, &check) != 0)) {
+            sim_snapshot_free(snap);
+            free(jobs);
+            return 1;
+        }
+        simulator_set_restore(snap);
+        fprintf(stderr, "Starting from the snapshot at %.0f us\n",
+                sim_snapshot_time(snap));
+    }
+
+    if (snapshot_out) {
+        // the warm-up runs the first scheduler only
+        SimParams params;
+        sim_params_default(&params);
+        params.sched_arg = sched_args[0];
+        int rc = run_simulation_snapshot(&cfg, jobs, n_jobs, scheds[0], &params,
+                                         snapshot_at_us, snapshot_out);
+        if (rc == 0)
+            printf("Snapshot of %s at %.0f us written to %s\n",
+                   labels[0], snapshot_at_us, snapshot_out);
+        sim_snapshot_free(snap);
+        free(jobs);
+        return rc == 0 ? 0 : 1;
+    }
+
+    if (sweep_path) {
+        int rc = run_sweep(sweep_path, jobs, n_jobs, threads, sweep_out);
+        sim_snapshot_free(snap);
+        free(jobs);
+        return rc == 0 ? 0 : 1;
+    }
+
+    if (tune) {
+        SimParams params;
+        sim_params_default(&params);
+        HpsWeights best;
+        tune_opt.threads = threads;
+        int rc = run_tune(&cfg, jobs, n_jobs, &tune_opt, &params, tune_out, &best);
+        free(jobs);
+        return rc == 0 ? 0 : 1;
+    }
+
+    SimStats stats[MAX_SCHEDULERS];
+    SimCounters counters[MAX_SCHEDULERS];
+    SimParams params[MAX_SCHEDULERS];
+
+    for (int k = 0; k < n_scheds; k++) {
+        sim_params_default(&params[k]);
+        params[k].counters = instrument_path ? &counters[k] : NULL;
+        params[k].sched_arg = sched_args[k];
+    }
+
+    if (snap) {
+        // forks of one warm state are independent: run them side by side
+        ForkRuns f = { .cfg = &cfg, .jobs = jobs, .n_jobs = n_jobs,
+                       .scheds = scheds, .params = params, .stats = stats,
+                       .n_runs = n_scheds };
+        pthread_mutex_init(&f.lock, NULL);
+        int n_threads = threads > 0 && threads < n_scheds ? threads : n_scheds;
+        pthread_t tids[MAX_SCHEDULERS];
+        for (int t = 0; t < n_threads; t++)
+            pthread_create(&tids[t], NULL, fork_worker, &f);
+        for (int t = 0; t < n_threads; t++)
+            pthread_join(tids[t], NULL);
+        pthread_mutex_destroy(&f.lock);
+    } else {
+        for (int k = 0; k < n_scheds; k++)
+            stats[k] = run_simulation_ops(&cfg, jobs, n_jobs, scheds[k], &params[k]);
+    }
 
-    print_stats("FIFO Baseline", &cfg, &fifo_stats, n_jobs);
-    print_stats("HPS Scheduler", &cfg, &hps_stats, n_jobs);
+    for (int k = 0; k < n_scheds; k++)
+        print_stats(labels[k], &cfg, &stats[k], n_jobs, per_tenant);
+    int rc = 0;
+    if (instrument_path &&
+        instrument_write_report(instrument_path, sched_names, stats,
+                                counters, n_scheds) != 0)
+        rc = 1;
+    for (int k = 0; k < n_scheds; k++)
+        sim_stats_free(&stats[k]);
 
+    sim_snapshot_free(snap);
     free(jobs);
-    return 0;
+    dag_set_free(dags);
+    return rc;
 }
@@ -0,0 +1,291 @@
+#include <float.h>
+#include <stdlib.h>
+#include "../includes/pcie.h"
+#include "../includes/heap.h"
+
+/* FIFO of transfer ids; each id sits in at most one ring at a time. */
+typedef struct {
+    int *buf;
+    int head;
+    int len;
+    int cap;
+} IdRing;
+
+struct PcieLink {
+    double rate;            // bits per us, whole link
+    int dma_depth;          // 0 = no limit
+    double setup_us;
+
+    double now_us;          // link time
+    double vtime;           // bits moved by each transfer on the link
+    IndexedHeap on_link;    // keyed by finishing tag
+    IdRing waiting;         // for a DMA slot
+    IdRing setup;           // setup ends in ring order
+    IdRing done;            // finished, not popped yet
+
+    double *bits;           // per id, while waiting or in setup
+    double *setup_end;      // per id, while in setup
+    long long *seq;         // submission order, breaks tag ties
+    long long n_submitted;
+    long long steps;
+    int cap;
+};
+
+static int ring_reserve(IdRing *r, int cap) {
+    if (cap <= r->cap) return 0;
+    int *buf = malloc(cap * sizeof(int));
+    if (!buf) return -1;
+    for (int i = 0; i < r->len; i++)
+        buf[i] = r->buf[(r->head + i) % r->cap];
+    free(r->buf);
+    r->buf = buf;
+    r->head = 0;
+    r->cap = cap;
+    return 0;
+}
+
+static void ring_push(IdRing *r, int id) {
+    r->buf[(r->head + r->len++) % r->cap] = id;
+}
+
+static int ring_pop(IdRing *r) {
+    int id = r->buf[r->head];
+    r->head = (r->head + 1) % r->cap;
+    r->len--;
+    return id;
+}
+
+PcieLink *pcie_link_create(double bits_per_us, int dma_depth, double setup_us) {
+    PcieLink *l = calloc(1, sizeof(PcieLink));
+    if (!l) return NULL;
+    l->rate = bits_per_us;
+    l->dma_depth = dma_depth > 0 ? dma_depth : 0;
+    l->setup_us = setup_us > 0.0 ? setup_us : 0.0;
+    iheap_init(&l->on_link, 0, 0);
+    return l;
+}
+
+void pcie_link_destroy(PcieLink *l) {
+    if (!l) return;
+    iheap_free(&l->on_link);
+    free(l->waiting.buf);
+    free(l->setup.buf);
+    free(l->done.buf);
+    free(l->bits);
+    free(l->setup_end);
+    free(l->seq);
+    free(l);
+}
+
+int pcie_link_reserve(PcieLink *l, int cap) {
+    if (cap <= l->cap) return 0;
+
+    double *bits = realloc(l->bits, cap * sizeof(double));
+    if (bits) l->bits = bits;
+    double *setup_end = realloc(l->setup_end, cap * sizeof(double));
+    if (setup_end) l->setup_end = setup_end;
+    long long *seq = realloc(l->seq, cap * sizeof(long long));
+    if (seq) l->seq = seq;
+    if (!bits || !setup_end || !seq) return -1;
+
+    if (iheap_reserve(&l->on_link, cap) != 0 ||
+        ring_reserve(&l->waiting, cap) != 0 ||
+        ring_reserve(&l->setup, cap) != 0 ||
+        ring_reserve(&l->done, cap) != 0)
+        return -1;
+    l->on_link.tie = l->seq;
+    l->cap = cap;
+    return 0;
+}
+
+/* Bandwidth of each transfer on the link. */
+static double share(const PcieLink *l) {
+    return l->rate / l->on_link.len;
+}
+
+static double next_completion(const PcieLink *l) {
+    int id = iheap_top(&l->on_link);
+    if (id < 0 || l->rate <= 0.0) return DBL_MAX;
+    return l->now_us + (l->on_link.key[id] - l->vtime) / share(l);
+}
+
+static void move_to(PcieLink *l, double t) {
+    if (t <= l->now_us) return;
+    if (l->on_link.len > 0 && l->rate > 0.0)
+        l->vtime += (t - l->now_us) * share(l);
+    l->now_us = t;
+}
+
+static void start_setup(PcieLink *l, int id) {
+    if (l->setup_us > 0.0) {
+        l->setup_end[id] = l->now_us + l->setup_us;
+        ring_push(&l->setup, id);
+    } else {
+        iheap_push(&l->on_link, id, l->vtime + l->bits[id]);
+    }
+}
+
+static void complete_top(PcieLink *l) {
+    ring_push(&l->done, iheap_pop(&l->on_link));
+    // tags only need to be comparable while someone is on the link
+    if (l->on_link.len == 0) l->vtime = 0.0;
+
+    // the freed DMA slot goes to the longest waiter
+    if (l->waiting.len > 0) start_setup(l, ring_pop(&l->waiting));
+}
+
+void pcie_link_advance(PcieLink *l, double now_us) {
+    for (;;) {
+        double t_setup = l->setup.len > 0 ? l->setup_end[l->setup.buf[l->setup.head]]
+                                          : DBL_MAX;
+        double t_done = next_completion(l);
+        double t = t_done < t_setup ? t_done : t_setup;
+        if (t > now_us) break;
+
+        move_to(l, t);
+        l->steps++;
+        if (t_done <= t_setup) {
+            complete_top(l);
+        } else {
+            int id = ring_pop(&l->setup);
+            iheap_push(&l->on_link, id, l->vtime + l->bits[id]);
+        }
+    }
+    move_to(l, now_us);
+
+    // a residue too small to move the clock would never finish
+    int id;
+    while ((id = iheap_top(&l->on_link)) >= 0 && l->rate > 0.0) {
+        double rest = l->on_link.key[id] - l->vtime;
+        if (rest >= 1e-6 && now_us + rest / share(l) > now_us) break;
+        l->steps++;
+        complete_top(l);
+    }
+}
+
+int pcie_link_pop_done(PcieLink *l) {
+    return l->done.len > 0 ? ring_pop(&l->done) : -1;
+}
+
+void pcie_link_set_rate(PcieLink *l, double now_us, double bits_per_us) {
+    pcie_link_advance(l, now_us);
+    l->rate = bits_per_us;
+}
+
+void pcie_link_submit(PcieLink *l, int id, double bits, double now_us) {
+    pcie_link_advance(l, now_us);
+    l->bits[id] = bits;
+    l->seq[id] = l->n_submitted++;
+    l->steps++;
+
+    int in_dma = l->setup.len + l->on_link.len;
+    if (l->dma_depth > 0 && in_dma >= l->dma_depth)
+        ring_push(&l->waiting, id);
+    else
+        start_setup(l, id);
+}
+
+double pcie_link_next_event(const PcieLink *l) {
+    double t = next_completion(l);
+    if (l->setup.len > 0) {
+        double t_setup = l->setup_end[l->setup.buf[l->setup.head]];
+        if (t_setup < t) t = t_setup;
+    }
+    return t;
+}
+
+int pcie_link_pending(const PcieLink *l) {
+    return l->waiting.len + l->setup.len + l->on_link.len;
+}
+
+long long pcie_link_steps(const PcieLink *l) {
+    return l->steps;
+}
+
+enum { LINK_ON, LINK_WAITING, LINK_SETUP, LINK_DONE };
+
+/* One transfer in a saved link, in the order it sits in its queue. */
+typedef struct {
+    int id;
+    int where;              // LINK_*
+    double bits;            // tag while on the link
+    double setup_end;
+    long long seq;
+} SavedTransfer;
+
+typedef struct {
+    double now_us;
+    double vtime;
+    long long n_submitted;
+    long long steps;
+    int n_transfers;
+} SavedLink;
+
+static int save_ring(const PcieLink *l, const IdRing *r, int where, FILE *f) {
+    for (int i = 0; i < r->len; i++) {
+        int id = r->buf[(r->head + i) % r->cap];
+        SavedTransfer t = { id, where, l->bits[id], l->setup_end[id], l->seq[id] };
+        if (fwrite(&t, sizeof(t), 1, f) != 1) return -1;
+    }
+    return 0;
+}
+
+int pcie_link_save(const PcieLink *l, FILE *f) {
+    SavedLink h = {
+        .now_us = l->now_us,
+        .vtime = l->vtime,
+        .n_submitted = l->n_submitted,
+        .steps = l->steps,
+        .n_transfers = pcie_link_pending(l) + l->done.len
+    };
+    if (fwrite(&h, sizeof(h), 1, f) != 1) return -1;
+
+    for (int i = 0; i < l->on_link.len; i++) {
+        int id = l->on_link.slots[i];
+        SavedTransfer t = { id, LINK_ON, l->on_link.key[id], 0.0, l->seq[id] };
+        if (fwrite(&t, sizeof(t), 1, f) != 1) return -1;
+    }
+    if (save_ring(l, &l->waiting, LINK_WAITING, f) != 0 ||
+        save_ring(l, &l->setup, LINK_SETUP, f) != 0 ||
+        save_ring(l, &l->done, LINK_DONE, f) != 0)
+        return -1;
+    return 0;
+}
+
+int pcie_link_load(PcieLink *l, FILE *f) {
+    SavedLink h;
+    if (fread(&h, sizeof(h), 1, f) != 1) return -1;
+    if (pcie_link_pending(l) + l->done.len > 0 || h.n_transfers > l->cap)
+        return -1;
+
+    l->now_us = h.now_us;
+    l->vtime = h.vtime;
+    l->n_submitted = h.n_submitted;
+    l->steps = h.steps;
+
+    for (int i = 0; i < h.n_transfers; i++) {
+        SavedTransfer t;
+        if (fread(&t, sizeof(t), 1, f) != 1) return -1;
+        if (t.id < 0 || t.id >= l->cap) return -1;
+
+        l->seq[t.id] = t.seq;
+        l->setup_end[t.id] = t.setup_end;
+        switch (t.where) {
+        case LINK_ON:
+            // ties on the tag go by seq, so the push order does not matter
+            iheap_push(&l->on_link, t.id, t.bits);
+            break;
+        case LINK_WAITING:
+            l->bits[t.id] = t.bits;
+            ring_push(&l->waiting, t.id);
+            break;
+        case LINK_SETUP:
+            l->bits[t.id] = t.bits;
+            ring_push(&l->setup, t.id);
+            break;
+        default:
+            ring_push(&l->done, t.id);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,334 @@
+#include <float.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include "../includes/daemon.h"
+#include "../includes/scheduler.h"
+#include "../includes/heap.h"
+
+/* The hardware side of the daemon protocol (daemon.h), modelled: engines
+ * run each assigned bootstrap for its static cost plus ctx_overhead, and
+ * the keys of each upload cross the link at pcie_gbps after the ones
+ * before it. */
+
+typedef struct {
+    int id;
+    int idx;
+} IdIndex;
+
+static int cmp_id(const void *a, const void *b) {
+    const IdIndex *x = a, *y = b;
+    return (x->id > y->id) - (x->id < y->id);
+}
+
+typedef struct {
+    const HwConfig *cfg;
+    const TfheJob *jobs;
+    IdIndex *by_id;
+    int n_jobs;
+
+    FILE *to;               // the daemon
+    FILE *from;
+    char *line;
+    size_t line_cap;
+
+    double now_us;
+    IndexedHeap engines;    // slice ends, by engine
+    int *engine_job;
+    double busy_us;
+
+    int *up_job;            // uploads in link order
+    double *up_done;
+    int up_head, up_len;
+    double link_free_us;
+
+    double *completion;
+    int finished;
+    Histogram round_trip_us;
+} Replay;
+
+static int job_index(const Replay *r, int id) {
+    IdIndex key = { id, 0 };
+    const IdIndex *hit = bsearch(&key, r->by_id, r->n_jobs, sizeof(IdIndex), cmp_id);
+    return hit ? hit->idx : -1;
+}
+
+static double elapsed_us(const struct timespec *a, const struct timespec *b) {
+    return (b->tv_sec - a->tv_sec) * 1e6 + (b->tv_nsec - a->tv_nsec) * 1e-3;
+}
+
+/* Act on one line of the daemon's reply; -1 on anything unexpected. */
+static int handle_reply(Replay *r, const char *line) {
+    const HwConfig *cfg = r->cfg;
+    int e, id, k;
+
+    if (sscanf(line, "assign %d %d", &e, &id) == 2) {
+        k = job_index(r, id);
+        if (k < 0 || e < 0 || e >= cfg->num_engines || r->engine_job[e] >= 0) {
+            fprintf(stderr, "Replay: bad assignment: %s", line);
+            return -1;
+        }
+        double slice = bootstrap_time_us(cfg, &r->jobs[k]) + cfg->ctx_switch_overhead_us;
+        r->engine_job[e] = k;
+        r->busy_us += slice;
+        iheap_push(&r->engines, e, r->now_us + slice);
+    } else if (sscanf(line, "upload %d", &id) == 1) {
+        k = job_index(r, id);
+        if (k < 0 || r->up_len == r->n_jobs) {
+            fprintf(stderr, "Replay: bad upload: %s", line);
+            return -1;
+        }
+        double bits_per_us = cfg->pcie_bandwidth_gbps * 1e3;
+        double start = r->link_free_us > r->now_us ? r->link_free_us : r->now_us;
+        r->link_free_us = start + r->jobs[k].key_size_mb * 8.0 * 1e6 / bits_per_us;
+        int slot = (r->up_head + r->up_len++) % r->n_jobs;
+        r->up_job[slot] = k;
+        r->up_done[slot] = r->link_free_us;
+    } else if (sscanf(line, "finished %d", &id) == 1) {
+        k = job_index(r, id);
+        if (k < 0) {
+            fprintf(stderr, "Replay: unknown job finished: %s", line);
+            return -1;
+        }
+        r->completion[k] = r->now_us;
+        r->finished++;
+    } else {
+        fprintf(stderr, "Replay: daemon says %s", line);
+        return -1;
+    }
+    return 0;
+}
+
+/* Send `msg` and work through the reply up to its '.'. */
+static int exchange(Replay *r, const char *msg) {
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if (fputs(msg, r->to) < 0 || fflush(r->to) != 0) {
+        fprintf(stderr, "Replay: the daemon went away\n");
+        return -1;
+    }
+    for (;;) {
+        if (getline(&r->line, &r->line_cap, r->from) <= 0) {
+            fprintf(stderr, "Replay: the daemon went away\n");
+            return -1;
+        }
+        if (strcmp(r->line, ".\n") == 0) break;
+        if (handle_reply(r, r->line) != 0) return -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    hist_add(&r->round_trip_us, elapsed_us(&t0, &t1));
+    return 0;
+}
+
+/* Uploads first, then arrivals, then slice ends, as the simulator orders
+ * events at one instant. */
+static int run(Replay *r) {
+    char msg[512];
+    int next = 0;
+
+    while (r->finished < r->n_jobs) {
+        double t_up = r->up_len > 0 ? r->up_done[r->up_head] : DBL_MAX;
+        double t_in = next < r->n_jobs ? r->jobs[next].arrival_time_us : DBL_MAX;
+        int e = iheap_top(&r->engines);
+        double t_eng = e >= 0 ? r->engines.key[e] : DBL_MAX;
+
+        if (t_up <= t_in && t_up <= t_eng && t_up < DBL_MAX) {
+            r->now_us = t_up;
+            int k = r->up_job[r->up_head];
+            r->up_head = (r->up_head + 1) % r->n_jobs;
+            r->up_len--;
+            snprintf(msg, sizeof(msg), "keys %.17g %d\n", r->now_us, r->jobs[k].id);
+        } else if (t_in <= t_eng && t_in < DBL_MAX) {
+            const TfheJob *j = &r->jobs[next++];
+            r->now_us = t_in;
+            snprintf(msg, sizeof(msg), "arrive %d %d %.17g %d %.17g %.17g %d %.17g %d\n",
+                     j->id, j->tenant_id, j->arrival_time_us, j->num_bootstraps,
+                     j->key_size_mb, j->noise_budget, j->priority, j->deadline_us,
+                     j->key_id);
+        } else if (e >= 0) {
+            r->now_us = t_eng;
+            iheap_pop(&r->engines);
+            r->engine_job[e] = -1;
+            snprintf(msg, sizeof(msg), "done %.17g %d\n", r->now_us, e);
+        } else {
+            fprintf(stderr, "Replay: the daemon left %d jobs unfinished\n",
+                    r->n_jobs - r->finished);
+            return -1;
+        }
+        if (exchange(r, msg) != 0) return -1;
+    }
+    return 0;
+}
+
+static void print_percentiles(const char *name, const Histogram *h) {
+    printf("%s P50/P90/P99/P99.9: %.3f / %.3f / %.3f / %.3f us\n", name,
+           hist_quantile(h, 0.50), hist_quantile(h, 0.90),
+           hist_quantile(h, 0.99), hist_quantile(h, 0.999));
+}
+
+static void report(const Replay *r, const char *label, const char *daemon_stats) {
+    const HwConfig *cfg = r->cfg;
+    double first = r->n_jobs > 0 ? r->jobs[0].arrival_time_us : 0.0;
+    double last = first, sum = 0.0;
+    Histogram *resp = calloc(1, sizeof(Histogram));
+    for (int k = 0; k < r->n_jobs; k++) {
+        if (r->completion[k] > last) last = r->completion[k];
+        double t = r->completion[k] - r->jobs[k].arrival_time_us;
+        sum += t;
+        if (resp) hist_add(resp, t);
+    }
+    double makespan = last - first;
+
+    printf("=== Replay: %s ===\n", label);
+    printf("Engines: %d | HBM: %.1f Gbps | Key Mem: %.1f MB\n",
+           cfg->num_engines, cfg->hbm_bandwidth_gbps, cfg->key_mem_mb);
+    printf("Jobs: %d\n", r->n_jobs);
+    printf("Makespan: %.2f us\n", makespan);
+    printf("Avg Completion: %.2f us\n", r->n_jobs > 0 ? sum / r->n_jobs : 0.0);
+    printf("Utilization: %.3f\n",
+           makespan > 0 ? r->busy_us / (makespan * cfg->num_engines) : 0.0);
+    if (resp) printf("Response P50/P90/P99/P99.9: %.2f / %.2f / %.2f / %.2f us\n",
+                     hist_quantile(resp, 0.50), hist_quantile(resp, 0.90),
+                     hist_quantile(resp, 0.99), hist_quantile(resp, 0.999));
+    free(resp);
+
+    long long events;
+    double p[4];
+    if (daemon_stats && sscanf(daemon_stats, "stats %lld %lf %lf %lf %lf",
+                               &events, &p[0], &p[1], &p[2], &p[3]) == 5) {
+        printf("Events: %lld\n", events);
+        printf("Decision latency P50/P90/P99/P99.9: %.3f / %.3f / %.3f / %.3f us\n",
+               p[0], p[1], p[2], p[3]);
+    }
+    print_percentiles("Round trip", &r->round_trip_us);
+    printf("\n");
+}
+
+/* A daemon session in a child, over two pipes. */
+static pid_t spawn_daemon(const HwConfig *cfg, const SchedulerOps *ops,
+                          const void *sched_arg, FILE **to, FILE **from)
+{
+    int down[2], up[2];
+    if (pipe(down) != 0) return -1;
+    if (pipe(up) != 0) {
+        close(down[0]);
+        close(down[1]);
+        return -1;
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(down[1]);
+        close(up[0]);
+        FILE *in = fdopen(down[0], "r");
+        FILE *out = fdopen(up[1], "w");
+        int rc = in && out ? daemon_session(cfg, ops, sched_arg, in, out, NULL) : -1;
+        if (out) fflush(out);
+        _exit(rc < 0 ? 1 : 0);
+    }
+    close(down[0]);
+    close(up[1]);
+    if (pid < 0) {
+        close(down[1]);
+        close(up[0]);
+        return -1;
+    }
+    *to = fdopen(down[1], "w");
+    *from = fdopen(up[0], "r");
+    return pid;
+}
+
+static int connect_daemon(const char *path, FILE **to, FILE **from) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        perror("connect to daemon");
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    int fd2 = dup(fd);
+    *from = fdopen(fd, "r");
+    *to = fd2 >= 0 ? fdopen(fd2, "w") : NULL;
+    return 0;
+}
+
+int daemon_replay(const HwConfig *cfg, const SchedulerOps *ops,
+                  const void *sched_arg, const char *path,
+                  const TfheJob *jobs, int n_jobs)
+{
+    Replay r = { .cfg = cfg, .jobs = jobs, .n_jobs = n_jobs };
+    int cap = n_jobs > 0 ? n_jobs : 1;
+    r.by_id = malloc(cap * sizeof(IdIndex));
+    r.engine_job = malloc(cfg->num_engines * sizeof(int));
+    r.up_job = malloc(cap * sizeof(int));
+    r.up_done = malloc(cap * sizeof(double));
+    r.completion = calloc(cap, sizeof(double));
+    iheap_init(&r.engines, cfg->num_engines, 0);
+
+    int rc = -1;
+    pid_t child = 0;
+    if (!r.by_id || !r.engine_job || !r.up_job || !r.up_done || !r.completion)
+        goto out;
+    for (int k = 0; k < n_jobs; k++)
+        r.by_id[k] = (IdIndex){ jobs[k].id, k };
+    qsort(r.by_id, n_jobs, sizeof(IdIndex), cmp_id);
+    for (int k = 1; k < n_jobs; k++) {
+        if (r.by_id[k].id == r.by_id[k - 1].id) {
+            fprintf(stderr, "Replay: job id %d appears twice\n", r.by_id[k].id);
+            goto out;
+        }
+    }
+    for (int e = 0; e < cfg->num_engines; e++) r.engine_job[e] = -1;
+
+    signal(SIGPIPE, SIG_IGN);
+    if (strcmp(path, "-") == 0) {
+        child = spawn_daemon(cfg, ops, sched_arg, &r.to, &r.from);
+        if (child < 0) {
+            perror("fork daemon");
+            child = 0;
+            goto out;
+        }
+    } else if (connect_daemon(path, &r.to, &r.from) != 0) {
+        goto out;
+    }
+    if (!r.to || !r.from) goto out;
+
+    if (run(&r) == 0) {
+        char *stats = NULL;
+        if (fputs("stats\n", r.to) >= 0 && fflush(r.to) == 0 &&
+            getline(&r.line, &r.line_cap, r.from) > 0)
+            stats = strdup(r.line);
+        while (stats && getline(&r.line, &r.line_cap, r.from) > 0 &&
+               strcmp(r.line, ".\n") != 0)
+            ;
+        report(&r, strcmp(path, "-") == 0 ? (ops->label ? ops->label : ops->name)
+                                          : path, stats);
+        free(stats);
+        rc = 0;
+    }
+    fputs("quit\n", r.to);
+
+out:
+    if (r.to) fclose(r.to);
+    if (r.from) fclose(r.from);
+    if (child > 0) waitpid(child, NULL, 0);
+    free(r.line);
+    free(r.by_id);
+    free(r.engine_job);
+    free(r.up_job);
+    free(r.up_done);
+    free(r.completion);
+    iheap_free(&r.engines);
+    return rc;
+}
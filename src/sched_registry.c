@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dlfcn.h>
+#include "../includes/sched_registry.h"
+
+#define SCHED_REGISTRY_MAX 64
+
+static const SchedulerOps *g_ops[SCHED_REGISTRY_MAX] = {
+    &sched_fifo_ops, &sched_hps_ops, &sched_cp_ops,
+    &sched_edf_ops, &sched_llf_ops
+};
+static int g_n_ops = 5;
+
+const SchedulerOps *sched_registry_find(const char *name) {
+    for (int i = 0; i < g_n_ops; i++)
+        if (strcmp(g_ops[i]->name, name) == 0) return g_ops[i];
+    return NULL;
+}
+
+int sched_registry_add(const SchedulerOps *ops) {
+    if (ops->abi != SCHED_PLUGIN_ABI) {
+        fprintf(stderr, "Scheduler %s: built for ABI %d, expected %d\n",
+                ops->name ? ops->name : "?", ops->abi, SCHED_PLUGIN_ABI);
+        return -1;
+    }
+    if (!ops->name || !ops->init || !ops->destroy || !ops->on_arrival ||
+        !ops->pick_batch) {
+        fprintf(stderr, "Scheduler %s: missing a required callback\n",
+                ops->name ? ops->name : "?");
+        return -1;
+    }
+    if (sched_registry_find(ops->name)) {
+        fprintf(stderr, "Scheduler %s is already registered\n", ops->name);
+        return -1;
+    }
+    if (g_n_ops == SCHED_REGISTRY_MAX) {
+        fprintf(stderr, "Too many schedulers registered\n");
+        return -1;
+    }
+    g_ops[g_n_ops++] = ops;
+    return 0;
+}
+
+int sched_registry_load(const char *path) {
+    // plugins stay loaded for the life of the process
+    void *lib = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (!lib) {
+        fprintf(stderr, "Cannot load scheduler plugin: %s\n", dlerror());
+        return -1;
+    }
+
+    const SchedulerOps *const *list = dlsym(lib, SCHED_PLUGIN_SYMBOL);
+    if (!list) {
+        fprintf(stderr, "%s: no %s array\n", path, SCHED_PLUGIN_SYMBOL);
+        dlclose(lib);
+        return -1;
+    }
+
+    int added = 0;
+    for (; *list; list++) {
+        if (sched_registry_add(*list) != 0) return -1;
+        added++;
+    }
+    return added;
+}
+
+void sched_registry_list(FILE *f) {
+    for (int i = 0; i < g_n_ops; i++)
+        fprintf(f, "%s\n", g_ops[i]->name);
+}
+
+const SchedulerOps *sched_registry_resolve(const char *spec, char *name_buf,
+                                           size_t name_len, const char **arg)
+{
+    const char *colon = strchr(spec, ':');
+    size_t n = colon ? (size_t)(colon - spec) : strlen(spec);
+    if (n >= name_len) {
+        fprintf(stderr, "Scheduler name too long: %s\n", spec);
+        return NULL;
+    }
+    memcpy(name_buf, spec, n);
+    name_buf[n] = '\0';
+    *arg = colon ? colon + 1 : NULL;
+
+    const SchedulerOps *ops = sched_registry_find(name_buf);
+    if (ops) return ops;
+
+    if (strchr(name_buf, '/') || (n > 3 && strcmp(name_buf + n - 3, ".so") == 0)) {
+        int first = g_n_ops;
+        if (sched_registry_load(name_buf) > 0) return g_ops[first];
+        return NULL;
+    }
+
+    fprintf(stderr, "Unknown scheduler: %s (available:", name_buf);
+    for (int i = 0; i < g_n_ops; i++) fprintf(stderr, " %s", g_ops[i]->name);
+    fprintf(stderr, ")\n");
+    return NULL;
+}
@@ -1,5 +1,10 @@
 #include <float.h>
+#include <stdlib.h>
+#include <string.h>
 #include "../includes/scheduler.h"
+#include "../includes/sched_registry.h"
+#include "../includes/heap.h"
+#include "../includes/hps_kernel.h"
 
 // FIFO scheduler
 int pick_job_fifo(const HwConfig *cfg, TfheJob *jobs, int n_jobs, double now_us) {
@@ -20,12 +25,9 @@ int pick_job_fifo(const HwConfig *cfg, TfheJob *jobs, int n_jobs, double now_us)
 }
 
 // Hardware-parametric scheduler 
-/* Tunable HPS weights (defaults chosen previously). */
-static double g_w_key_affinity = 3.0;
-static double g_w_noise_urgency = 4.0;
-static double g_w_bw_penalty = 2.0;
-static double g_w_fairness = 1.5;
-static double g_w_deadline = 2.0;
+/* Tunable HPS weights (defaults chosen previously).  These back the
+ * stateless pick_job_hps; run_simulation passes its own copy per run. */
+static HpsWeights g_weights = HPS_DEFAULT_WEIGHTS;
 
 void scheduler_set_weights(double w_key_affinity,
                            double w_noise_urgency,
@@ -33,11 +35,90 @@ void scheduler_set_weights(double w_key_affinity,
                            double w_fairness,
                            double w_deadline)
 {
-    g_w_key_affinity = w_key_affinity;
-    g_w_noise_urgency = w_noise_urgency;
-    g_w_bw_penalty = w_bw_penalty;
-    g_w_fairness = w_fairness;
-    g_w_deadline = w_deadline;
+    g_weights.key_affinity = w_key_affinity;
+    g_weights.noise_urgency = w_noise_urgency;
+    g_weights.bw_penalty = w_bw_penalty;
+    g_weights.fairness = w_fairness;
+    g_weights.deadline = w_deadline;
+}
+
+HpsWeights scheduler_get_weights(void)
+{
+    return g_weights;
+}
+
+/* The four time-independent terms, weighted.  head holds the first two
+ * so that adding the deadline term next keeps the summation order. */
+typedef struct {
+    double head;
+    double fair;
+    double bw;
+} HpsTerms;
+
+static HpsTerms hps_terms(const HwConfig *cfg, const HpsWeights *w,
+                          const TfheJob *job)
+{
+    /*************************************************************
+     * 1. Key affinity
+     *************************************************************/
+    double key_aff = 1.0 / (job->key_size_mb + 1.0);
+
+    /*************************************************************
+     * 2. Noise urgency (bounded)
+     *************************************************************/
+    double nb = job->noise_budget;
+    if (nb < 0) nb = 0;
+    if (nb > 1) nb = 1;
+    double noise_urg = (1.0 - nb);
+
+    /*************************************************************
+     * 4. Tenant fairness (bounded)
+     *************************************************************/
+    double fairness = 1.0 / (1.0 + job->tenant_id * 0.2);
+
+    /*************************************************************
+     * 5. Bandwidth penalty (per-bootstrap)
+     *************************************************************/
+    double t = bootstrap_time_us(cfg, job);
+    double bw_pen = 1.0 / (t + 1.0);
+
+    return (HpsTerms){
+        .head = w->key_affinity * key_aff + w->noise_urgency * noise_urg,
+        .fair = w->fairness * fairness,
+        .bw = w->bw_penalty * bw_pen
+    };
+}
+
+static double hps_combine(const HpsTerms *t, const HpsWeights *w,
+                          const TfheJob *job, double slack)
+{
+    /*************************************************************
+     * 3. Deadline pressure (bounded)
+     *************************************************************/
+    double deadline_score = 0.0;
+    if (job->deadline_us > 0.0) {
+        if (slack < 0) slack = 0;
+        if (slack > HPS_SLACK_CAP_US) slack = HPS_SLACK_CAP_US;
+        deadline_score = 1.0 - slack / (slack + 500.0);
+    }
+
+    /*************************************************************
+     * Combined weighted score
+     *************************************************************/
+    return t->head + w->deadline * deadline_score + t->fair + t->bw;
+}
+
+static double hps_score_slack(const HwConfig *cfg, const HpsWeights *w,
+                              const TfheJob *job, double slack)
+{
+    HpsTerms t = hps_terms(cfg, w, job);
+    return hps_combine(&t, w, job, slack);
+}
+
+static double hps_score(const HwConfig *cfg, const HpsWeights *w,
+                        const TfheJob *job, double now_us)
+{
+    return hps_score_slack(cfg, w, job, job->deadline_us - now_us);
 }
 
 int pick_job_hps(const HwConfig *cfg, TfheJob *jobs, int n_jobs, double now_us)
@@ -51,51 +132,7 @@ int pick_job_hps(const HwConfig *cfg, TfheJob *jobs, int n_jobs, double now_us)
         if (jobs[i].remaining_bootstraps <= 0) continue;
         if (jobs[i].arrival_time_us > now_us) continue;
 
-        /*************************************************************
-         * 1. Key affinity
-         *************************************************************/
-        double key_aff = 1.0 / (jobs[i].key_size_mb + 1.0);
-
-        /*************************************************************
-         * 2. Noise urgency (bounded)
-         *************************************************************/
-        double nb = jobs[i].noise_budget;
-        if (nb < 0) nb = 0;
-        if (nb > 1) nb = 1;
-        double noise_urg = (1.0 - nb);
-
-        /*************************************************************
-         * 3. Deadline pressure (bounded)
-         *************************************************************/
-        double deadline_score = 0.0;
-        if (jobs[i].deadline_us > 0.0) {
-            double slack = jobs[i].deadline_us - now_us;
-            if (slack < 0) slack = 0;
-            if (slack > 20000) slack = 20000;
-            deadline_score = 1.0 - slack / (slack + 500.0);
-        }
-
-        /*************************************************************
-         * 4. Tenant fairness (bounded)
-         *************************************************************/
-        double fairness = 1.0 / (1.0 + jobs[i].tenant_id * 0.2);
-
-        /*************************************************************
-         * 5. Bandwidth penalty (per-bootstrap)
-         *************************************************************/
-        double t = bootstrap_time_us(cfg, &jobs[i]);
-        double bw_pen = 1.0 / (t + 1.0);
-
-        /*************************************************************
-         * Combined weighted score
-         *************************************************************/
-        double score =
-              g_w_key_affinity  * key_aff
-            + g_w_noise_urgency * noise_urg
-            + g_w_deadline      * deadline_score
-            + g_w_fairness      * fairness
-            + g_w_bw_penalty    * bw_pen;
-
+        double score = hps_score(cfg, &g_weights, &jobs[i], now_us);
         if (score > best_score) {
             best_score = score;
             best_idx = i;
@@ -106,6 +143,807 @@ int pick_job_hps(const HwConfig *cfg, TfheJob *jobs, int n_jobs, double now_us)
 }
 
 
+/* ====================================================
+   ===================== READY SET ====================
+   ==================================================== */
+
+/* HPS jobs move through phases as their deadline approaches:
+ *   STATIC  - score no longer depends on time (no deadline, or it passed)
+ *   DORMANT - deadline further away than the slack cap, score is constant
+ *             until it comes within range
+ *   DYNAMIC - deadline within range, score grows as slack shrinks
+ * STATIC and DORMANT jobs sit in max-heaps keyed by their exact score.
+ * DYNAMIC jobs are keyed by an upper bound and only re-scored at pick time
+ * when that bound could still beat the best exact score.  When there are
+ * many of them, they are all re-scored in one pass of the batch kernel
+ * over packed columns instead (hps_kernel.h). */
+enum { PHASE_NONE, PHASE_STATIC, PHASE_DORMANT, PHASE_DYNAMIC };
+
+/* The bounded heap scan re-scores only jobs that might win, the batch
+ * kernel re-scores all of them several times faster per job.  Picks use
+ * the batch kernel while the last heap scan visited more than
+ * 1/HPS_BATCH_GAIN of the DYNAMIC jobs, and retry the heap scan every
+ * HPS_BATCH_RUN picks in case the bounds have become selective again. */
+#define HPS_BATCH_MIN  64
+#define HPS_BATCH_GAIN 4
+#define HPS_BATCH_RUN  32
+
+/* Jobs whose keys are not on the device yet (JobHot.pcie_transferred == 0)
+ * are kept apart from the others, so that a pick made while no upload can
+ * start passes them all over at once. */
+enum { POOL_KEYS, POOL_NO_KEYS, N_POOLS };
+
+typedef struct {
+    /* FIFO: admitted jobs keyed by admission order */
+    IndexedHeap fifo;
+
+    /* HPS */
+    IndexedHeap stat;
+    IndexedHeap dormant;
+    IndexedHeap dynamic;
+    HpsColumns dyn;         // DYNAMIC jobs, packed for the batch kernel
+    double *dyn_score;      // batch kernel output, dyn.cap long
+    int batch_picks;        // picks left before the heap scan is retried
+} ReadyPool;
+
+struct ReadySet {
+    ReadyKind kind;
+    const HwConfig *cfg;
+    HpsWeights w;
+    const TfheJob *jobs;
+    const JobHot *hot;
+    int cap;
+    long long *seq;         // admission order per slot, breaks score ties
+
+    unsigned char *parked;  // taken out until it can run again
+    unsigned char *pool;    // pool per slot, while it is placed
+    ReadyPool pools[N_POOLS];
+
+    /* HPS */
+    unsigned char *phase;
+    IndexedHeap timers;     // next phase change per DORMANT/DYNAMIC job
+    int *stack;             // DFS scratch for the DYNAMIC scan
+    HpsTerms *terms;        // per slot, set on admission
+    int *dyn_row;           // row in its pool's dyn per slot, -1 = not DYNAMIC
+    HpsScoreFn kernel;
+
+    SchedCounters *ctr;     // NULL unless instrumented
+};
+
+ReadySet *ready_set_create(ReadyKind kind, const HwConfig *cfg,
+                           const HpsWeights *w,
+                           const TfheJob *jobs, const JobHot *hot,
+                           int n_jobs)
+{
+    ReadySet *rs = calloc(1, sizeof(ReadySet));
+    if (!rs) return NULL;
+
+    rs->kind = kind;
+    rs->cfg = cfg;
+    rs->w = w ? *w : g_weights;
+
+    for (int i = 0; i < N_POOLS; i++) {
+        ReadyPool *p = &rs->pools[i];
+        if (kind == READY_HPS) {
+            iheap_init(&p->stat, 0, 1);
+            iheap_init(&p->dormant, 0, 1);
+            iheap_init(&p->dynamic, 0, 1);
+        } else {
+            iheap_init(&p->fifo, 0, 0);
+        }
+    }
+    if (kind == READY_HPS) {
+        rs->kernel = hps_score_kernel();
+        iheap_init(&rs->timers, 0, 0);
+    }
+    if (ready_set_reserve(rs, jobs, hot, n_jobs > 0 ? n_jobs : 1) != 0) {
+        ready_set_destroy(rs);
+        return NULL;
+    }
+    return rs;
+}
+
+int ready_set_reserve(ReadySet *rs, const TfheJob *jobs, const JobHot *hot,
+                      int cap)
+{
+    rs->jobs = jobs;
+    rs->hot = hot;
+    if (cap <= rs->cap) return 0;
+
+    long long *seq = realloc(rs->seq, cap * sizeof(long long));
+    if (!seq) return -1;
+    rs->seq = seq;
+    unsigned char *parked = realloc(rs->parked, cap);
+    if (!parked) return -1;
+    rs->parked = parked;
+    memset(rs->parked + rs->cap, 0, cap - rs->cap);
+    unsigned char *pool = realloc(rs->pool, cap);
+    if (!pool) return -1;
+    rs->pool = pool;
+    memset(rs->pool + rs->cap, POOL_KEYS, cap - rs->cap);
+
+    if (rs->kind == READY_FIFO) {
+        for (int i = 0; i < N_POOLS; i++)
+            if (iheap_reserve(&rs->pools[i].fifo, cap) != 0) return -1;
+    } else {
+        unsigned char *phase = realloc(rs->phase, cap);
+        int *stack = realloc(rs->stack, cap * sizeof(int));
+        HpsTerms *terms = realloc(rs->terms, cap * sizeof(HpsTerms));
+        int *dyn_row = realloc(rs->dyn_row, cap * sizeof(int));
+        if (phase) rs->phase = phase;
+        if (stack) rs->stack = stack;
+        if (terms) rs->terms = terms;
+        if (dyn_row) rs->dyn_row = dyn_row;
+        if (!phase || !stack || !terms || !dyn_row) return -1;
+        memset(rs->phase + rs->cap, PHASE_NONE, cap - rs->cap);
+        for (int j = rs->cap; j < cap; j++) rs->dyn_row[j] = -1;
+
+        IndexedHeap *heaps[] = {
+            &rs->pools[POOL_KEYS].stat, &rs->pools[POOL_KEYS].dormant,
+            &rs->pools[POOL_KEYS].dynamic, &rs->pools[POOL_NO_KEYS].stat,
+            &rs->pools[POOL_NO_KEYS].dormant, &rs->pools[POOL_NO_KEYS].dynamic,
+            &rs->timers
+        };
+        for (int i = 0; i < 7; i++) {
+            if (iheap_reserve(heaps[i], cap) != 0) return -1;
+            heaps[i]->tie = rs->seq;
+        }
+    }
+    rs->cap = cap;
+    return 0;
+}
+
+void ready_set_destroy(ReadySet *rs)
+{
+    if (!rs) return;
+    free(rs->seq);
+    free(rs->parked);
+    free(rs->pool);
+    free(rs->phase);
+    free(rs->stack);
+    free(rs->terms);
+    free(rs->dyn_row);
+    for (int i = 0; i < N_POOLS; i++) {
+        ReadyPool *p = &rs->pools[i];
+        free(p->dyn_score);
+        hps_columns_free(&p->dyn);
+        if (rs->kind == READY_HPS) {
+            iheap_free(&p->stat);
+            iheap_free(&p->dormant);
+            iheap_free(&p->dynamic);
+        } else {
+            iheap_free(&p->fifo);
+        }
+    }
+    if (rs->kind == READY_HPS) iheap_free(&rs->timers);
+    free(rs);
+}
+
+/* Score of the job in slot j from its stored terms. */
+static double hps_slot_score(const ReadySet *rs, int j, double slack)
+{
+    return hps_combine(&rs->terms[j], &rs->w, &rs->jobs[j], slack);
+}
+
+static void hps_enter_dynamic(ReadySet *rs, int j)
+{
+    const TfheJob *job = &rs->jobs[j];
+    ReadyPool *p = &rs->pools[rs->pool[j]];
+    double lo = hps_slot_score(rs, j, 0.0);
+    double hi = hps_slot_score(rs, j, HPS_SLACK_CAP_US);
+
+    rs->phase[j] = PHASE_DYNAMIC;
+    iheap_push(&p->dynamic, j, lo > hi ? lo : hi);
+    iheap_push(&rs->timers, j, job->deadline_us);
+
+    HpsColumns *c = &p->dyn;
+    if (c->len == c->cap) {
+        int cap = c->cap ? 2 * c->cap : 256;
+        double *score = realloc(p->dyn_score, cap * sizeof(double));
+        if (score) p->dyn_score = score;
+        // without room the job is still found by the heap scan
+        if (!score || hps_columns_reserve(c, cap) != 0) return;
+    }
+    int row = c->len++;
+    c->head[row] = rs->terms[j].head;
+    c->fair[row] = rs->terms[j].fair;
+    c->bw[row] = rs->terms[j].bw;
+    c->deadline[row] = job->deadline_us;
+    c->slot[row] = j;
+    rs->dyn_row[j] = row;
+}
+
+static void hps_leave_dynamic(ReadySet *rs, int j)
+{
+    ReadyPool *p = &rs->pools[rs->pool[j]];
+    iheap_remove(&p->dynamic, j);
+
+    // move the last row into the hole
+    HpsColumns *c = &p->dyn;
+    int row = rs->dyn_row[j];
+    if (row < 0) return;
+    int last = --c->len;
+    if (row != last) {
+        c->head[row] = c->head[last];
+        c->fair[row] = c->fair[last];
+        c->bw[row] = c->bw[last];
+        c->deadline[row] = c->deadline[last];
+        c->slot[row] = c->slot[last];
+        rs->dyn_row[c->slot[row]] = row;
+    }
+    rs->dyn_row[j] = -1;
+}
+
+static void hps_place(ReadySet *rs, int j, double now_us)
+{
+    const TfheJob *job = &rs->jobs[j];
+    ReadyPool *p = &rs->pools[rs->pool[j]];
+    rs->terms[j] = hps_terms(rs->cfg, &rs->w, job);
+
+    if (job->deadline_us <= 0.0 || job->deadline_us <= now_us) {
+        rs->phase[j] = PHASE_STATIC;
+        iheap_push(&p->stat, j, hps_slot_score(rs, j, job->deadline_us - now_us));
+    } else if (job->deadline_us - now_us > HPS_SLACK_CAP_US) {
+        rs->phase[j] = PHASE_DORMANT;
+        iheap_push(&p->dormant, j, hps_slot_score(rs, j, HPS_SLACK_CAP_US));
+        // wake a little early; re-scoring a DYNAMIC job is always exact
+        iheap_push(&rs->timers, j, job->deadline_us - HPS_SLACK_CAP_US - 1.0);
+    } else {
+        hps_enter_dynamic(rs, j);
+    }
+}
+
+/* Put an admitted or unparked job back where it can be picked, in the
+ * pool its keys call for. */
+static void ready_set_place(ReadySet *rs, int j, double now_us)
+{
+    rs->pool[j] = rs->hot[j].pcie_transferred ? POOL_KEYS : POOL_NO_KEYS;
+    if (rs->kind == READY_FIFO)
+        iheap_push(&rs->pools[rs->pool[j]].fifo, j, (double)rs->seq[j]);
+    else if (rs->phase[j] == PHASE_NONE)
+        hps_place(rs, j, now_us);
+}
+
+void ready_set_admit(ReadySet *rs, int j, long long seq, double now_us)
+{
+    if (rs->hot[j].remaining_bootstraps <= 0) return;
+    rs->seq[j] = seq;
+    rs->parked[j] = 0;
+    ready_set_place(rs, j, now_us);
+}
+
+void ready_set_retire(ReadySet *rs, int j)
+{
+    ReadyPool *p = &rs->pools[rs->pool[j]];
+    if (rs->kind == READY_FIFO) {
+        iheap_remove(&p->fifo, j);
+        return;
+    }
+
+    switch (rs->phase[j]) {
+    case PHASE_STATIC:  iheap_remove(&p->stat, j); break;
+    case PHASE_DORMANT: iheap_remove(&p->dormant, j); break;
+    case PHASE_DYNAMIC: hps_leave_dynamic(rs, j); break;
+    default: return;
+    }
+    iheap_remove(&rs->timers, j);
+    rs->phase[j] = PHASE_NONE;
+}
+
+/* Keys on their way, every released bootstrap of its graph running, or
+ * every remaining one waiting for its key-switch. */
+static int slot_waiting(const ReadySet *rs, int j)
+{
+    return rs->hot[j].pcie_transferred < 0 || rs->hot[j].blocked;
+}
+
+/* Placed without keys, which it has since been given. */
+static int slot_misplaced(const ReadySet *rs, int j)
+{
+    if (rs->pool[j] != POOL_NO_KEYS || !rs->hot[j].pcie_transferred) return 0;
+    if (rs->kind == READY_FIFO)
+        return iheap_contains(&rs->pools[POOL_NO_KEYS].fifo, j);
+    return rs->phase[j] != PHASE_NONE;
+}
+
+void ready_set_unpark(ReadySet *rs, int j, double now_us)
+{
+    if (slot_waiting(rs, j)) return;
+    if (slot_misplaced(rs, j)) {
+        ready_set_retire(rs, j);
+        ready_set_place(rs, j, now_us);
+        return;
+    }
+    if (!rs->parked[j]) return;
+    rs->parked[j] = 0;
+    if (rs->hot[j].remaining_bootstraps > 0) ready_set_place(rs, j, now_us);
+}
+
+static int hps_better(const ReadySet *rs, double score, int j,
+                      double best_score, int best_idx)
+{
+    if (best_idx < 0 || score > best_score) return 1;
+    if (score != best_score) return 0;
+    if (rs->seq[j] != rs->seq[best_idx]) return rs->seq[j] < rs->seq[best_idx];
+    return j < best_idx;
+}
+
+/* Best job in one pool, if it beats *best_idx. */
+static void hps_pool_pick(ReadySet *rs, ReadyPool *p, double now_us,
+                          int *best_idx, double *best_score)
+{
+    int j;
+    if (rs->ctr) rs->ctr->examined += (p->stat.len > 0) + (p->dormant.len > 0);
+
+    if ((j = iheap_top(&p->stat)) >= 0 &&
+        hps_better(rs, p->stat.key[j], j, *best_score, *best_idx)) {
+        *best_idx = j;
+        *best_score = p->stat.key[j];
+    }
+    if ((j = iheap_top(&p->dormant)) >= 0 &&
+        hps_better(rs, p->dormant.key[j], j, *best_score, *best_idx)) {
+        *best_idx = j;
+        *best_score = p->dormant.key[j];
+    }
+
+    /* ---- Unselective bounds: re-score all DYNAMIC jobs in one batch ---- */
+    // every row holds a DYNAMIC job unless the columns ran out of memory
+    int batch_ok = p->dyn.len >= HPS_BATCH_MIN && p->dyn.len == p->dynamic.len;
+    if (batch_ok && p->batch_picks > 0) {
+        p->batch_picks--;
+        rs->kernel(&p->dyn, rs->w.deadline, now_us, p->dyn_score);
+        if (rs->ctr) {
+            rs->ctr->examined += p->dyn.len;
+            rs->ctr->rescored += p->dyn.len;
+        }
+        for (int row = 0; row < p->dyn.len; row++) {
+            j = p->dyn.slot[row];
+            if (hps_better(rs, p->dyn_score[row], j, *best_score, *best_idx)) {
+                *best_idx = j;
+                *best_score = p->dyn_score[row];
+            }
+        }
+        return;
+    }
+
+    /* ---- Re-score DYNAMIC jobs whose bound can still win ---- */
+    int visited = 0;
+    int sp = 0;
+    if (p->dynamic.len > 0) rs->stack[sp++] = 0;
+    while (sp > 0) {
+        int slot = rs->stack[--sp];
+        j = p->dynamic.slots[slot];
+        if (*best_idx >= 0 && p->dynamic.key[j] < *best_score) continue;
+
+        visited++;
+        if (rs->ctr) {
+            rs->ctr->examined++;
+            rs->ctr->rescored++;
+        }
+        double score = hps_slot_score(rs, j, rs->jobs[j].deadline_us - now_us);
+        if (hps_better(rs, score, j, *best_score, *best_idx)) {
+            *best_idx = j;
+            *best_score = score;
+        }
+
+        int child = 2 * slot + 1;
+        if (child < p->dynamic.len) rs->stack[sp++] = child;
+        if (child + 1 < p->dynamic.len) rs->stack[sp++] = child + 1;
+    }
+    if (batch_ok && visited * HPS_BATCH_GAIN > p->dyn.len)
+        p->batch_picks = HPS_BATCH_RUN;
+}
+
+static int hps_pick(ReadySet *rs, double now_us, int first, int end)
+{
+    /* ---- Advance phase timers ---- */
+    int j;
+    while ((j = iheap_top(&rs->timers)) >= 0 && rs->timers.key[j] <= now_us) {
+        ReadyPool *p = &rs->pools[rs->pool[j]];
+        iheap_pop(&rs->timers);
+        if (rs->ctr) rs->ctr->phase_moves++;
+        if (rs->phase[j] == PHASE_DORMANT) {
+            iheap_remove(&p->dormant, j);
+            hps_enter_dynamic(rs, j);
+        } else {
+            hps_leave_dynamic(rs, j);
+            rs->phase[j] = PHASE_STATIC;
+            iheap_push(&p->stat, j,
+                       hps_slot_score(rs, j, rs->jobs[j].deadline_us - now_us));
+        }
+    }
+
+    int best_idx = -1;
+    double best_score = -DBL_MAX;
+    for (int i = first; i < end; i++)
+        hps_pool_pick(rs, &rs->pools[i], now_us, &best_idx, &best_score);
+    return best_idx;
+}
+
+static int fifo_pick(ReadySet *rs, int first, int end)
+{
+    int j = -1;
+    for (int i = first; i < end; i++) {
+        int k = iheap_top(&rs->pools[i].fifo);
+        if (k >= 0 && (j < 0 || rs->seq[k] < rs->seq[j])) j = k;
+    }
+    if (j >= 0 && rs->ctr) rs->ctr->examined++;
+    return j;
+}
+
+int ready_set_pick(ReadySet *rs, double now_us, int uploads)
+{
+    int first = uploads == SCHED_UPLOADS_ONLY ? POOL_NO_KEYS : POOL_KEYS;
+    int end = uploads == SCHED_UPLOADS_CLOSED ? POOL_NO_KEYS : N_POOLS;
+    int j;
+    while ((j = rs->kind == READY_FIFO ? fifo_pick(rs, first, end)
+                                       : hps_pick(rs, now_us, first, end)) >= 0) {
+        if (slot_waiting(rs, j)) {
+            ready_set_retire(rs, j);
+            rs->parked[j] = 1;
+            if (rs->ctr) rs->ctr->parked++;
+        } else if (slot_misplaced(rs, j)) {
+            ready_set_retire(rs, j);
+            ready_set_place(rs, j, now_us);
+        } else {
+            break;
+        }
+    }
+    return j;
+}
+
+void ready_set_set_counters(ReadySet *rs, SchedCounters *c)
+{
+    rs->ctr = c;
+}
+
+double ready_set_stable_until(const ReadySet *rs, double now_us)
+{
+    if (rs->kind == READY_FIFO) return DBL_MAX;
+    for (int i = 0; i < N_POOLS; i++)
+        if (rs->pools[i].dynamic.len > 0) return now_us;
+
+    int j = iheap_top(&rs->timers);
+    return j >= 0 ? rs->timers.key[j] : DBL_MAX;
+}
+
+/* ====================================================
+   ================ BUILT-IN POLICIES =================
+   ==================================================== */
+
+/* FIFO and HPS as SchedulerOps over a ReadySet.  Pick order is the same
+ * as pick_job_fifo / pick_job_hps. */
+typedef struct {
+    const SchedContext *ctx;
+    ReadySet *rs;
+} BuiltinSched;
+
+static void *builtin_init(const SchedContext *ctx, ReadyKind kind)
+{
+    BuiltinSched *b = malloc(sizeof(BuiltinSched));
+    if (!b) return NULL;
+    b->ctx = ctx;
+    b->rs = ready_set_create(kind, ctx->cfg, ctx->weights, ctx->jobs, ctx->hot,
+                             ctx->cap);
+    if (!b->rs) {
+        free(b);
+        return NULL;
+    }
+    ready_set_set_counters(b->rs, ctx->counters);
+    return b;
+}
+
+static void *fifo_init(const SchedContext *ctx) { return builtin_init(ctx, READY_FIFO); }
+static void *hps_init(const SchedContext *ctx) { return builtin_init(ctx, READY_HPS); }
+
+static void builtin_destroy(void *state)
+{
+    BuiltinSched *b = state;
+    ready_set_destroy(b->rs);
+    free(b);
+}
+
+static int builtin_resize(void *state)
+{
+    BuiltinSched *b = state;
+    return ready_set_reserve(b->rs, b->ctx->jobs, b->ctx->hot, b->ctx->cap);
+}
+
+static void builtin_arrival(void *state, int slot, long long seq, double now_us)
+{
+    BuiltinSched *b = state;
+    ready_set_admit(b->rs, slot, seq, now_us);
+}
+
+static void builtin_transfer_done(void *state, int slot, double now_us)
+{
+    BuiltinSched *b = state;
+    ready_set_unpark(b->rs, slot, now_us);
+}
+
+static void builtin_bootstrap_done(void *state, int slot, int engine, double now_us)
+{
+    BuiltinSched *b = state;
+    (void)engine;
+    if (sched_job_remaining(b->ctx, slot) == 0)
+        ready_set_retire(b->rs, slot);
+    else
+        ready_set_unpark(b->rs, slot, now_us);
+}
+
+static int builtin_pick(void *state, double now_us, int idle_engines, int *n_slices)
+{
+    BuiltinSched *b = state;
+    (void)idle_engines;
+    (void)n_slices;
+    return ready_set_pick(b->rs, now_us, b->ctx->uploads);
+}
+
+static double builtin_stable_until(void *state, double now_us)
+{
+    BuiltinSched *b = state;
+    return ready_set_stable_until(b->rs, now_us);
+}
+
+const SchedulerOps sched_fifo_ops = {
+    .abi = SCHED_PLUGIN_ABI,
+    .name = "fifo",
+    .label = "FIFO Baseline",
+    .init = fifo_init,
+    .destroy = builtin_destroy,
+    .on_resize = builtin_resize,
+    .on_arrival = builtin_arrival,
+    .on_transfer_done = builtin_transfer_done,
+    .on_bootstrap_done = builtin_bootstrap_done,
+    .pick_batch = builtin_pick,
+    .stable_until = builtin_stable_until
+};
+
+const SchedulerOps sched_hps_ops = {
+    .abi = SCHED_PLUGIN_ABI,
+    .name = "hps",
+    .label = "HPS Scheduler",
+    .init = hps_init,
+    .destroy = builtin_destroy,
+    .on_resize = builtin_resize,
+    .on_arrival = builtin_arrival,
+    .on_transfer_done = builtin_transfer_done,
+    .on_bootstrap_done = builtin_bootstrap_done,
+    .pick_batch = builtin_pick,
+    .stable_until = builtin_stable_until
+};
+
+/* Policies that rank jobs by one key each, in IndexedHeaps over the
+ * slots, ties to the earlier admission.  A key may only move against the
+ * job (down for a max-heap, up for a min-heap) as its bootstraps are
+ * issued, without a callback, so it is checked when the job reaches the
+ * top and the job is pushed again with its current key when it has gone
+ * stale.  Jobs that cannot run leave the heaps until a transfer or
+ * bootstrap brings them back.  Jobs without their keys have a heap of
+ * their own, as in the ReadySet pools. */
+typedef double (*SlotKeyFn)(const SchedContext *ctx, int j);
+
+typedef struct {
+    const SchedContext *ctx;
+    SlotKeyFn key;
+    IndexedHeap heap[N_POOLS];
+    long long *seq;         // admission order per slot, breaks ties
+    int cap;
+} KeyedSched;
+
+static int keyed_resize(void *state)
+{
+    KeyedSched *c = state;
+    int cap = c->ctx->cap;
+    if (cap <= c->cap) return 0;
+    long long *seq = realloc(c->seq, cap * sizeof(long long));
+    if (!seq) return -1;
+    c->seq = seq;
+    for (int i = 0; i < N_POOLS; i++) {
+        if (iheap_reserve(&c->heap[i], cap) != 0) return -1;
+        c->heap[i].tie = c->seq;
+    }
+    c->cap = cap;
+    return 0;
+}
+
+static void keyed_destroy(void *state)
+{
+    KeyedSched *c = state;
+    for (int i = 0; i < N_POOLS; i++) iheap_free(&c->heap[i]);
+    free(c->seq);
+    free(c);
+}
+
+static void *keyed_init(const SchedContext *ctx, SlotKeyFn key, int is_max)
+{
+    KeyedSched *c = calloc(1, sizeof(KeyedSched));
+    if (!c) return NULL;
+    c->ctx = ctx;
+    c->key = key;
+    for (int i = 0; i < N_POOLS; i++) iheap_init(&c->heap[i], 0, is_max);
+    if (keyed_resize(c) != 0) {
+        keyed_destroy(c);
+        return NULL;
+    }
+    return c;
+}
+
+static int keyed_pool(const KeyedSched *c, int slot)
+{
+    return sched_job_transferred(c->ctx, slot) ? POOL_KEYS : POOL_NO_KEYS;
+}
+
+/* Queue the job with its current key if it can run. */
+static void keyed_requeue(KeyedSched *c, int slot)
+{
+    if (!sched_job_runnable(c->ctx, slot)) return;
+    int pool = keyed_pool(c, slot);
+    iheap_remove(&c->heap[!pool], slot);
+    iheap_push(&c->heap[pool], slot, c->key(c->ctx, slot));
+}
+
+static void keyed_arrival(void *state, int slot, long long seq, double now_us)
+{
+    KeyedSched *c = state;
+    (void)now_us;
+    c->seq[slot] = seq;
+    keyed_requeue(c, slot);
+}
+
+static void keyed_transfer_done(void *state, int slot, double now_us)
+{
+    (void)now_us;
+    keyed_requeue(state, slot);
+}
+
+static void keyed_bootstrap_done(void *state, int slot, int engine, double now_us)
+{
+    KeyedSched *c = state;
+    (void)engine;
+    (void)now_us;
+    if (sched_job_remaining(c->ctx, slot) == 0) {
+        for (int i = 0; i < N_POOLS; i++) iheap_remove(&c->heap[i], slot);
+    } else {
+        keyed_requeue(c, slot);
+    }
+}
+
+/* Best job in one heap that can run, with its current key. */
+static int keyed_top(KeyedSched *c, int pool)
+{
+    SchedCounters *ctr = c->ctx->counters;
+    IndexedHeap *h = &c->heap[pool];
+    int j;
+    while ((j = iheap_top(h)) >= 0) {
+        if (ctr) ctr->examined++;
+        if (!sched_job_runnable(c->ctx, j)) {
+            iheap_remove(h, j);
+            if (ctr) ctr->parked++;
+            continue;
+        }
+        if (keyed_pool(c, j) != pool) {
+            // its keys turned up in the cache when it was picked
+            keyed_requeue(c, j);
+            continue;
+        }
+        double key = c->key(c->ctx, j);
+        if (key == h->key[j]) return j;
+        if (ctr) ctr->stale++;
+        iheap_push(h, j, key);
+    }
+    return -1;
+}
+
+static int keyed_pick(void *state, double now_us, int idle_engines, int *n_slices)
+{
+    KeyedSched *c = state;
+    (void)now_us;
+    (void)idle_engines;
+    (void)n_slices;
+
+    int uploads = c->ctx->uploads;
+    int j = uploads == SCHED_UPLOADS_ONLY ? -1 : keyed_top(c, POOL_KEYS);
+    if (uploads == SCHED_UPLOADS_CLOSED) return j;
+    int k = keyed_top(c, POOL_NO_KEYS);
+    if (k < 0) return j;
+    if (j < 0) return k;
+
+    // the order the two heaps keep
+    double kj = c->heap[POOL_KEYS].key[j], kk = c->heap[POOL_NO_KEYS].key[k];
+    if (kk != kj) return (c->heap[POOL_KEYS].is_max ? kk > kj : kk < kj) ? k : j;
+    if (c->seq[k] != c->seq[j]) return c->seq[k] < c->seq[j] ? k : j;
+    return k < j ? k : j;
+}
+
+/* Critical path first, the job-level form of HLFET: engines go to the job
+ * whose best released bootstrap heads the longest chain, in time
+ * (sched_job_path() bootstrap times).  Max-heap on path time. */
+static double cp_key(const SchedContext *ctx, int j)
+{
+    return sched_job_path(ctx, j) * sched_job_bootstrap_us(ctx, j);
+}
+
+static void *cp_init(const SchedContext *ctx)
+{
+    return keyed_init(ctx, cp_key, 1);
+}
+
+const SchedulerOps sched_cp_ops = {
+    .abi = SCHED_PLUGIN_ABI,
+    .name = "cp",
+    .label = "Critical Path First",
+    .init = cp_init,
+    .destroy = keyed_destroy,
+    .on_resize = keyed_resize,
+    .on_arrival = keyed_arrival,
+    .on_transfer_done = keyed_transfer_done,
+    .on_bootstrap_done = keyed_bootstrap_done,
+    .pick_batch = keyed_pick
+};
+
+/* Earliest deadline first: min-heap on the absolute deadline, jobs
+ * without one after every job with one, in admission order. */
+static double edf_key(const SchedContext *ctx, int j)
+{
+    double d = ctx->jobs[j].deadline_us;
+    return d > 0.0 ? d : DBL_MAX;
+}
+
+static void *edf_init(const SchedContext *ctx)
+{
+    return keyed_init(ctx, edf_key, 0);
+}
+
+const SchedulerOps sched_edf_ops = {
+    .abi = SCHED_PLUGIN_ABI,
+    .name = "edf",
+    .label = "Earliest Deadline First",
+    .init = edf_init,
+    .destroy = keyed_destroy,
+    .on_resize = keyed_resize,
+    .on_arrival = keyed_arrival,
+    .on_transfer_done = keyed_transfer_done,
+    .on_bootstrap_done = keyed_bootstrap_done,
+    .pick_batch = keyed_pick
+};
+
+/* Least laxity first: min-heap on the deadline less the engine time the
+ * job still needs at best, its remaining bootstraps spread over every
+ * engine but no faster than its graph's critical path.  The clock is left
+ * out, it is the same for every job.  The laxity only grows as the job's
+ * bootstraps are issued. */
+static double llf_key(const SchedContext *ctx, int j)
+{
+    double d = ctx->jobs[j].deadline_us;
+    if (d <= 0.0) return DBL_MAX;
+
+    int n_eng = ctx->cfg->num_engines;
+    int rounds = (sched_job_remaining(ctx, j) + n_eng - 1) / n_eng;
+    int path = sched_job_path(ctx, j);
+    if (path > rounds) rounds = path;
+    double slice = sched_job_bootstrap_us(ctx, j) + ctx->cfg->ctx_switch_overhead_us;
+    return d - rounds * slice;
+}
+
+static void *llf_init(const SchedContext *ctx)
+{
+    return keyed_init(ctx, llf_key, 0);
+}
+
+const SchedulerOps sched_llf_ops = {
+    .abi = SCHED_PLUGIN_ABI,
+    .name = "llf",
+    .label = "Least Laxity First",
+    .init = llf_init,
+    .destroy = keyed_destroy,
+    .on_resize = keyed_resize,
+    .on_arrival = keyed_arrival,
+    .on_transfer_done = keyed_transfer_done,
+    .on_bootstrap_done = keyed_bootstrap_done,
+    .pick_batch = keyed_pick
+};
+
 
 
 // Compute per-bootstrap time
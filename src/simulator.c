@@ -2,19 +2,40 @@
 #include <stdlib.h>
 #include <float.h>
 #include <string.h>
+#include <stdint.h>
+#include <sys/stat.h>
 #include "../includes/simulator.h"
 #include "../includes/scheduler.h"
-
-typedef struct {
-    int job_id; // job index
-    double remaining_bits; // remaining transfer size in bits
-} Transfer;
-
-// File-scope testing knobs
+#include "../includes/heap.h"
+#include "../includes/key_cache.h"
+#include "../includes/timeline.h"
+#include "../includes/histogram.h"
+#include "../includes/sched_registry.h"
+#include "../includes/pcie.h"
+#include "../includes/ks_pipe.h"
+#include "../includes/uploads.h"
+
+// File-scope defaults used by run_simulation; run_simulation_params takes
+// its own copy so concurrent runs never share them
 static double g_pcie_scale = 1.0; // multiply pcie bandwidth by this
 static double g_pcie_cap_mb = 0.0; // cap per-transfer size in MB (0 = no cap)
+static int g_pcie_dma_depth = 0;   // uploads in setup or on the link (0 = no cap)
+static double g_pcie_setup_us = 0.0;
 static int g_show_progress = 0;    // whether to print progress updates
 static char *g_csv_prefix = NULL;
+static int g_fast_forward = 1;     // collapse steady bootstrap chains
+static int g_key_cache = 0;        // model resident keys in key_mem_mb
+static KeyEvictPolicy g_key_policy = KEY_EVICT_LRU;
+static KeySharing g_key_sharing = KEY_SHARE_TENANT;
+static int g_prefetch_depth = 0;   // speculative uploads, 0 = off
+static double g_prefetch_budget_mb = 0.0;
+static HwCostModel g_cost_model = HW_COST_STATIC;
+static const SimSnapshot *g_restore = NULL;
+static const JobDagSet *g_dags = NULL;
+static AdmitPolicy g_admit = ADMIT_ALL;
+static char *g_out_dir = NULL;     // NULL = SIM_DEFAULT_OUT_DIR
+static TimelineFormat g_timeline_format = TIMELINE_CSV;
+static double g_timeline_merge_us = 0.0;
 
 /* ===================== SETTERS ===================== */
 
@@ -26,6 +47,11 @@ void simulator_set_pcie_cap_mb(double cap_mb) {
     if (cap_mb >= 0.0) g_pcie_cap_mb = cap_mb;
 }
 
+void simulator_set_pcie_dma(int depth, double setup_us) {
+    if (depth >= 0) g_pcie_dma_depth = depth;
+    if (setup_us >= 0.0) g_pcie_setup_us = setup_us;
+}
+
 void simulator_set_show_progress(int show) {
     g_show_progress = show ? 1 : 0;
 }
@@ -36,209 +62,2008 @@ void simulator_set_csv_prefix(const char *prefix) {
     else g_csv_prefix = NULL;
 }
 
+void simulator_set_fast_forward(int enable) {
+    g_fast_forward = enable ? 1 : 0;
+}
+
+void simulator_set_key_cache(int enable, KeyEvictPolicy policy,
+                             KeySharing sharing) {
+    g_key_cache = enable ? 1 : 0;
+    g_key_policy = policy;
+    g_key_sharing = sharing;
+}
+
+void simulator_set_out_dir(const char *dir) {
+    if (g_out_dir) free(g_out_dir);
+    g_out_dir = dir ? strdup(dir) : NULL;
+}
+
+void simulator_set_timeline(TimelineFormat fmt, double merge_us) {
+    g_timeline_format = fmt;
+    if (merge_us >= 0.0) g_timeline_merge_us = merge_us;
+}
+
+void simulator_set_prefetch(int depth, double budget_mb) {
+    if (depth >= 0) g_prefetch_depth = depth;
+    if (budget_mb >= 0.0) g_prefetch_budget_mb = budget_mb;
+}
+
+void simulator_set_cost_model(HwCostModel model) {
+    g_cost_model = model;
+}
+
+void simulator_set_restore(const SimSnapshot *snapshot) {
+    g_restore = snapshot;
+}
+
+void simulator_set_dags(const JobDagSet *dags) {
+    g_dags = dags;
+}
+
+void simulator_set_admit(AdmitPolicy policy) {
+    g_admit = policy;
+}
+
+int sim_parse_admit(const char *name, AdmitPolicy *out) {
+    if (strcmp(name, "all") == 0) *out = ADMIT_ALL;
+    else if (strcmp(name, "reject") == 0) *out = ADMIT_REJECT;
+    else if (strcmp(name, "defer") == 0) *out = ADMIT_DEFER;
+    else return -1;
+    return 0;
+}
+
+void sim_params_default(SimParams *p) {
+    p->pcie_scale = g_pcie_scale;
+    p->pcie_cap_mb = g_pcie_cap_mb;
+    p->pcie_dma_depth = g_pcie_dma_depth;
+    p->pcie_setup_us = g_pcie_setup_us;
+    p->show_progress = g_show_progress;
+    p->csv_prefix = g_csv_prefix;
+    p->fast_forward = g_fast_forward;
+    p->cost_model = g_cost_model;
+    p->key_cache = g_key_cache;
+    p->key_policy = g_key_policy;
+    p->key_sharing = g_key_sharing;
+    p->prefetch_depth = g_prefetch_depth;
+    p->prefetch_budget_mb = g_prefetch_budget_mb;
+    p->out_dir = g_out_dir;
+    p->timeline_format = g_timeline_format;
+    p->timeline_merge_us = g_timeline_merge_us;
+    p->weights = scheduler_get_weights();
+    p->counters = NULL;
+    p->sched_arg = NULL;
+    p->sync = NULL;
+    p->restore = g_restore;
+    p->dags = g_dags;
+    p->admit = g_admit;
+    p->stop = NULL;
+    p->stop_ctx = NULL;
+}
+
+typedef struct {
+    double arrival_us;
+    int idx;
+} ArrivalKey;
+
+static int cmp_arrival_key(const void *a, const void *b) {
+    const ArrivalKey *ka = a;
+    const ArrivalKey *kb = b;
+    if (ka->arrival_us < kb->arrival_us) return -1;
+    if (ka->arrival_us > kb->arrival_us) return 1;
+    return ka->idx - kb->idx;
+}
+
+/* Job indices ordered by (arrival, index).  Workloads from read_workload
+ * are already sorted, in which case this is just the identity. */
+/* NULL when out of memory. */
+static int *arrival_sorted_order(const TfheJob *jobs, int n_jobs) {
+    int *order = malloc((n_jobs > 0 ? n_jobs : 1) * sizeof(int));
+    if (!order) return NULL;
+    int sorted = 1;
+    for (int i = 0; i < n_jobs; i++) {
+        order[i] = i;
+        if (i > 0 && jobs[i].arrival_time_us < jobs[i - 1].arrival_time_us)
+            sorted = 0;
+    }
+    if (sorted) return order;
+
+    ArrivalKey *keys = malloc(n_jobs * sizeof(ArrivalKey));
+    if (!keys) {
+        free(order);
+        return NULL;
+    }
+    for (int i = 0; i < n_jobs; i++)
+        keys[i] = (ArrivalKey){ jobs[i].arrival_time_us, i };
+    qsort(keys, n_jobs, sizeof(ArrivalKey), cmp_arrival_key);
+    for (int i = 0; i < n_jobs; i++)
+        order[i] = keys[i].idx;
+    free(keys);
+    return order;
+}
+
+/* ===================== JOB TABLE ===================== */
+
+/* Per-slot job state.  Fed from an array, slot i holds job i for the
+ * whole run and `jobs` is the caller's array, read but never copied.  Fed
+ * from a stream, a slot is recycled once its job has finished and no
+ * engine, transfer or key wait still refers to it, so the table only grows
+ * with the number of jobs in flight.
+ *
+ * The event loop works on `hot`; the whole record of a job is put back
+ * together by slot_job() for the reports and for stateless pickers. */
+typedef struct {
+    const TfheJob *jobs;    // as the job arrived
+    TfheJob *own_jobs;      // stream mode: the records behind `jobs`
+    JobHot *hot;            // cache-line aligned
+    JobTimes *times;
+    long long *seq;         // admission order, -1 for a free slot
+    int *refs;              // engines, transfers and key waits on the job
+    int *key_entry;         // cache entry held by each job, -1 if none
+    int *key_waiter;        // next job waiting on the same upload
+    int *free_slots;
+
+    /* with prefetch on only */
+    double *pf_start;       // when the job's keys were prefetched, -1 = not
+    double *pf_done;        // when that upload finished, -1 = not yet
+    long long *pf_dispatch; // jobs dispatched before the prefetch
+    unsigned char *arrived; // admitted to the scheduler yet
+
+    /* with bootstrap graphs only */
+    DagRun *dag;            // dag == NULL for jobs without one
+    int *path;              // SchedContext.path
+
+    /* with key-switch units only */
+    int *ks_held;           // bootstraps off their engine, key-switch pending
+
+    /* with admission control only */
+    unsigned char *admit;   // SLOT_* below
+    int n_free;
+    int n_slots;            // slots handed out so far
+    int cap;
+} JobTable;
+
+/* The job in slot j as one record, with its run state filled in. */
+static TfheJob slot_job(const JobTable *t, int j) {
+    TfheJob job = t->jobs[j];
+    job.remaining_bootstraps = t->hot[j].remaining_bootstraps;
+    job.pcie_transferred = t->hot[j].pcie_transferred;
+    job.started = t->hot[j].started;
+    job.start_time_us = t->times[j].start_us;
+    job.completion_time_us = t->times[j].completion_us;
+    return job;
+}
+
+/* Where admission control (SimParams.admit) put a job. */
+enum {
+    SLOT_ADMITTED,          // straight to the scheduler
+    SLOT_HELD,              // deferred, not given to the scheduler yet
+    SLOT_DEFERRED,          // deferred, then given to the scheduler
+    SLOT_REJECTED
+};
+
+/* Deadline outcome of one group of jobs so far. */
+typedef struct {
+    long n;                 // jobs that ran
+    long with_deadline;
+    long missed;
+    long rejected;
+    long deferred;
+    Histogram *lateness;    // NULL until the first miss
+} DeadlineAcc;
+
+/* Running totals for SimStats.  Jobs are added in index order when the
+ * run is fed from an array, and as their slots are recycled when it is
+ * streamed. */
+typedef struct {
+    long n;
+    double first_arrival;
+    double last_finish;
+    double sum_comp;
+    double sum_slow;
+    double *sum_slow_t;     // per tenant
+    int *cnt_t;
+    int n_tenants;
+
+    /* tail latency; zeroed memory is an empty histogram */
+    Histogram response;
+    Histogram queue;
+    Histogram slowdown;
+    Histogram **tenant_hist;    // response, queue, slowdown per tenant
+
+    DeadlineAcc dl;
+    DeadlineAcc *dl_t;          // per tenant
+    DeadlineAcc *dl_p;          // per priority
+    int n_priorities;
+} StatsAcc;
+
+static double job_slowdown(const HwConfig *cfg, const TfheJob *job) {
+    double svc = job->num_bootstraps * bootstrap_time_us(cfg, job);
+    if (svc < 1) svc = 1;
+    return (job->completion_time_us - job->arrival_time_us) / svc;
+}
+
+static void deadline_add(DeadlineAcc *d, const TfheJob *job, int admit) {
+    if (admit == SLOT_REJECTED) {
+        d->rejected++;
+        return;
+    }
+    d->n++;
+    // held still when an early stop ended the run
+    if (admit == SLOT_DEFERRED || admit == SLOT_HELD) d->deferred++;
+    if (job->deadline_us <= 0.0) return;
+
+    d->with_deadline++;
+    if (job->completion_time_us <= job->deadline_us) return;
+    d->missed++;
+    if (!d->lateness) d->lateness = calloc(1, sizeof(Histogram));
+    hist_add(d->lateness, job->completion_time_us - job->deadline_us);
+}
+
+static void stats_grow_tenants(StatsAcc *a, int t) {
+    if (t < a->n_tenants) return;
+    int n = 2 * t + 8;
+    a->sum_slow_t = realloc(a->sum_slow_t, n * sizeof(double));
+    a->cnt_t = realloc(a->cnt_t, n * sizeof(int));
+    a->tenant_hist = realloc(a->tenant_hist, n * sizeof(Histogram *));
+    a->dl_t = realloc(a->dl_t, n * sizeof(DeadlineAcc));
+    for (int k = a->n_tenants; k < n; k++) {
+        a->sum_slow_t[k] = 0.0;
+        a->cnt_t[k] = 0;
+        a->tenant_hist[k] = NULL;
+        a->dl_t[k] = (DeadlineAcc){0};
+    }
+    a->n_tenants = n;
+}
+
+/* Add a job that finished or was rejected (`admit` is its SLOT_*). */
+static void stats_add(StatsAcc *a, const HwConfig *cfg, const TfheJob *job,
+                      int admit) {
+    int t = job->tenant_id;
+    int p = job->priority;
+    if (t >= 0) stats_grow_tenants(a, t);
+    if (p >= 0 && p >= a->n_priorities) {
+        int n = 2 * p + 4;
+        a->dl_p = realloc(a->dl_p, n * sizeof(DeadlineAcc));
+        for (int k = a->n_priorities; k < n; k++) a->dl_p[k] = (DeadlineAcc){0};
+        a->n_priorities = n;
+    }
+    deadline_add(&a->dl, job, admit);
+    if (t >= 0) deadline_add(&a->dl_t[t], job, admit);
+    if (p >= 0) deadline_add(&a->dl_p[p], job, admit);
+    if (admit == SLOT_REJECTED) return;
+
+    if (a->n == 0 || job->arrival_time_us < a->first_arrival)
+        a->first_arrival = job->arrival_time_us;
+    if (job->completion_time_us > a->last_finish)
+        a->last_finish = job->completion_time_us;
+
+    double resp = job->completion_time_us - job->arrival_time_us;
+    double slow = job_slowdown(cfg, job);
+
+    a->sum_comp += resp;
+    a->sum_slow += slow;
+    a->n++;
+
+    // jobs that never got an engine have no queueing delay to report
+    int started = job->start_time_us >= 0.0;
+    double queue = job->start_time_us - job->arrival_time_us;
+    hist_add(&a->response, resp);
+    hist_add(&a->slowdown, slow);
+    if (started) hist_add(&a->queue, queue);
+
+    if (t < 0) return;
+    a->sum_slow_t[t] += slow;
+    a->cnt_t[t]++;
+
+    Histogram *th = a->tenant_hist[t];
+    if (!th) th = a->tenant_hist[t] = calloc(3, sizeof(Histogram));
+    hist_add(&th[0], resp);
+    if (started) hist_add(&th[1], queue);
+    hist_add(&th[2], slow);
+}
+
+static Percentiles percentiles(const Histogram *h) {
+    return (Percentiles){
+        .p50 = hist_quantile(h, 0.50),
+        .p90 = hist_quantile(h, 0.90),
+        .p99 = hist_quantile(h, 0.99),
+        .p999 = hist_quantile(h, 0.999)
+    };
+}
+
+static DeadlineStats deadline_finish(DeadlineAcc *d) {
+    DeadlineStats s = {
+        .with_deadline = d->with_deadline,
+        .missed = d->missed,
+        .rejected = d->rejected,
+        .deferred = d->deferred
+    };
+    if (d->lateness) s.lateness_us = percentiles(d->lateness);
+    free(d->lateness);
+    d->lateness = NULL;
+    return s;
+}
+
+static void stats_finish(StatsAcc *a, const HwConfig *cfg,
+                         double total_engine_busy_us, SimStats *s) {
+    s->n_jobs = a->n;
+    s->makespan_us = a->last_finish - a->first_arrival;
+    s->first_arrival_us = a->first_arrival;
+    s->last_finish_us = a->last_finish;
+    // admission control may have turned every job away
+    s->avg_completion_time_us = a->n > 0 ? a->sum_comp / a->n : 0.0;
+    s->avg_slowdown = a->n > 0 ? a->sum_slow / a->n : 0.0;
+    s->engine_utilization =
+        (s->makespan_us > 0 ? total_engine_busy_us / (s->makespan_us * cfg->num_engines)
+                            : 0.0);
+
+    /* Jain's index over the per-tenant average slowdown */
+    double sum_x = 0, sum_x2 = 0;
+    int present = 0;
+    for (int t = 0; t < a->n_tenants; t++) {
+        if (a->cnt_t[t] > 0) {
+            double avg = a->sum_slow_t[t] / a->cnt_t[t];
+            sum_x += avg;
+            sum_x2 += avg * avg;
+            present++;
+        }
+    }
+    s->fairness = present > 1 ? (sum_x * sum_x) / (present * sum_x2) : 1.0;
+
+    /* percentiles, overall and per tenant */
+    s->response_us = percentiles(&a->response);
+    s->queue_us = percentiles(&a->queue);
+    s->slowdown = percentiles(&a->slowdown);
+
+    // tenants whose jobs were all rejected still get a row
+    int listed = 0;
+    for (int t = 0; t < a->n_tenants; t++)
+        if (a->cnt_t[t] > 0 || a->dl_t[t].rejected > 0) listed++;
+
+    s->tenants = listed > 0 ? malloc(listed * sizeof(TenantStats)) : NULL;
+    s->n_tenants = 0;
+    for (int t = 0; t < a->n_tenants; t++) {
+        Histogram *th = a->tenant_hist[t];
+        if (a->cnt_t[t] == 0 && a->dl_t[t].rejected == 0) continue;
+        TenantStats *ts = &s->tenants[s->n_tenants++];
+        *ts = (TenantStats){
+            .tenant_id = t,
+            .n_jobs = a->cnt_t[t],
+            .deadlines = deadline_finish(&a->dl_t[t])
+        };
+        if (!th) continue;
+        ts->avg_slowdown = a->sum_slow_t[t] / a->cnt_t[t];
+        ts->response_us = percentiles(&th[0]);
+        ts->queue_us = percentiles(&th[1]);
+        ts->slowdown = percentiles(&th[2]);
+        free(th);
+    }
+
+    /* deadlines, overall and per priority */
+    s->deadlines = deadline_finish(&a->dl);
+    listed = 0;
+    for (int p = 0; p < a->n_priorities; p++)
+        if (a->dl_p[p].n > 0 || a->dl_p[p].rejected > 0) listed++;
+    s->priorities = listed > 0 ? malloc(listed * sizeof(PriorityStats)) : NULL;
+    s->n_priorities = 0;
+    for (int p = 0; p < a->n_priorities; p++) {
+        if (a->dl_p[p].n == 0 && a->dl_p[p].rejected == 0) continue;
+        s->priorities[s->n_priorities++] = (PriorityStats){
+            .priority = p,
+            .n_jobs = a->dl_p[p].n,
+            .deadlines = deadline_finish(&a->dl_p[p])
+        };
+    }
+
+    free(a->tenant_hist);
+    free(a->sum_slow_t);
+    free(a->cnt_t);
+    free(a->dl_t);
+    free(a->dl_p);
+}
+
+void sim_stats_free(SimStats *s) {
+    free(s->tenants);
+    s->tenants = NULL;
+    s->n_tenants = 0;
+    free(s->priorities);
+    s->priorities = NULL;
+    s->n_priorities = 0;
+}
+
+static void write_job_row(FILE *f, const TfheJob *job) {
+    fprintf(f, "%d,%d,%.0f,%.0f,%.0f,%d,%.2f,%d\n",
+            job->id, job->tenant_id,
+            job->arrival_time_us, job->start_time_us,
+            job->completion_time_us, job->num_bootstraps,
+            job->key_size_mb, job->pcie_transferred);
+}
+
+/* Everything one run owns besides its engines and event queue. */
+typedef struct {
+    const HwConfig *cfg;
+    const SimParams *params;
+    JobTable tab;
+    StatsAcc acc;
+    FILE *job_csv;
+
+    /* arrivals: a job array in any order, or a sorted JobSource */
+    const TfheJob *in_jobs;
+    int *arrival_order;
+    int n_in;
+    int next_in;
+    JobSource *src;
+    TfheJob pending;
+    int has_pending;
+    int feed_error;
+    double last_arrival_us;
+
+    long long admitted;
+    long long finished;
+    double first_arrival_us;
+
+    /* admission control: engine time the scheduler's jobs still need, and
+     * deferred jobs in arrival order */
+    double backlog_us;
+    int *held_ring;
+    int held_head, held_len, held_cap;
+
+    /* keys: uploads by job slot, and the resident cache (NULL = off) */
+    PcieLink *link;
+    KeyCache *kc;
+    int *key_waiters;           // first waiting job per cache entry
+    int key_waiters_cap;
+    double pcie_mb_moved;
+    UploadCap uploads;          // uploads started by picks (uploads.h)
+
+    /* prefetch: admitted jobs in arrival order, dispatched ones dropped
+     * lazily from the front */
+    int *pf_ring;
+    long long *pf_ring_seq;
+    int pf_head, pf_len, pf_cap;
+    double pf_inflight_mb;
+    long long dispatched;       // jobs picked for the first time
+    SimStats pf_stats;          // prefetch fields only
+
+    /* run_simulation_snapshot: where to stop and what became of it */
+    const char *snap_path;
+    double snap_at_us;
+    int snap_rc;
+
+    /* scheduler policy and its view of the job table */
+    const SchedulerOps *ops;
+    void *sched;
+    SchedContext sctx;
+    SchedulerFn legacy_fn;      // for stateless pickers
+} Sim;
+
+/* realloc() for the hot table, which starts on a cache line. */
+static JobHot *hot_grow(JobHot *old, int old_cap, int cap) {
+    size_t bytes = (cap * sizeof(JobHot) + 63) & ~(size_t)63;
+    JobHot *hot = aligned_alloc(64, bytes);
+    if (hot && old) {
+        memcpy(hot, old, old_cap * sizeof(JobHot));
+        free(old);
+    }
+    return hot;
+}
+
+static int table_grow(Sim *sim, int cap) {
+    JobTable *t = &sim->tab;
+    if (cap <= t->cap) return 0;
+
+    TfheJob *jobs = t->own_jobs;
+    if (sim->src) {
+        jobs = realloc(t->own_jobs, cap * sizeof(TfheJob));
+        if (jobs) t->jobs = t->own_jobs = jobs;
+    }
+    JobHot *hot = hot_grow(t->hot, t->cap, cap);
+    if (hot) t->hot = hot;
+    JobTimes *times = realloc(t->times, cap * sizeof(JobTimes));
+    if (times) t->times = times;
+    long long *seq = realloc(t->seq, cap * sizeof(long long));
+    if (seq) t->seq = seq;
+    int *refs = realloc(t->refs, cap * sizeof(int));
+    if (refs) t->refs = refs;
+    int *key_entry = realloc(t->key_entry, cap * sizeof(int));
+    if (key_entry) t->key_entry = key_entry;
+    int *key_waiter = realloc(t->key_waiter, cap * sizeof(int));
+    if (key_waiter) t->key_waiter = key_waiter;
+    int *free_slots = realloc(t->free_slots, cap * sizeof(int));
+    if (free_slots) t->free_slots = free_slots;
+    if ((sim->src && !jobs) || !hot || !times || !seq || !refs ||
+        !key_entry || !key_waiter || !free_slots)
+        return -1;
+
+    if (sim->params->prefetch_depth > 0) {
+        double *pf_start = realloc(t->pf_start, cap * sizeof(double));
+        if (pf_start) t->pf_start = pf_start;
+        double *pf_done = realloc(t->pf_done, cap * sizeof(double));
+        if (pf_done) t->pf_done = pf_done;
+        long long *pf_dispatch = realloc(t->pf_dispatch, cap * sizeof(long long));
+        if (pf_dispatch) t->pf_dispatch = pf_dispatch;
+        unsigned char *arrived = realloc(t->arrived, cap);
+        if (arrived) t->arrived = arrived;
+        if (!pf_start || !pf_done || !pf_dispatch || !arrived)
+            return -1;
+    }
+    if (sim->params->dags) {
+        DagRun *dag = realloc(t->dag, cap * sizeof(DagRun));
+        if (dag) {
+            memset(dag + t->cap, 0, (cap - t->cap) * sizeof(DagRun));
+            t->dag = dag;
+        }
+        int *path = realloc(t->path, cap * sizeof(int));
+        if (path) t->path = path;
+        if (!dag || !path)
+            return -1;
+    }
+    if (sim->cfg->ks_units > 0) {
+        int *ks_held = realloc(t->ks_held, cap * sizeof(int));
+        if (!ks_held) return -1;
+        t->ks_held = ks_held;
+    }
+    if (sim->params->admit != ADMIT_ALL) {
+        unsigned char *admit = realloc(t->admit, cap);
+        if (!admit) return -1;
+        t->admit = admit;
+    }
+    if (sim->link && pcie_link_reserve(sim->link, cap) != 0)
+        return -1;
+
+    t->cap = cap;
+    sim->sctx.jobs = t->jobs;
+    sim->sctx.hot = t->hot;
+    sim->sctx.path = t->path;
+    sim->sctx.cap = cap;
+    if (sim->sched && sim->ops->on_resize && sim->ops->on_resize(sim->sched) != 0)
+        return -1;
+    return 0;
+}
+
+static void table_free(JobTable *t) {
+    for (int j = 0; t->dag && j < t->cap; j++)
+        dag_run_free(&t->dag[j]);
+    free(t->dag);
+    free(t->path);
+    free(t->ks_held);
+    free(t->admit);
+    free(t->own_jobs);
+    free(t->hot);
+    free(t->times);
+    free(t->seq);
+    free(t->refs);
+    free(t->key_entry);
+    free(t->key_waiter);
+    free(t->free_slots);
+    free(t->pf_start);
+    free(t->pf_done);
+    free(t->pf_dispatch);
+    free(t->arrived);
+}
+
+static double slot_bootstrap_us(const Sim *sim, const TfheJob *job) {
+    if (sim->params->cost_model == HW_COST_ROOFLINE)
+        // every engine streaming its own key: the slowest a slice gets
+        return hw_roofline_us(sim->cfg, job->key_size_mb, sim->cfg->num_engines);
+    return bootstrap_time_us(sim->cfg, job);
+}
+
+/* Set slot j up as a fresh, not yet dispatched job.  A streamed job is
+ * copied into the table; an array job already sits at jobs[j]. */
+static void slot_init(Sim *sim, int j, const TfheJob *job, long long seq) {
+    JobTable *t = &sim->tab;
+    if (sim->src) t->own_jobs[j] = *job;
+
+    t->hot[j] = (JobHot){
+        .remaining_bootstraps = job->remaining_bootstraps,
+        // initialize PCIe transfer state
+        .pcie_transferred = sim->cfg->pcie_bandwidth_gbps <= 0.0 ? 1 : 0,
+        .started = job->started != 0,
+        .bootstrap_us = slot_bootstrap_us(sim, job)
+    };
+    t->times[j] = (JobTimes){ job->start_time_us, job->completion_time_us };
+
+    t->seq[j] = seq;
+    t->refs[j] = 0;
+    t->key_entry[j] = -1;
+    t->key_waiter[j] = -1;
+    if (t->ks_held) t->ks_held[j] = 0;
+    if (t->admit) t->admit[j] = SLOT_ADMITTED;
+    if (t->pf_start) {
+        t->pf_start[j] = t->pf_done[j] = -1.0;
+        t->arrived[j] = 0;
+    }
+}
+
+/* Hand a finished, unreferenced job's slot back (stream mode only). */
+static void slot_retire(Sim *sim, int j) {
+    JobTable *t = &sim->tab;
+    if (!sim->src || t->refs[j] > 0 || t->times[j].completion_us <= 0.0)
+        return;
+
+    TfheJob job = slot_job(t, j);
+    int admit = t->admit ? t->admit[j] : SLOT_ADMITTED;
+    stats_add(&sim->acc, sim->cfg, &job, admit);
+    if (sim->job_csv && admit != SLOT_REJECTED) write_job_row(sim->job_csv, &job);
+
+    // custom pickers scan the table; keep them off the empty slot
+    t->hot[j].remaining_bootstraps = 0;
+    t->seq[j] = -1;
+    t->free_slots[t->n_free++] = j;
+}
+
+static void slot_unref(Sim *sim, int j) {
+    sim->tab.refs[j]--;
+    slot_retire(sim, j);
+}
+
+/* ===================== BOOTSTRAP GRAPHS ===================== */
+
+/* Put the job just admitted to slot j on its graph, if it has one.  -1
+ * when the graph does not fit the job. */
+static int dag_admit(Sim *sim, int j) {
+    JobTable *t = &sim->tab;
+    const TfheJob *job = &t->jobs[j];
+    const JobDag *d = dag_set_find(sim->params->dags, job->id);
+
+    t->path[j] = 1;
+    if (!d) return 0;
+    if (d->n_nodes != job->num_bootstraps) {
+        fprintf(stderr, "Job %d: graph has %d bootstraps, the job %d\n",
+                job->id, d->n_nodes, job->num_bootstraps);
+        return -1;
+    }
+    if (dag_run_init(&t->dag[j], d) != 0) return -1;
+    t->path[j] = dag_run_path(&t->dag[j]);
+    return 0;
+}
+
+/* Slices of slot j were issued or one of them finished. */
+static void dag_refresh(JobTable *t, int j) {
+    DagRun *r = &t->dag[j];
+    if (t->hot[j].remaining_bootstraps == 0) {
+        dag_run_free(r);
+        t->hot[j].blocked = 0;
+        t->path[j] = 0;
+        return;
+    }
+    t->hot[j].blocked = r->n_ready == 0;
+    t->path[j] = dag_run_path(r);
+}
+
+/* ===================== BOOTSTRAP COMPLETION ===================== */
+
+/* With key-switch units, a job whose remaining bootstraps have all left
+ * their engines waits for their key-switches rather than taking engines
+ * for more.  Graph jobs release nothing until then anyway. */
+static void ks_refresh(JobTable *t, int j) {
+    if (t->dag && t->dag[j].dag) return;
+    int left = t->hot[j].remaining_bootstraps;
+    t->hot[j].blocked = left > 0 && left <= t->ks_held[j];
+}
+
+/* Bootstrap `node` of slot j (-1 without a graph), run on `engine`, has
+ * finished: when its slice ends, or with key-switch units when its
+ * key-switch does. */
+static void bootstrap_done(Sim *sim, int j, int node, int engine,
+                           double now_us, Histogram *done_slowdown)
+{
+    JobTable *t = &sim->tab;
+    t->hot[j].remaining_bootstraps--;
+    if (t->hot[j].remaining_bootstraps >= 0)
+        sim->backlog_us -= t->hot[j].bootstrap_us + sim->cfg->ctx_switch_overhead_us;
+    if (t->ks_held) {
+        t->ks_held[j]--;
+        ks_refresh(t, j);
+    }
+    if (node >= 0) {
+        dag_run_done(&t->dag[j], node);
+        dag_refresh(t, j);
+    }
+
+    if (t->hot[j].remaining_bootstraps == 0) {
+        t->times[j].completion_us = now_us;
+        sim->finished++;
+        if (sim->kc) key_cache_release(sim->kc, t->key_entry[j]);
+        if (done_slowdown) {
+            TfheJob job = slot_job(t, j);
+            hist_add(done_slowdown, job_slowdown(sim->cfg, &job));
+        }
+    }
+    if (sim->ops->on_bootstrap_done)
+        sim->ops->on_bootstrap_done(sim->sched, j, engine, now_us);
+    slot_unref(sim, j);
+}
+
+/* ===================== KEY UPLOADS ===================== */
+
+/* Link bandwidth in bits per us, shared by the transfers on it (pcie.h). */
+static double pcie_bits_per_us(const HwConfig *cfg, const SimParams *params)
+{
+    double eff_pcie_gbps = cfg->pcie_bandwidth_gbps * params->pcie_scale;
+    return eff_pcie_gbps > 0.0 ? eff_pcie_gbps * 1e3 : 0.0;
+}
+
+static double upload_mb(const Sim *sim, int j) {
+    double mb = sim->tab.jobs[j].key_size_mb;
+    if (sim->params->pcie_cap_mb > 0.0 && mb > sim->params->pcie_cap_mb)
+        mb = sim->params->pcie_cap_mb;
+    return mb;
+}
+
+/* The keys of a job picked before they were resident have landed; its
+ * upload no longer counts against the cap on uploads started by picks. */
+static void unstage(Sim *sim, int j)
+{
+    if (!sim->tab.hot[j].staged) return;
+    sim->tab.hot[j].staged = 0;
+    upload_cap_landed(&sim->uploads);
+}
+
+/* Whether slot j's keys are in the cache, loaded or on their way, so that
+ * fetching them starts no upload. */
+static int keys_resident(const Sim *sim, int j)
+{
+    if (!sim->kc) return 0;
+    const TfheJob *job = &sim->tab.jobs[j];
+    long long key = key_cache_job_key(job->key_id, job->tenant_id, sim->tab.seq[j],
+                                      sim->params->key_sharing);
+    return key_cache_resident(sim->kc, key, job->key_size_mb);
+}
+
+/* Get slot j's keys onto the device: from the cache, by riding on an
+ * upload already in flight, or by starting one.  Leaves pcie_transferred
+ * at 1 when the keys are there and -1 while they are on their way.
+ * Returns the MB this call put on the link. */
+static double fetch_keys(Sim *sim, int j, double now_us)
+{
+    JobTable *t = &sim->tab;
+    const TfheJob *job = &t->jobs[j];
+    SimCounters *ic = sim->params->counters;
+
+    if (sim->kc) {
+        int key_status;
+        long long key = key_cache_job_key(job->key_id, job->tenant_id, t->seq[j],
+                                          sim->params->key_sharing);
+        int ent = key_cache_acquire(sim->kc, key, job->key_size_mb, &key_status);
+        t->key_entry[j] = ent;
+
+        if (ent >= sim->key_waiters_cap) {
+            int old_cap = sim->key_waiters_cap;
+            sim->key_waiters_cap = 2 * ent + 64;
+            sim->key_waiters = realloc(sim->key_waiters,
+                                       sim->key_waiters_cap * sizeof(int));
+            for (int w = old_cap; w < sim->key_waiters_cap; w++)
+                sim->key_waiters[w] = -1;
+        }
+
+        if (key_status == KEY_HIT) {
+            t->hot[j].pcie_transferred = 1;
+            return 0.0;
+        }
+        if (key_status == KEY_LOADING) {
+            // ride on the upload already in flight
+            t->key_waiter[j] = sim->key_waiters[ent];
+            sim->key_waiters[ent] = j;
+            t->hot[j].pcie_transferred = -1;
+            t->refs[j]++;
+            if (ic) ic->key_waits++;
+            return 0.0;
+        }
+    }
+
+    double mb = upload_mb(sim, j);
+    pcie_link_submit(sim->link, j, mb * 8.0 * 1e6, now_us);
+    t->hot[j].pcie_transferred = -1;
+    t->refs[j]++;
+    sim->pcie_mb_moved += mb;
+    if (ic) ic->transfers_started++;
+    return mb;
+}
+
+/* ===================== PREFETCH ===================== */
+
+static void pf_ring_push(Sim *sim, int j) {
+    if (sim->pf_len == sim->pf_cap) {
+        int cap = sim->pf_cap ? 2 * sim->pf_cap : 256;
+        int *ring = malloc(cap * sizeof(int));
+        long long *seq = malloc(cap * sizeof(long long));
+        if (!ring || !seq) {
+            // the job is just never prefetched
+            free(ring);
+            free(seq);
+            return;
+        }
+        for (int i = 0; i < sim->pf_len; i++) {
+            int k = (sim->pf_head + i) % sim->pf_cap;
+            ring[i] = sim->pf_ring[k];
+            seq[i] = sim->pf_ring_seq[k];
+        }
+        free(sim->pf_ring);
+        free(sim->pf_ring_seq);
+        sim->pf_ring = ring;
+        sim->pf_ring_seq = seq;
+        sim->pf_head = 0;
+        sim->pf_cap = cap;
+    }
+    int k = (sim->pf_head + sim->pf_len++) % sim->pf_cap;
+    sim->pf_ring[k] = j;
+    sim->pf_ring_seq[k] = sim->tab.seq[j];
+}
+
+/* Start slot j's upload unless it would overrun the budget (returns 0). */
+static int prefetch_job(Sim *sim, int j, double now_us) {
+    JobTable *t = &sim->tab;
+    double budget = sim->params->prefetch_budget_mb;
+    if (budget > 0.0 && sim->pf_inflight_mb + upload_mb(sim, j) > budget)
+        return 0;
+
+    double mb = fetch_keys(sim, j, now_us);
+    if (mb > 0.0) {
+        t->pf_start[j] = now_us;
+        t->pf_dispatch[j] = sim->dispatched;
+        sim->pf_inflight_mb += mb;
+        sim->pf_stats.prefetches++;
+        sim->pf_stats.prefetch_mb += mb;
+    }
+    return 1;
+}
+
+/* Fetch keys for the next prefetch_depth jobs in arrival order that have
+ * not been dispatched: admitted jobs first, then, when the whole workload
+ * is loaded, the ones about to arrive.  Stops at the first upload the
+ * budget has no room for, so the order of uploads follows the order of
+ * the jobs. */
+static void prefetch(Sim *sim, double now_us)
+{
+    JobTable *t = &sim->tab;
+    int depth = sim->params->prefetch_depth;
+
+    while (sim->pf_len > 0) {
+        int k = sim->pf_head;
+        int j = sim->pf_ring[k];
+        if (t->seq[j] == sim->pf_ring_seq[k] && !t->hot[j].started) break;
+        sim->pf_head = (k + 1) % sim->pf_cap;
+        sim->pf_len--;
+    }
+
+    int seen = 0;
+    for (int i = 0; i < sim->pf_len && seen < depth; i++, seen++) {
+        int k = (sim->pf_head + i) % sim->pf_cap;
+        int j = sim->pf_ring[k];
+        if (t->seq[j] != sim->pf_ring_seq[k] || t->hot[j].started) continue;
+        if (!t->hot[j].pcie_transferred && !prefetch_job(sim, j, now_us)) return;
+    }
+    for (int i = sim->next_in; !sim->src && i < sim->n_in && seen < depth; i++, seen++) {
+        int j = sim->arrival_order[i];
+        if (!t->hot[j].pcie_transferred && !prefetch_job(sim, j, now_us)) return;
+    }
+}
+
+/* A prefetch is accurate when its job is dispatched within the lookahead
+ * depth. */
+static void prefetch_dispatched(Sim *sim, int j) {
+    JobTable *t = &sim->tab;
+    if (t->pf_start[j] < 0.0) return;
+
+    SimStats *ps = &sim->pf_stats;
+    if (sim->dispatched - t->pf_dispatch[j] < sim->params->prefetch_depth)
+        ps->prefetch_accurate++;
+    else
+        ps->prefetch_wasted_mb += upload_mb(sim, j);
+}
+
+/* ===================== ADMISSION ===================== */
+
+/* Give slot j to the scheduler. */
+static void admit_to_sched(Sim *sim, int j, double now_us) {
+    JobTable *t = &sim->tab;
+    sim->backlog_us += t->hot[j].remaining_bootstraps *
+                       (t->hot[j].bootstrap_us + sim->cfg->ctx_switch_overhead_us);
+    // keys another job brought into the cache are the job's too, so the
+    // upload cap does not keep it from engines
+    if (!t->hot[j].pcie_transferred && keys_resident(sim, j))
+        fetch_keys(sim, j, now_us);
+    sim->ops->on_arrival(sim->sched, j, t->seq[j], now_us);
+    if (t->arrived) {
+        t->arrived[j] = 1;
+        pf_ring_push(sim, j);
+    }
+}
+
+/* Would slot j still make its deadline if admitted at now_us?  The
+ * estimate is its key upload, then the longer of its own run on every
+ * engine (no faster than its graph's critical path allows) and draining
+ * the backlog plus the job over all engines, as if the engines were
+ * shared fairly from here on.  Jobs without a deadline always fit. */
+static int admit_fits(const Sim *sim, int j, double now_us) {
+    const JobTable *t = &sim->tab;
+    const HwConfig *cfg = sim->cfg;
+    double deadline = t->jobs[j].deadline_us;
+    if (deadline <= 0.0) return 1;
+
+    double est = now_us;
+    double rate = pcie_bits_per_us(cfg, sim->params);
+    if (!t->hot[j].pcie_transferred && rate > 0.0)
+        est += upload_mb(sim, j) * 8.0 * 1e6 / rate;
+
+    int left = t->hot[j].remaining_bootstraps;
+    int n_eng = cfg->num_engines;
+    double slice = t->hot[j].bootstrap_us + cfg->ctx_switch_overhead_us;
+    int rounds = (left + n_eng - 1) / n_eng;
+    if (t->path && t->path[j] > rounds) rounds = t->path[j];
+    double alone = rounds * slice;
+    double shared = (sim->backlog_us + left * slice) / n_eng;
+    est += alone > shared ? alone : shared;
+    return est <= deadline;
+}
+
+/* Turn slot j away: it finishes at once and never runs. */
+static void admit_reject(Sim *sim, int j, double now_us) {
+    JobTable *t = &sim->tab;
+    t->admit[j] = SLOT_REJECTED;
+    t->hot[j].remaining_bootstraps = 0;
+    t->times[j].completion_us = now_us;
+    sim->finished++;
+    if (t->dag && t->dag[j].dag) dag_run_free(&t->dag[j]);
+    if (sim->kc) {
+        // a prefetch may have claimed its keys already
+        key_cache_release(sim->kc, t->key_entry[j]);
+        t->key_entry[j] = -1;
+    }
+    slot_retire(sim, j);
+}
+
+static void admit_hold(Sim *sim, int j) {
+    if (sim->held_len == sim->held_cap) {
+        int cap = sim->held_cap ? 2 * sim->held_cap : 256;
+        int *ring = malloc(cap * sizeof(int));
+        if (!ring) {
+            // the job just goes in now
+            admit_to_sched(sim, j, sim->tab.jobs[j].arrival_time_us);
+            return;
+        }
+        for (int i = 0; i < sim->held_len; i++)
+            ring[i] = sim->held_ring[(sim->held_head + i) % sim->held_cap];
+        free(sim->held_ring);
+        sim->held_ring = ring;
+        sim->held_head = 0;
+        sim->held_cap = cap;
+    }
+    sim->tab.admit[j] = SLOT_HELD;
+    sim->held_ring[(sim->held_head + sim->held_len++) % sim->held_cap] = j;
+}
+
+/* Release deferred jobs, oldest first, while they fit, and in any case
+ * when nothing else is left to run so that they never wait forever. */
+static void admit_held(Sim *sim, double now_us) {
+    JobTable *t = &sim->tab;
+    while (sim->held_len > 0) {
+        int j = sim->held_ring[sim->held_head];
+        long long active = sim->admitted - sim->finished - sim->held_len;
+        if (active > 0 && !admit_fits(sim, j, now_us)) break;
+        sim->held_head = (sim->held_head + 1) % sim->held_cap;
+        sim->held_len--;
+        t->admit[j] = now_us > t->jobs[j].arrival_time_us ? SLOT_DEFERRED
+                                                          : SLOT_ADMITTED;
+        admit_to_sched(sim, j, now_us);
+    }
+}
+
+/* Is there another job to admit?  Stores its arrival time. */
+static int feed_peek(Sim *sim, double *arrival_us) {
+    if (!sim->src) {
+        if (sim->next_in >= sim->n_in) return 0;
+        *arrival_us = sim->in_jobs[sim->arrival_order[sim->next_in]].arrival_time_us;
+        return 1;
+    }
+
+    if (!sim->has_pending && !sim->feed_error) {
+        int rc = sim->src->next(sim->src, &sim->pending);
+        if (rc > 0) sim->has_pending = 1;
+        else if (rc < 0) sim->feed_error = 1;
+    }
+    if (!sim->has_pending) return 0;
+    *arrival_us = sim->pending.arrival_time_us;
+    return 1;
+}
+
+/* Admit the job feed_peek just reported. */
+static void feed_admit(Sim *sim, double now_us) {
+    JobTable *t = &sim->tab;
+    int j;
+
+    if (!sim->src) {
+        j = sim->arrival_order[sim->next_in++];
+    } else {
+        if (sim->admitted > 0 &&
+            sim->pending.arrival_time_us < sim->last_arrival_us) {
+            fprintf(stderr, "Job %d arrives before its predecessor: "
+                            "stream is not arrival-sorted\n",
+                    sim->pending.id);
+            sim->feed_error = 1;
+        }
+        sim->last_arrival_us = sim->pending.arrival_time_us;
+        if (t->n_free > 0) {
+            j = t->free_slots[--t->n_free];
+        } else {
+            if (t->n_slots == t->cap && table_grow(sim, 2 * t->cap) != 0) {
+                fprintf(stderr, "Out of memory growing the job table\n");
+                sim->feed_error = 1;
+                sim->has_pending = 0;
+                return;
+            }
+            j = t->n_slots++;
+            sim->sctx.n_slots = t->n_slots;
+        }
+        slot_init(sim, j, &sim->pending, sim->admitted);
+        sim->has_pending = 0;
+    }
+    if (t->dag && dag_admit(sim, j) != 0)
+        sim->feed_error = 1;
+
+    if (sim->admitted == 0) sim->first_arrival_us = t->jobs[j].arrival_time_us;
+    sim->admitted++;
+
+    switch (sim->params->admit) {
+    case ADMIT_ALL:
+        break;
+    case ADMIT_REJECT:
+        if (!admit_fits(sim, j, now_us)) {
+            admit_reject(sim, j, now_us);
+            return;
+        }
+        break;
+    case ADMIT_DEFER:
+        // behind jobs already held, so that deadlines keep their order;
+        // jobs without one have nothing to wait for
+        if ((sim->held_len > 0 && t->jobs[j].deadline_us > 0.0) ||
+            !admit_fits(sim, j, now_us)) {
+            admit_hold(sim, j);
+            return;
+        }
+        break;
+    }
+    admit_to_sched(sim, j, now_us);
+}
+
+/* Run-length fast-forward.
+ *
+ * If every engine is running the job the scheduler would pick next, and
+ * nothing but engine completions can happen before `horizon_us` (no
+ * transfer in flight, no arrival, no change in the scheduler's ordering),
+ * every completion just re-issues that job on the same engine.  Replay
+ * those chains per engine without the event queue or the scheduler.
+ *
+ * The job is kept at >= num_engines remaining bootstraps so that every
+ * completion in the window is re-issued in full and the job cannot finish
+ * inside it.  Slice ends are accumulated exactly as the per-bootstrap loop
+ * does, so the results are bit-identical. */
+static int fast_forward(const HwConfig *cfg, Engine *engines,
+                        IndexedHeap *events, Timeline *tl,
+                        const JobTable *tab,
+                        int attempt_cap, Sim *sim,
+                        double now_us, double horizon_us)
+{
+    int n_eng = cfg->num_engines;
+    JobHot *hot = tab->hot;
+    int n_slices = 0;
+    int j = sim->ops->pick_batch(sim->sched, now_us, 0, &n_slices);
+    if (j < 0 || hot[j].pcie_transferred <= 0) return 0;
+
+    for (int e = 0; e < n_eng; e++)
+        if (engines[e].job_id != j) return 0;
+
+    // re-issuing k freed engines at one instant takes ceil(k / batch) picks
+    int per_pick = cfg->batch_size < n_eng ? cfg->batch_size : n_eng;
+    if ((n_eng + per_pick - 1) / per_pick > attempt_cap) return 0;
+
+    int per_engine = (hot[j].remaining_bootstraps - n_eng) / n_eng;
+    if (per_engine <= 0) return 0;
+
+    double t_us = hot[j].bootstrap_us;
+    int done = 0;
+
+    for (int e = 0; e < n_eng; e++) {
+        Engine *eng = &engines[e];
+        int k = 0;
+        while (k < per_engine && eng->busy_until_us < horizon_us) {
+            double at = eng->busy_until_us;
+            double end = at + t_us + cfg->ctx_switch_overhead_us;
+            eng->busy_until_us = end;
+            eng->busy_us += end - at;
+            if (tl) timeline_slice(tl, e, tab->seq[j], at, end);
+            k++;
+        }
+        if (k > 0) iheap_push(events, e, eng->busy_until_us);
+        done += k;
+    }
+
+    hot[j].remaining_bootstraps -= done;
+    sim->backlog_us -= done * (t_us + cfg->ctx_switch_overhead_us);
+    return done;
+}
 
 /* ====================================================
-   ==================== SIMULATION ====================
+   ======================= PCIe =======================
    ==================================================== */
 
-SimStats run_simulation(const HwConfig *cfg,
-                        TfheJob *jobs_original,
-                        int n_jobs,
-                        SchedulerFn pick_job)
+/* Keep the PCIe event at the link's next completion or setup end. */
+static void pcie_reschedule(IndexedHeap *events, int ev_pcie, const PcieLink *link)
+{
+    double t = pcie_link_next_event(link);
+    if (t < DBL_MAX) iheap_push(events, ev_pcie, t);
+    else iheap_remove(events, ev_pcie);
+}
+
+static void ks_reschedule(IndexedHeap *events, int ev_ks, const KsPipe *ks)
 {
-    /* --------- Clone jobs --------- */
+    double t = ks_pipe_next_event(ks);
+    if (t < DBL_MAX) iheap_push(events, ev_ks, t);
+    else iheap_remove(events, ev_ks);
+}
+
+/* ====================================================
+   ============== STATELESS PICKER ADAPTER ============
+   ==================================================== */
+
+/* A SchedulerFn with no state of its own, asked for a pick over the whole
+ * table each time.  It takes whole TfheJob records, so each pick first
+ * assembles them from the slot tables; the picker walks every slot anyway.
+ * ctx->arg points at the Sim. */
+typedef struct {
+    const SchedContext *ctx;
+    const Sim *sim;
+    TfheJob *view;
+    int view_cap;
+} LegacySched;
+
+static void *legacy_init(const SchedContext *ctx) {
+    LegacySched *l = calloc(1, sizeof(LegacySched));
+    if (!l) return NULL;
+    l->ctx = ctx;
+    l->sim = ctx->arg;
+    return l;
+}
+
+static void legacy_destroy(void *state) {
+    LegacySched *l = state;
+    free(l->view);
+    free(l);
+}
+
+static void legacy_arrival(void *state, int slot, long long seq, double now_us) {
+    (void)state;
+    (void)slot;
+    (void)seq;
+    (void)now_us;
+}
+
+static int legacy_pick(void *state, double now_us, int idle_engines, int *n_slices) {
+    LegacySched *l = state;
+    const SchedContext *ctx = l->ctx;
+    (void)idle_engines;
+    (void)n_slices;
+    if (ctx->counters) ctx->counters->examined += ctx->n_slots;
+
+    if (ctx->n_slots > l->view_cap) {
+        TfheJob *view = realloc(l->view, ctx->cap * sizeof(TfheJob));
+        if (!view) return -1;
+        l->view = view;
+        l->view_cap = ctx->cap;
+    }
+    // jobs waiting for their keys, or without them past the upload cap,
+    // look finished, so the picker passes them over
+    for (int j = 0; j < ctx->n_slots; j++) {
+        l->view[j] = slot_job(&l->sim->tab, j);
+        if (l->view[j].pcie_transferred < 0 || l->sim->tab.hot[j].blocked ||
+            (ctx->uploads == SCHED_UPLOADS_CLOSED && !l->view[j].pcie_transferred) ||
+            (ctx->uploads == SCHED_UPLOADS_ONLY && l->view[j].pcie_transferred) ||
+            (l->sim->tab.admit && l->sim->tab.admit[j] == SLOT_HELD))
+            l->view[j].remaining_bootstraps = 0;
+    }
+    return l->sim->legacy_fn(ctx->cfg, l->view, ctx->n_slots, now_us);
+}
+
+static const SchedulerOps legacy_ops = {
+    .abi = SCHED_PLUGIN_ABI,
+    .name = "sim",
+    .init = legacy_init,
+    .destroy = legacy_destroy,
+    .on_arrival = legacy_arrival,
+    .pick_batch = legacy_pick
+};
+
+/* ====================================================
+   ===================== SNAPSHOTS ====================
+   ==================================================== */
 
-    TfheJob *jobs = malloc(n_jobs * sizeof(TfheJob));
+#define SIM_SNAPSHOT_MAGIC   "TFHESNP"
+#define SIM_SNAPSHOT_VERSION 1
+
+/* File layout: this header, then per slot JobHot, JobTimes, refs,
+ * key_entry and key_waiter, the key_waiters lists, the engines and their
+ * key-stream flags, the PCIe link and, with a key cache, the cache.  All
+ * in host byte order; a snapshot is read by the build that wrote it. */
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t n_jobs;
+    uint64_t trace_hash;
+    int32_t num_engines;
+    int32_t key_cache;          // 0 = off
+    int32_t key_sharing;
+    int32_t key_waiters_cap;
+    double at_us;
+    double now_us;
+    double first_arrival_us;
+    double pcie_mb_moved;
+    int64_t next_in;
+    int64_t admitted;
+    int64_t finished;
+    int64_t dispatched;
+    int64_t n_events;
+    int64_t n_picks;
+} SnapshotHeader;
+
+struct SimSnapshot {
+    SnapshotHeader hdr;
+    char *data;                 // the whole file
+    size_t len;
+};
+
+/* FNV-1a over the fields that decide how a trace runs. */
+static uint64_t trace_hash(const TfheJob *jobs, int n_jobs) {
+    uint64_t h = 1469598103934665603ULL;
     for (int i = 0; i < n_jobs; i++) {
-        jobs[i] = jobs_original[i];
+        const TfheJob *job = &jobs[i];
+        const void *fields[] = { &job->id, &job->tenant_id, &job->num_bootstraps,
+                                 &job->key_id, &job->arrival_time_us,
+                                 &job->key_size_mb, &job->deadline_us };
+        const size_t sizes[] = { sizeof(int), sizeof(int), sizeof(int), sizeof(int),
+                                 sizeof(double), sizeof(double), sizeof(double) };
+        for (int f = 0; f < 7; f++) {
+            const unsigned char *b = fields[f];
+            for (size_t k = 0; k < sizes[f]; k++) {
+                h ^= b[k];
+                h *= 1099511628211ULL;
+            }
+        }
+    }
+    return h;
+}
 
-        // initialize PCIe transfer state
-        if (cfg->pcie_bandwidth_gbps <= 0.0) jobs[i].pcie_transferred = 1;
-        else jobs[i].pcie_transferred = 0;
+SimSnapshot *sim_snapshot_load(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror("fopen snapshot");
+        return NULL;
+    }
+    SimSnapshot *s = calloc(1, sizeof(SimSnapshot));
+    long len = -1;
+    if (s && fseek(f, 0, SEEK_END) == 0 && (len = ftell(f)) >= 0 &&
+        fseek(f, 0, SEEK_SET) == 0 && (s->data = malloc(len > 0 ? len : 1)) &&
+        fread(s->data, 1, len, f) == (size_t)len) {
+        s->len = len;
+    } else {
+        fprintf(stderr, "Cannot read snapshot %s\n", path);
+        sim_snapshot_free(s);
+        fclose(f);
+        return NULL;
+    }
+    fclose(f);
+
+    if (s->len < sizeof(SnapshotHeader) ||
+        memcmp(s->data, SIM_SNAPSHOT_MAGIC, sizeof(SIM_SNAPSHOT_MAGIC)) != 0) {
+        fprintf(stderr, "%s is not a snapshot\n", path);
+        sim_snapshot_free(s);
+        return NULL;
+    }
+    memcpy(&s->hdr, s->data, sizeof(SnapshotHeader));
+    if (s->hdr.version != SIM_SNAPSHOT_VERSION ||
+        s->hdr.header_size != sizeof(SnapshotHeader)) {
+        fprintf(stderr, "Snapshot %s is from another version\n", path);
+        sim_snapshot_free(s);
+        return NULL;
+    }
+    return s;
+}
+
+void sim_snapshot_free(SimSnapshot *s) {
+    if (!s) return;
+    free(s->data);
+    free(s);
+}
+
+double sim_snapshot_time(const SimSnapshot *s) {
+    return s->hdr.at_us;
+}
+
+int sim_snapshot_check(const SimSnapshot *s, const HwConfig *cfg,
+                       const TfheJob *jobs, int n_jobs,
+                       const SimParams *params)
+{
+    const SnapshotHeader *h = &s->hdr;
+    if (h->n_jobs != (uint64_t)n_jobs || h->trace_hash != trace_hash(jobs, n_jobs)) {
+        fprintf(stderr, "Snapshot was taken on another trace\n");
+        return -1;
+    }
+    if (h->num_engines != cfg->num_engines) {
+        fprintf(stderr, "Snapshot has %d engines, the hardware %d\n",
+                h->num_engines, cfg->num_engines);
+        return -1;
+    }
+    if (h->key_cache != params->key_cache ||
+        (h->key_cache && h->key_sharing != (int32_t)params->key_sharing)) {
+        fprintf(stderr, "Snapshot was taken with another key cache setup\n");
+        return -1;
+    }
+    if (params->sync) {
+        fprintf(stderr, "Cluster devices cannot start from a snapshot\n");
+        return -1;
+    }
+    if (params->dags) {
+        fprintf(stderr, "Snapshots do not cover bootstrap graphs\n");
+        return -1;
+    }
+    if (cfg->ks_units > 0) {
+        fprintf(stderr, "Snapshots do not cover key-switch units\n");
+        return -1;
+    }
+    if (params->admit != ADMIT_ALL) {
+        fprintf(stderr, "Snapshots do not cover admission control\n");
+        return -1;
+    }
+    return 0;
+}
+
+static int put(FILE *f, const void *p, size_t size, size_t n) {
+    return n == 0 || fwrite(p, size, n, f) == n ? 0 : -1;
+}
+
+static int get(FILE *f, void *p, size_t size, size_t n) {
+    return n == 0 || fread(p, size, n, f) == n ? 0 : -1;
+}
+
+static int snapshot_write(Sim *sim, const Engine *engines,
+                          const unsigned char *key_stream,
+                          double now_us, long long n_events, long long n_picks)
+{
+    const JobTable *t = &sim->tab;
+    const HwConfig *cfg = sim->cfg;
+    int n = sim->n_in;
+
+    FILE *f = fopen(sim->snap_path, "wb");
+    if (!f) {
+        perror("fopen snapshot");
+        return -1;
+    }
+
+    SnapshotHeader h = {
+        .version = SIM_SNAPSHOT_VERSION,
+        .header_size = sizeof(SnapshotHeader),
+        .n_jobs = n,
+        .trace_hash = trace_hash(sim->in_jobs, n),
+        .num_engines = cfg->num_engines,
+        .key_cache = sim->kc != NULL,
+        .key_sharing = sim->params->key_sharing,
+        .key_waiters_cap = sim->key_waiters_cap,
+        .at_us = sim->snap_at_us,
+        .now_us = now_us,
+        .first_arrival_us = sim->first_arrival_us,
+        .pcie_mb_moved = sim->pcie_mb_moved,
+        .next_in = sim->next_in,
+        .admitted = sim->admitted,
+        .finished = sim->finished,
+        .dispatched = sim->dispatched,
+        .n_events = n_events,
+        .n_picks = n_picks
+    };
+    memcpy(h.magic, SIM_SNAPSHOT_MAGIC, sizeof(SIM_SNAPSHOT_MAGIC));
+
+    unsigned char *streams = calloc(cfg->num_engines, 1);
+    if (streams && key_stream) memcpy(streams, key_stream, cfg->num_engines);
+
+    int rc = streams ? 0 : -1;
+    if (rc == 0)
+        rc = put(f, &h, sizeof(h), 1) |
+             put(f, t->hot, sizeof(JobHot), n) |
+             put(f, t->times, sizeof(JobTimes), n) |
+             put(f, t->refs, sizeof(int), n) |
+             put(f, t->key_entry, sizeof(int), n) |
+             put(f, t->key_waiter, sizeof(int), n) |
+             put(f, sim->key_waiters, sizeof(int), sim->key_waiters_cap) |
+             put(f, engines, sizeof(Engine), cfg->num_engines) |
+             put(f, streams, 1, cfg->num_engines) |
+             pcie_link_save(sim->link, f);
+    if (rc == 0 && sim->kc)
+        rc = key_cache_save(sim->kc, f);
+    free(streams);
+    if (fclose(f) != 0) rc = -1;
+
+    if (rc != 0)
+        fprintf(stderr, "Cannot write snapshot %s\n", sim->snap_path);
+    return rc;
+}
+
+/* Load params->restore into a run whose table, cache and link are set up
+ * but empty.  Also returns the loop's clock and counters. */
+static int snapshot_restore(Sim *sim, Engine *engines, unsigned char *key_stream,
+                            int *hbm_streams, double *now_us,
+                            long long *n_events, long long *n_picks)
+{
+    const SimSnapshot *s = sim->params->restore;
+    const SnapshotHeader *h = &s->hdr;
+    JobTable *t = &sim->tab;
+    const HwConfig *cfg = sim->cfg;
+    int n = sim->n_in;
+
+    if (sim->src) {
+        fprintf(stderr, "Snapshots need the whole trace loaded; drop --stream\n");
+        return -1;
+    }
+    if (sim_snapshot_check(s, cfg, sim->in_jobs, n, sim->params) != 0)
+        return -1;
+
+    FILE *f = fmemopen(s->data, s->len, "rb");
+    if (!f) return -1;
+
+    sim->key_waiters_cap = h->key_waiters_cap;
+    sim->key_waiters = malloc((h->key_waiters_cap > 0 ? h->key_waiters_cap : 1) * sizeof(int));
+    unsigned char *streams = calloc(cfg->num_engines, 1);
+
+    int rc = sim->key_waiters && streams ? 0 : -1;
+    if (rc == 0)
+        rc = fseek(f, h->header_size, SEEK_SET) |
+             get(f, t->hot, sizeof(JobHot), n) |
+             get(f, t->times, sizeof(JobTimes), n) |
+             get(f, t->refs, sizeof(int), n) |
+             get(f, t->key_entry, sizeof(int), n) |
+             get(f, t->key_waiter, sizeof(int), n) |
+             get(f, sim->key_waiters, sizeof(int), h->key_waiters_cap) |
+             get(f, engines, sizeof(Engine), cfg->num_engines) |
+             get(f, streams, 1, cfg->num_engines) |
+             pcie_link_load(sim->link, f);
+    if (rc == 0 && sim->kc)
+        rc = key_cache_load(sim->kc, f);
+    fclose(f);
+
+    if (rc != 0) {
+        fprintf(stderr, "Snapshot is damaged\n");
+        free(streams);
+        return -1;
+    }
+
+    // the fork may run another cost model
+    for (int j = 0; j < n; j++)
+        t->hot[j].bootstrap_us = slot_bootstrap_us(sim, &t->jobs[j]);
+    if (key_stream) {
+        memcpy(key_stream, streams, cfg->num_engines);
+        for (int e = 0; e < cfg->num_engines; e++)
+            *hbm_streams += streams[e];
+    }
+    free(streams);
+
+    sim->next_in = h->next_in;
+    sim->admitted = h->admitted;
+    sim->finished = h->finished;
+    sim->first_arrival_us = h->first_arrival_us;
+    sim->dispatched = h->dispatched;
+    sim->pcie_mb_moved = h->pcie_mb_moved;
+    for (int j = 0; j < n; j++)
+        sim->uploads.in_flight += t->hot[j].staged;
+    *now_us = h->now_us;
+    *n_events = h->n_events;
+    *n_picks = h->n_picks;
+    return 0;
+}
+
+/* Tell the restored policy about the jobs admitted before the snapshot. */
+static void snapshot_replay(Sim *sim, double now_us) {
+    JobTable *t = &sim->tab;
+    const SchedulerOps *ops = sim->ops;
+
+    for (int i = 0; i < sim->next_in; i++) {
+        int j = sim->arrival_order[i];
+        if (t->arrived) {
+            t->arrived[j] = 1;
+            if (!t->hot[j].started) pf_ring_push(sim, j);
+        }
+        if (t->hot[j].remaining_bootstraps <= 0) continue;
+
+        ops->on_arrival(sim->sched, j, t->seq[j], now_us);
+        if (ops->on_transfer_done && t->hot[j].pcie_transferred == 1)
+            ops->on_transfer_done(sim->sched, j, now_us);
     }
+}
 
-    /* --------- PCIe transfer tracking --------- */
+/* ====================================================
+   ==================== SIMULATION ====================
+   ==================================================== */
+
+/* The event loop.  `sim` comes in with its job table, arrival feed and
+ * policy set up; everything else a run needs is created and torn down
+ * here.  Returns -1 if the policy could not be started. */
+static int simulate(Sim *sim, SimStats *out)
+{
+    const HwConfig *cfg = sim->cfg;
+    const SimParams *params = sim->params;
+    JobTable *tab = &sim->tab;
+    const SchedulerOps *ops = sim->ops;
+
+    /* --------- Scheduler policy --------- */
+
+    SimCounters *ic = params->counters;
+    if (ic) memset(ic, 0, sizeof(*ic));
+
+    sim->sctx.cfg = cfg;
+    sim->sctx.weights = &params->weights;
+    sim->sctx.jobs = tab->jobs;
+    sim->sctx.hot = tab->hot;
+    sim->sctx.n_slots = tab->n_slots;
+    sim->sctx.cap = tab->cap;
+    sim->sctx.arg = ops == &legacy_ops ? (const void *)sim : params->sched_arg;
+    sim->sctx.counters = ic ? &ic->sched : NULL;
+    sim->sched = ops->init(&sim->sctx);
+    if (!sim->sched) {
+        fprintf(stderr, "Scheduler %s failed to start\n", ops->name);
+        memset(out, 0, sizeof(*out));
+        return -1;
+    }
+
+    /* --------- Resident-key cache --------- */
+
+    if (params->key_cache)
+        sim->kc = key_cache_create(cfg->key_mem_mb, params->key_policy);
+    KeyCache *kc = sim->kc;
+
+    /* --------- PCIe link --------- */
+
+    sim->link = pcie_link_create(pcie_bits_per_us(cfg, params),
+                                 params->pcie_dma_depth, params->pcie_setup_us);
+    PcieLink *link = sim->link;
+    if (!link || pcie_link_reserve(link, tab->cap) != 0) {
+        fprintf(stderr, "Out of memory setting up the PCIe link\n");
+        pcie_link_destroy(link);
+        sim->link = NULL;
+        key_cache_destroy(kc);
+        sim->kc = NULL;
+        ops->destroy(sim->sched);
+        sim->sched = NULL;
+        memset(out, 0, sizeof(*out));
+        return -1;
+    }
 
-    Transfer *transfers = malloc(n_jobs * sizeof(Transfer));
-    for (int t = 0; t < n_jobs; t++) {
-        transfers[t].job_id = -1;
-        transfers[t].remaining_bits = 0.0;
+    /* --------- Key-switch units --------- */
+
+    KsPipe *ks = NULL;
+    if (cfg->ks_units > 0) {
+        ks = ks_pipe_create(cfg->ks_units, cfg->ks_latency_us, cfg->ks_depth,
+                            cfg->ks_queue);
+        if (!ks) {
+            fprintf(stderr, "Out of memory setting up the key-switch units\n");
+            pcie_link_destroy(link);
+            sim->link = NULL;
+            key_cache_destroy(kc);
+            sim->kc = NULL;
+            ops->destroy(sim->sched);
+            sim->sched = NULL;
+            memset(out, 0, sizeof(*out));
+            return -1;
+        }
     }
 
-    /* --------- Allocate engines + NEW LOGGING --------- */
+    /* --------- Allocate engines --------- */
 
     Engine *engines = malloc(cfg->num_engines * sizeof(Engine));
     for (int e = 0; e < cfg->num_engines; e++) {
         engines[e].job_id = -1;
         engines[e].busy_until_us = 0.0;
+        engines[e].busy_us = 0.0;
+    }
 
-        // NEW: initialize engine-level logs
-        engines[e].log_len = 0;
-        engines[e].log_cap = 1024;
-        engines[e].log = malloc(sizeof(EngineLogEntry) * engines[e].log_cap);
+    // roofline: the engine of each batch that streams its key from HBM
+    unsigned char *key_stream = NULL;
+    int hbm_streams = 0;
+    if (params->cost_model == HW_COST_ROOFLINE)
+        key_stream = calloc(cfg->num_engines, sizeof(unsigned char));
+
+    // bootstrap graphs: the graph node each engine is running, -1 = none
+    int *eng_node = NULL;
+    if (tab->dag) {
+        eng_node = malloc(cfg->num_engines * sizeof(int));
+        for (int e = 0; e < cfg->num_engines; e++) eng_node[e] = -1;
     }
 
-    double now_us = 0.0;
-    double total_engine_busy_us = 0.0;
-    int jobs_finished = 0;
+    // key-switch units: engines holding a finished bootstrap the full
+    // queue would not take, in the order they finished
+    KsOp *held = NULL;
+    double *stall_since = NULL;
+    int *stalled = NULL;
+    int st_head = 0, st_len = 0;
+    double stall_us = 0.0;
+    if (ks) {
+        held = malloc(cfg->num_engines * sizeof(KsOp));
+        stall_since = malloc(cfg->num_engines * sizeof(double));
+        stalled = malloc(cfg->num_engines * sizeof(int));
+    }
 
-    int log_picks = getenv("HPS_LOG_PICKS") != NULL;
-    const char *sched_label = "scheduler";
-    if (log_picks) {
-        if (pick_job == pick_job_hps) sched_label = "HPS";
-        else if (pick_job == pick_job_fifo) sched_label = "FIFO";
+    /* --------- Warm state from a snapshot --------- */
+
+    double start_us = 0.0;
+    long long start_events = 0, start_picks = 0;
+    if (params->restore &&
+        snapshot_restore(sim, engines, key_stream, &hbm_streams,
+                         &start_us, &start_events, &start_picks) != 0) {
+        free(engines);
+        free(key_stream);
+        free(eng_node);
+        free(held);
+        free(stall_since);
+        free(stalled);
+        ks_pipe_destroy(ks);
+        free(sim->key_waiters);
+        sim->key_waiters = NULL;
+        pcie_link_destroy(link);
+        sim->link = NULL;
+        key_cache_destroy(kc);
+        sim->kc = NULL;
+        ops->destroy(sim->sched);
+        sim->sched = NULL;
+        memset(out, 0, sizeof(*out));
+        return -1;
     }
 
-    /* ====================================================
-       ==================== MAIN LOOP ====================
-       ==================================================== */
+    /* --------- Job CSV and engine timeline, written as we go --------- */
 
-    while (jobs_finished < n_jobs) {
+    Timeline *tl = NULL;
+    char *job_csv_buf = NULL;
 
-        double next_event = DBL_MAX;
+    if (params->csv_prefix) {
+        const char *label = ops->name;
 
-        /* ---- Next engine completion ---- */
-        for (int e = 0; e < cfg->num_engines; e++) {
-            if (engines[e].job_id >= 0 && engines[e].busy_until_us > now_us) {
-                if (engines[e].busy_until_us < next_event)
-                    next_event = engines[e].busy_until_us;
-            }
+        const char *dir = params->out_dir ? params->out_dir : SIM_DEFAULT_OUT_DIR;
+        mkdir(dir, 0755);
+
+        char path_jobs[512];
+        snprintf(path_jobs, sizeof(path_jobs),
+                 "%s/%s-%s.csv", dir, params->csv_prefix, label);
+
+        sim->job_csv = fopen(path_jobs, "w");
+        if (sim->job_csv) {
+            job_csv_buf = malloc(1 << 20);
+            if (job_csv_buf) setvbuf(sim->job_csv, job_csv_buf, _IOFBF, 1 << 20);
+            fprintf(sim->job_csv, "job_id,tenant_id,arrival_us,start_us,completion_us,"
+                                  "num_bootstraps,key_size_mb,pcie_transferred\n");
         }
 
-        /* ---- Next job arrival ---- */
-        for (int j = 0; j < n_jobs; j++) {
-            if (jobs[j].arrival_time_us > now_us &&
-                jobs[j].arrival_time_us < next_event)
-                next_event = jobs[j].arrival_time_us;
+        char path_eng[512];
+        snprintf(path_eng, sizeof(path_eng), "%s/%s-%s-%s", dir,
+                 params->csv_prefix, label,
+                 timeline_suffix(params->timeline_format));
+        tl = timeline_open(path_eng, params->timeline_format,
+                           cfg->num_engines, params->timeline_merge_us);
+    }
+
+    /* --------- Event queue --------- */
+
+    // ids [0, num_engines) are engine completions, then one slot each for
+    // the next arrival, PCIe completion and key-switch start or finish
+    const int ev_arrival = cfg->num_engines;
+    const int ev_pcie = cfg->num_engines + 1;
+    const int ev_ks = cfg->num_engines + 2;
+
+    IndexedHeap events;
+    iheap_init(&events, cfg->num_engines + 3, 0);
+
+    double now_us = start_us;
+    double next_arrival_us;
+    int busy_eng = 0;
+    long long n_events = start_events;
+    long long n_picks = start_picks;
+
+    if (params->restore) {
+        for (int e = 0; e < cfg->num_engines; e++) {
+            if (engines[e].job_id < 0) continue;
+            iheap_push(&events, e, engines[e].busy_until_us);
+            busy_eng++;
         }
+        pcie_reschedule(&events, ev_pcie, link);
+        snapshot_replay(sim, now_us);
+    }
 
-        /* ---- Next PCIe transfer completion ---- */
-        int active_transfers = 0;
-        for (int t = 0; t < n_jobs; t++)
-            if (transfers[t].job_id >= 0) active_transfers++;
-
-        if (active_transfers > 0 && cfg->pcie_bandwidth_gbps > 0.0) {
-            double eff_pcie_gbps = cfg->pcie_bandwidth_gbps * g_pcie_scale;
-            double bits_per_us = (eff_pcie_gbps * 1e3) / (double)active_transfers;
-            for (int t = 0; t < n_jobs; t++) {
-                if (transfers[t].job_id >= 0) {
-                    double finish_time =
-                        now_us + transfers[t].remaining_bits / bits_per_us;
-                    if (finish_time < next_event)
-                        next_event = finish_time;
-                }
+    /* --------- Instrumentation (opt-in) --------- */
+
+    double *idle_since = NULL;      // per engine, while it has no slice
+    uint64_t mark = 0, pick_ticks = 0;
+    struct timespec wall0;
+    if (ic) {
+        idle_since = calloc(cfg->num_engines, sizeof(double));
+        clock_gettime(CLOCK_MONOTONIC, &wall0);
+        mark = instr_ticks();
+        ic->total_ticks = mark;
+    }
+
+    while (feed_peek(sim, &next_arrival_us) && next_arrival_us <= now_us)
+        feed_admit(sim, now_us);
+    if (feed_peek(sim, &next_arrival_us))
+        iheap_push(&events, ev_arrival, next_arrival_us);
+    if (sim->held_len > 0) admit_held(sim, now_us);
+
+    JobHot *hot = tab->hot;
+    JobTimes *times = tab->times;
+    int *key_entry = tab->key_entry;
+    int *key_waiter = tab->key_waiter;
+
+    int log_picks = getenv("HPS_LOG_PICKS") != NULL;
+    SimSync *sync = params->sync;
+
+    // slowdowns of finished jobs, for the early-stop callback
+    Histogram *done_slowdown = params->stop ? calloc(1, sizeof(Histogram)) : NULL;
+    long long next_stop_check = SIM_STOP_CHECK;
+
+    /* ====================================================
+       ==================== MAIN LOOP ====================
+       ==================================================== */
+
+    for (;;) {
+
+        /* ---- Cluster window boundary ---- */
+        // a device in a cluster stops at the end of each window until the
+        // coordinator has dispatched the next window's jobs
+        int top;
+        while (sync && !sync->closed &&
+               ((top = iheap_top(&events)) < 0 ||
+                events.key[top] >= sync->window_end_us)) {
+            // PCIe progress up to the boundary runs at this window's rate
+            if (pcie_link_pending(link) > 0 && cfg->pcie_bandwidth_gbps > 0.0 &&
+                sync->window_end_us > now_us) {
+                pcie_link_advance(link, sync->window_end_us);
+                now_us = sync->window_end_us;
             }
+
+            SimDeviceState st = {
+                .now_us = now_us,
+                .next_event_us = top >= 0 ? events.key[top] : DBL_MAX,
+                .active_transfers = pcie_link_pending(link),
+                .in_flight = sim->admitted - sim->finished + sim->has_pending
+            };
+            sync->wait(sync, &st);
+
+            // new jobs may have been queued and the link rate changed
+            if (feed_peek(sim, &next_arrival_us))
+                iheap_push(&events, ev_arrival, next_arrival_us);
+            pcie_link_set_rate(link, now_us, pcie_bits_per_us(cfg, params));
+            pcie_reschedule(&events, ev_pcie, link);
         }
 
-        if (next_event == DBL_MAX)
+        // a cluster device may still be sent jobs until the run is closed
+        if (!feed_peek(sim, &next_arrival_us) && sim->finished >= sim->admitted &&
+            (!sync || sync->closed))
             break;
 
-        double delta = next_event - now_us;
-
-        /* ---- Account engine busy time ---- */
-        int busy_eng = 0;
-        for (int e = 0; e < cfg->num_engines; e++)
-            if (engines[e].job_id >= 0) busy_eng++;
+        /* ---- Next event: engine completion, arrival or PCIe ---- */
+        int ev = iheap_top(&events);
+        if (ev < 0)
+            break;
 
-        total_engine_busy_us += delta * busy_eng;
+        double next_event = events.key[ev];
+        if (sim->snap_path && next_event > sim->snap_at_us) {
+            sim->snap_rc = snapshot_write(sim, engines, key_stream,
+                                          now_us, n_events, n_picks);
+            break;
+        }
         now_us = next_event;
+        n_events++;
+        if (ic) instr_phase(ic, SIM_PHASE_EVENT_SEARCH, &mark);
 
         /* ---- Update PCIe transfers ---- */
-        if (active_transfers > 0 && cfg->pcie_bandwidth_gbps > 0.0) {
-            double eff_pcie_gbps = cfg->pcie_bandwidth_gbps * g_pcie_scale;
-            double bits_per_us = (eff_pcie_gbps * 1e3) / (double)active_transfers;
-            double bits_dec = delta * bits_per_us;
-
-            for (int t = 0; t < n_jobs; t++) {
-                if (transfers[t].job_id >= 0) {
-                    transfers[t].remaining_bits -= bits_dec;
-                    if (transfers[t].remaining_bits < 1e-6)
-                        transfers[t].remaining_bits = 0.0;
+        pcie_link_advance(link, now_us);
+
+        /* ---- Handle PCIe completions ---- */
+        iheap_remove(&events, ev_pcie);
+        for (int j; (j = pcie_link_pop_done(link)) >= 0; ) {
+            hot[j].pcie_transferred = 1;
+            unstage(sim, j);
+            if (ic) ic->pcie_completions++;
+            if (tab->pf_start && tab->pf_start[j] >= 0.0 && tab->pf_done[j] < 0.0) {
+                tab->pf_done[j] = now_us;
+                sim->pf_inflight_mb -= upload_mb(sim, j);
+            }
+
+            if (log_picks)
+                printf("[PCIe] done %.0f us -> job %lld\n", now_us, tab->seq[j]);
+
+            // the upload filled this cache entry (-1 when uncached)
+            // prefetched jobs may not have arrived yet
+            int ent = key_entry[j];
+            if (ops->on_transfer_done && (!tab->arrived || tab->arrived[j]))
+                ops->on_transfer_done(sim->sched, j, now_us);
+
+            if (ent >= 0) {
+                key_cache_loaded(kc, ent);
+                for (int w = sim->key_waiters[ent]; w >= 0; ) {
+                    int next = key_waiter[w];
+                    hot[w].pcie_transferred = 1;
+                    unstage(sim, w);
+                    if (ops->on_transfer_done && (!tab->arrived || tab->arrived[w]))
+                        ops->on_transfer_done(sim->sched, w, now_us);
+                    slot_unref(sim, w);
+                    w = next;
                 }
+                sim->key_waiters[ent] = -1;
             }
+            slot_unref(sim, j);
         }
 
-        /* ---- Handle PCIe completions ---- */
-        for (int t = 0; t < n_jobs; t++) {
-            if (transfers[t].job_id >= 0 &&
-                transfers[t].remaining_bits <= 0.0)
-            {
-                int j = transfers[t].job_id;
-                jobs[j].pcie_transferred = 1;
-
-                if (log_picks)
-                    printf("[PCIe] done %.0f us -> job %d\n", now_us, j);
+        if (ic) instr_phase(ic, SIM_PHASE_TRANSFERS, &mark);
+
+        /* ---- Handle arrivals ---- */
+        long long admitted_before = sim->admitted;
+        while (feed_peek(sim, &next_arrival_us) && next_arrival_us <= now_us)
+            feed_admit(sim, now_us);
+        if (feed_peek(sim, &next_arrival_us))
+            iheap_push(&events, ev_arrival, next_arrival_us);
+        else
+            iheap_remove(&events, ev_arrival);
+        if (ic) {
+            ic->arrivals += sim->admitted - admitted_before;
+            instr_phase(ic, SIM_PHASE_ARRIVALS, &mark);
+        }
 
-                transfers[t].job_id = -1;
+        // admissions may have grown the table
+        hot = tab->hot;
+        times = tab->times;
+        key_entry = tab->key_entry;
+        key_waiter = tab->key_waiter;
+
+        /* ---- Handle key-switch completions ---- */
+        if (ks) {
+            ks_pipe_advance(ks, now_us);
+            iheap_remove(&events, ev_ks);
+            for (KsOp op; ks_pipe_pop_done(ks, &op); )
+                bootstrap_done(sim, op.job, op.node, op.engine, now_us,
+                               done_slowdown);
+
+            // room in the queue goes to the engines stalled longest
+            while (st_len > 0 && ks_pipe_offer(ks, held[stalled[st_head]], now_us)) {
+                int e = stalled[st_head];
+                st_head = (st_head + 1) % cfg->num_engines;
+                st_len--;
+                stall_us += now_us - stall_since[e];
+                engines[e].job_id = -1;
+                busy_eng--;
+                if (ic) idle_since[e] = now_us;
             }
         }
 
         /* ---- Handle engine completions ---- */
-        for (int e = 0; e < cfg->num_engines; e++) {
-            if (engines[e].job_id >= 0 &&
-                engines[e].busy_until_us <= now_us) {
-
-                int j = engines[e].job_id;
-                jobs[j].remaining_bootstraps--;
-
-                if (jobs[j].remaining_bootstraps == 0) {
-                    jobs[j].completion_time_us = now_us;
-                    jobs_finished++;
+        while ((ev = iheap_top(&events)) >= 0 && ev < cfg->num_engines &&
+               events.key[ev] <= now_us) {
+            iheap_pop(&events);
+
+            int j = engines[ev].job_id;
+            int node = -1;
+            if (eng_node) {
+                node = eng_node[ev];
+                eng_node[ev] = -1;
+            }
+            if (key_stream && key_stream[ev]) {
+                key_stream[ev] = 0;
+                hbm_streams--;
+            }
+            if (ic) ic->engine_completions++;
+
+            if (ks) {
+                // the bootstrap goes on to a key-switch unit, or the engine
+                // holds it until the queue has room
+                held[ev] = (KsOp){ j, node, ev };
+                tab->ks_held[j]++;
+                ks_refresh(tab, j);
+                if (st_len > 0 || !ks_pipe_offer(ks, held[ev], now_us)) {
+                    stalled[(st_head + st_len++) % cfg->num_engines] = ev;
+                    stall_since[ev] = now_us;
+                    continue;
                 }
-                engines[e].job_id = -1;
             }
+
+            engines[ev].job_id = -1;
+            busy_eng--;
+            if (ic) idle_since[ev] = now_us;
+            if (!ks) bootstrap_done(sim, j, node, ev, now_us, done_slowdown);
+        }
+        if (ic) instr_phase(ic, SIM_PHASE_COMPLETIONS, &mark);
+
+        /* ---- Early stop ---- */
+        if (params->stop && sim->finished >= next_stop_check) {
+            next_stop_check = sim->finished + SIM_STOP_CHECK;
+            SimProgress pr = {
+                .now_us = now_us,
+                .first_arrival_us = sim->first_arrival_us,
+                .finished = sim->finished,
+                .n_jobs = sim->src ? 0 : sim->n_in,
+                .slowdown = done_slowdown
+            };
+            if (params->stop(params->stop_ctx, &pr)) break;
         }
 
-        /* ---- Assign work (batching) ---- */
-        int idle = 0;
-        for (int e = 0; e < cfg->num_engines; e++)
-            if (engines[e].job_id < 0) idle++;
+        /* ---- Release deferred jobs ---- */
+        if (sim->held_len > 0) admit_held(sim, now_us);
 
+        /* ---- Assign work (batching) ---- */
+        int idle = cfg->num_engines - busy_eng;
         int attempts = 0;
+        int attempt_cap = sim->src ? (int)(sim->admitted + cfg->num_engines)
+                                   : sim->n_in;
 
+        upload_cap_begin(&sim->uploads, &sim->sctx, cfg->num_engines);
         while (idle > 0) {
-            if (attempts++ >= n_jobs)
+            if (attempts++ >= attempt_cap)
                 break;
 
-            int j = pick_job(cfg, jobs, n_jobs, now_us);
-            if (j < 0) break;
-
-            if (!jobs[j].started) {
-                jobs[j].started = 1;
-                jobs[j].start_time_us = now_us;
+            uint64_t pick_start = ic ? instr_ticks() : 0;
+            int n_slices = 0;
+            int j = ops->pick_batch(sim->sched, now_us, idle, &n_slices);
+            if (ic) {
+                pick_ticks += instr_ticks() - pick_start;
+                ic->sched_calls++;
+                if (j < 0) ic->sched_empty++;
+                else if (hot[j].pcie_transferred < 0 || hot[j].blocked)
+                    ic->wasted_picks++;
+            }
+            if (j < 0) {
+                // no job with keys for the idle engines: they can wait on
+                // uploads instead (uploads.h)
+                if (upload_cap_spare(&sim->uploads, &sim->sctx, idle)) continue;
+                break;
             }
+            n_picks++;
 
             /* ---- PCIe required? ---- */
-            if (!jobs[j].pcie_transferred) {
-                int found = 0;
-                for (int t = 0; t < n_jobs; t++)
-                    if (transfers[t].job_id == j)
-                        found = 1;
-
-                if (!found) {
-                    for (int t = 0; t < n_jobs; t++) {
-                        if (transfers[t].job_id < 0) {
-                            double mb = jobs[j].key_size_mb;
-                            if (g_pcie_cap_mb > 0.0 && mb > g_pcie_cap_mb)
-                                mb = g_pcie_cap_mb;
-
-                            transfers[t].job_id = j;
-                            transfers[t].remaining_bits = mb * 8.0 * 1e6;
-                            jobs[j].pcie_transferred = -1;
-                            break;
-                        }
-                    }
+            // jobs waiting for their keys, for bootstraps of their graph or
+            // for their key-switches get no engines; the policy should have
+            // passed such a job over, so it has nothing better right now
+            if (hot[j].pcie_transferred < 0 || hot[j].blocked)
+                break;
+            if (!hot[j].pcie_transferred) {
+                // past the upload cap the policy should have passed it over
+                // too, unless the cache has its keys
+                if (sim->sctx.uploads != SCHED_UPLOADS_OPEN && !keys_resident(sim, j))
+                    break;
+                if (fetch_keys(sim, j, now_us) > 0.0) {
+                    hot[j].staged = 1;
+                    upload_cap_started(&sim->uploads, &sim->sctx);
                 }
-                continue;
+                if (hot[j].pcie_transferred < 0)
+                    continue;
             }
 
-            int batch = cfg->batch_size;
-            if (batch > jobs[j].remaining_bootstraps)
-                batch = jobs[j].remaining_bootstraps;
+            if (!hot[j].started) {
+                hot[j].started = 1;
+                times[j].start_us = now_us;
+                if (tab->pf_start) prefetch_dispatched(sim, j);
+                sim->dispatched++;
+            }
+
+            int batch = n_slices > 0 ? n_slices : cfg->batch_size;
+            if (batch > hot[j].remaining_bootstraps)
+                batch = hot[j].remaining_bootstraps;
+            if (tab->ks_held && batch > hot[j].remaining_bootstraps - tab->ks_held[j])
+                batch = hot[j].remaining_bootstraps - tab->ks_held[j];
             if (batch > idle)
                 batch = idle;
-
-            double t_us = bootstrap_time_us(cfg, &jobs[j]);
+            DagRun *dag = tab->dag && tab->dag[j].dag ? &tab->dag[j] : NULL;
+            if (dag && batch > dag->n_ready)
+                batch = dag->n_ready;
+
+            double t_us = hot[j].bootstrap_us;
+            int stream_owner = -1;
+            if (key_stream) {
+                // the whole batch shares one pass over the key
+                t_us = hw_roofline_us(cfg, tab->jobs[j].key_size_mb, hbm_streams + 1);
+            }
 
             /* ---- Assign engines ---- */
             for (int e = 0; e < cfg->num_engines && batch > 0; e++) {
@@ -246,161 +2071,338 @@ SimStats run_simulation(const HwConfig *cfg,
 
                     double end = now_us + t_us + cfg->ctx_switch_overhead_us;
                     engines[e].job_id = j;
+                    if (dag) eng_node[e] = dag_run_take(dag);
                     engines[e].busy_until_us = end;
+                    engines[e].busy_us += end - now_us;
+                    iheap_push(&events, e, end);
+                    busy_eng++;
+                    tab->refs[j]++;
+                    if (key_stream && stream_owner < 0) {
+                        stream_owner = e;
+                        key_stream[e] = 1;
+                        hbm_streams++;
+                    }
 
-                    /* ==== NEW: LOG ENGINE SLICE ==== */
-                    if (engines[e].log_len >= engines[e].log_cap) {
-                        engines[e].log_cap *= 2;
-                        engines[e].log = realloc(engines[e].log,
-                             engines[e].log_cap * sizeof(EngineLogEntry));
+                    if (tl) timeline_slice(tl, e, tab->seq[j], now_us, end);
+                    if (ic && idle_since[e] < now_us) {
+                        ic->idle_intervals++;
+                        ic->idle_us += now_us - idle_since[e];
                     }
-                    engines[e].log[engines[e].log_len++] = (EngineLogEntry){
-                        .job_id = j,
-                        .start_us = now_us,
-                        .end_us = end
-                    };
 
                     idle--;
                     batch--;
                 }
             }
+            if (dag) dag_refresh(tab, j);
         }
-    }
 
-    /* --------- ensure all jobs have completion time --------- */
+        /* ---- Upload ahead of the engines ---- */
+        while (cfg->pcie_bandwidth_gbps > 0.0 &&
+               attempts++ < attempt_cap &&
+               upload_cap_ahead(&sim->uploads, &sim->sctx)) {
+            uint64_t pick_start = ic ? instr_ticks() : 0;
+            int n_slices = 0;
+            int j = ops->pick_batch(sim->sched, now_us, idle, &n_slices);
+            if (ic) {
+                pick_ticks += instr_ticks() - pick_start;
+                ic->sched_calls++;
+                if (j < 0) ic->sched_empty++;
+            }
+            // a job with keys here is one the policy could not pass over
+            if (j < 0 || hot[j].pcie_transferred) break;
+            n_picks++;
+            if (fetch_keys(sim, j, now_us) > 0.0) {
+                hot[j].staged = 1;
+                upload_cap_started(&sim->uploads, &sim->sctx);
+            }
+        }
 
-    for (int i = 0; i < n_jobs; i++)
-        if (jobs[i].completion_time_us <= 0.0)
-            jobs[i].completion_time_us = now_us;
+        /* ---- Speculative key uploads ---- */
+        if (tab->pf_start) prefetch(sim, now_us);
+
+        /* ---- Run-length fast-forward ---- */
+        // slice lengths under the roofline model depend on what else runs,
+        // a graph releases bootstraps only as others finish, and with
+        // key-switch units bootstraps finish off the engines
+        if (params->fast_forward && !key_stream && !eng_node && !ks &&
+            ops->stable_until &&
+            pcie_link_pending(link) == 0 &&
+            busy_eng == cfg->num_engines) {
+            double horizon = ops->stable_until(sim->sched, now_us);
+            if (feed_peek(sim, &next_arrival_us) && next_arrival_us < horizon)
+                horizon = next_arrival_us;
+            // jobs for the next window are not known yet
+            if (sync && horizon > sync->window_end_us)
+                horizon = sync->window_end_us;
+
+            if (ic) instr_phase(ic, SIM_PHASE_ASSIGN, &mark);
+            int slices = fast_forward(cfg, engines, &events, tl, tab,
+                                      attempt_cap, sim, now_us, horizon);
+            if (ic) {
+                ic->ff_slices += slices;
+                instr_phase(ic, SIM_PHASE_FAST_FORWARD, &mark);
+            }
+        }
+        if (ic) instr_phase(ic, SIM_PHASE_ASSIGN, &mark);
 
-    /* --------- Compute statistics --------- */
+        /* ---- Schedule next PCIe completion and key-switch ---- */
+        pcie_reschedule(&events, ev_pcie, link);
+        if (ks) ks_reschedule(&events, ev_ks, ks);
+        if (ic) instr_phase(ic, SIM_PHASE_TRANSFERS, &mark);
+    }
 
-    double first_arrival = jobs[0].arrival_time_us;
-    for (int i = 1; i < n_jobs; i++)
-        if (jobs[i].arrival_time_us < first_arrival)
-            first_arrival = jobs[i].arrival_time_us;
+    if (ic) {
+        struct timespec wall1;
+        clock_gettime(CLOCK_MONOTONIC, &wall1);
+        ic->total_ticks = instr_ticks() - ic->total_ticks;
+        ic->wall_us = (wall1.tv_sec - wall0.tv_sec) * 1e6 +
+                      (wall1.tv_nsec - wall0.tv_nsec) * 1e-3;
+        ic->loop_iterations = n_events;
+        ic->transfer_scans = pcie_link_steps(link);
 
-    double last_finish = 0.0;
-    for (int i = 0; i < n_jobs; i++)
-        if (jobs[i].completion_time_us > last_finish)
-            last_finish = jobs[i].completion_time_us;
+        // picks ran inside the assignment phase
+        ic->phase_ticks[SIM_PHASE_PICK] = pick_ticks;
+        ic->phase_ticks[SIM_PHASE_ASSIGN] -= pick_ticks;
 
-    SimStats s;
-    s.makespan_us = last_finish - first_arrival;
+        for (int e = 0; e < cfg->num_engines; e++) {
+            if (engines[e].job_id < 0 && idle_since[e] < now_us) {
+                ic->idle_intervals++;
+                ic->idle_us += now_us - idle_since[e];
+            }
+        }
+        free(idle_since);
+    }
 
-    double sum_comp = 0.0, sum_slow = 0.0;
-    for (int i = 0; i < n_jobs; i++) {
-        double resp = jobs[i].completion_time_us - jobs[i].arrival_time_us;
-        sum_comp += resp;
+    /* --------- Engine busy time, clipped at the end of the run --------- */
 
-        double svc = jobs[i].num_bootstraps * bootstrap_time_us(cfg, &jobs[i]);
-        if (svc < 1) svc = 1;
-        sum_slow += resp / svc;
+    double total_engine_busy_us = 0.0;
+    for (int e = 0; e < cfg->num_engines; e++) {
+        double busy = engines[e].busy_us;
+        if (engines[e].job_id >= 0 && engines[e].busy_until_us > now_us)
+            busy -= engines[e].busy_until_us - now_us;
+        total_engine_busy_us += busy;
     }
 
-    s.avg_completion_time_us = sum_comp / n_jobs;
-    s.avg_slowdown = sum_slow / n_jobs;
-    s.engine_utilization =
-        (s.makespan_us > 0 ? total_engine_busy_us / (s.makespan_us * cfg->num_engines)
-                           : 0.0);
+    // engines still stalled when the run stopped early
+    for (int i = 0; i < st_len; i++)
+        stall_us += now_us - stall_since[stalled[(st_head + i) % cfg->num_engines]];
 
-    /* --------- Compute fairness --------- */
-    int max_tenant = -1;
-    for (int i = 0; i < n_jobs; i++)
-        if (jobs[i].tenant_id > max_tenant)
-            max_tenant = jobs[i].tenant_id;
-
-    double fairness = 1.0;
-    if (max_tenant >= 0) {
-        int T = max_tenant + 1;
-        double *sum_slow_t = calloc(T, sizeof(double));
-        int *cnt_t = calloc(T, sizeof(int));
-
-        for (int i = 0; i < n_jobs; i++) {
-            double resp = jobs[i].completion_time_us - jobs[i].arrival_time_us;
-            double svc = jobs[i].num_bootstraps *
-                         bootstrap_time_us(cfg, &jobs[i]);
-            if (svc < 1) svc = 1;
-            double slow = resp / svc;
-
-            sum_slow_t[jobs[i].tenant_id] += slow;
-            cnt_t[jobs[i].tenant_id]++;
-        }
+    /* --------- Jobs still holding a slot --------- */
 
-        double sum_x = 0, sum_x2 = 0;
-        int present = 0;
-        for (int t = 0; t < T; t++) {
-            if (cnt_t[t] > 0) {
-                double avg = sum_slow_t[t] / cnt_t[t];
-                sum_x += avg;
-                sum_x2 += avg * avg;
-                present++;
-            }
-        }
+    // every job when fed from an array, the unfinished or still
+    // referenced tail of the trace when streamed
+    for (int j = 0; j < tab->n_slots; j++) {
+        if (tab->seq[j] < 0) continue;
+
+        // ensure all jobs have completion time
+        if (times[j].completion_us <= 0.0)
+            times[j].completion_us = now_us;
 
-        if (present > 1)
-            fairness = (sum_x * sum_x) / (present * sum_x2);
+        TfheJob job = slot_job(tab, j);
+        int admit = tab->admit ? tab->admit[j] : SLOT_ADMITTED;
+        stats_add(&sim->acc, cfg, &job, admit);
+        if (sim->job_csv && admit != SLOT_REJECTED) write_job_row(sim->job_csv, &job);
 
-        free(sum_slow_t);
-        free(cnt_t);
+        // prefetched for a job that never ran
+        if (tab->pf_start && tab->pf_start[j] >= 0.0 && !hot[j].started)
+            sim->pf_stats.prefetch_wasted_mb += upload_mb(sim, j);
     }
 
-    s.fairness = fairness;
+    /* --------- Compute statistics --------- */
 
-    /* --------- Write Logs to CSV --------- */
+    stats_finish(&sim->acc, cfg, total_engine_busy_us, out);
+
+    /* --------- Key cache report --------- */
+
+    out->n_events = n_events;
+    out->n_picks = n_picks;
+    out->pcie_mb_moved = sim->pcie_mb_moved;
+    out->key_hits = out->key_misses = out->key_evictions = 0;
+    out->key_evicted_mb = 0.0;
+    if (kc) {
+        KeyCacheStats ks = key_cache_stats(kc);
+        out->key_hits = ks.hits;
+        out->key_misses = ks.misses;
+        out->key_evictions = ks.evictions;
+        out->key_evicted_mb = ks.evicted_mb;
+    }
 
-    if (g_csv_prefix) {
-        const char *label = "sim";
-        if (pick_job == pick_job_fifo) label = "fifo";
-        else if (pick_job == pick_job_hps) label = "hps";
+    out->prefetches = sim->pf_stats.prefetches;
+    out->prefetch_accurate = sim->pf_stats.prefetch_accurate;
+    out->prefetch_mb = sim->pf_stats.prefetch_mb;
+    out->prefetch_wasted_mb = sim->pf_stats.prefetch_wasted_mb;
+
+    /* --------- Key-switch stage --------- */
+
+    out->key_switches = 0;
+    out->ks_utilization = out->ks_queue_wait_us = out->engine_stall_us = 0.0;
+    out->ks_queue_peak = 0;
+    if (ks) {
+        KsPipeStats kst = ks_pipe_stats(ks);
+        out->key_switches = kst.done;
+        out->ks_utilization = out->makespan_us > 0
+            ? kst.issue_us / (out->makespan_us * cfg->ks_units) : 0.0;
+        out->ks_queue_wait_us = kst.queue_wait_us;
+        out->ks_queue_peak = kst.max_queue;
+        out->engine_stall_us = stall_us;
+    }
 
-        char path_jobs[512];
-        snprintf(path_jobs, sizeof(path_jobs),
-                 "examples/results/%s-%s.csv", g_csv_prefix, label);
-
-        FILE *f = fopen(path_jobs, "w");
-        if (f) {
-            fprintf(f, "job_id,tenant_id,arrival_us,start_us,completion_us,"
-                        "num_bootstraps,key_size_mb,pcie_transferred\n");
-            for (int i = 0; i < n_jobs; i++) {
-                fprintf(f, "%d,%d,%.0f,%.0f,%.0f,%d,%.2f,%d\n",
-                        jobs[i].id, jobs[i].tenant_id,
-                        jobs[i].arrival_time_us, jobs[i].start_time_us,
-                        jobs[i].completion_time_us, jobs[i].num_bootstraps,
-                        jobs[i].key_size_mb, jobs[i].pcie_transferred);
-            }
-            fclose(f);
-        }
+    /* --------- Close the CSV outputs --------- */
 
-        /* ---- NEW ENGINE LOG CSV ---- */
-        char path_eng[512];
-        snprintf(path_eng, sizeof(path_eng),
-                 "examples/results/%s-%s-engines.csv", g_csv_prefix, label);
-
-        FILE *ef = fopen(path_eng, "w");
-        if (ef) {
-            fprintf(ef, "engine,job_id,start_us,end_us\n");
-            for (int e = 0; e < cfg->num_engines; e++) {
-                for (int k = 0; k < engines[e].log_len; k++) {
-                    EngineLogEntry *L = &engines[e].log[k];
-                    fprintf(ef, "%d,%d,%.0f,%.0f\n",
-                            e, L->job_id, L->start_us, L->end_us);
-                }
-            }
-            fclose(ef);
-        }
+    if (sim->job_csv) {
+        fclose(sim->job_csv);
+        sim->job_csv = NULL;
     }
+    free(job_csv_buf);
+    timeline_close(tl);
 
     /* --------- Cleanup --------- */
 
-    for (int e = 0; e < cfg->num_engines; e++)
-        free(engines[e].log);
-
     free(engines);
-    free(transfers);
-    free(jobs);
+    free(key_stream);
+    free(eng_node);
+    free(held);
+    free(stall_since);
+    free(stalled);
+    ks_pipe_destroy(ks);
+    free(done_slowdown);
+    iheap_free(&events);
+    ops->destroy(sim->sched);
+    sim->sched = NULL;
+    key_cache_destroy(kc);
+    sim->kc = NULL;
+    free(sim->key_waiters);
+    sim->key_waiters = NULL;
+    free(sim->held_ring);
+    sim->held_ring = NULL;
+    free(sim->pf_ring);
+    free(sim->pf_ring_seq);
+    sim->pf_ring = NULL;
+    sim->pf_ring_seq = NULL;
+    pcie_link_destroy(link);
+    sim->link = NULL;
+
+    if (params->show_progress) printf("\n");
+    return 0;
+}
+
+/* Pickers passed as a SchedulerFn: the built-in ones map to their
+ * incremental policies, anything else is called on the whole table. */
+static const SchedulerOps *ops_for_fn(Sim *sim, SchedulerFn pick_job) {
+    if (pick_job == pick_job_fifo) return &sched_fifo_ops;
+    if (pick_job == pick_job_hps) return &sched_hps_ops;
+    sim->legacy_fn = pick_job;
+    return &legacy_ops;
+}
+
+SimStats run_simulation(const HwConfig *cfg,
+                        TfheJob *jobs_original,
+                        int n_jobs,
+                        SchedulerFn pick_job)
+{
+    SimParams params;
+    sim_params_default(&params);
+    return run_simulation_params(cfg, jobs_original, n_jobs, pick_job, &params);
+}
+
+static SimStats run_array(Sim *sim, TfheJob *jobs_original, int n_jobs)
+{
+    /* --------- Job table over the caller's jobs --------- */
 
-    if (g_show_progress) printf("\n");
+    SimStats s;
+    sim->tab.jobs = jobs_original;
+    sim->arrival_order = NULL;
+    if (table_grow(sim, n_jobs > 0 ? n_jobs : 1) != 0 ||
+        !(sim->arrival_order = arrival_sorted_order(jobs_original, n_jobs))) {
+        fprintf(stderr, "Out of memory setting up the job table\n");
+        table_free(&sim->tab);
+        memset(&s, 0, sizeof(s));
+        return s;
+    }
+    for (int i = 0; i < n_jobs; i++)
+        slot_init(sim, i, &jobs_original[i], i);
+    sim->tab.n_slots = n_jobs;
+
+    sim->in_jobs = jobs_original;
+    sim->n_in = n_jobs;
 
+    simulate(sim, &s);
+
+    free(sim->arrival_order);
+    table_free(&sim->tab);
     return s;
 }
+
+SimStats run_simulation_params(const HwConfig *cfg,
+                               TfheJob *jobs_original,
+                               int n_jobs,
+                               SchedulerFn pick_job,
+                               const SimParams *params)
+{
+    Sim sim = { .cfg = cfg, .params = params };
+    sim.ops = ops_for_fn(&sim, pick_job);
+    return run_array(&sim, jobs_original, n_jobs);
+}
+
+SimStats run_simulation_ops(const HwConfig *cfg,
+                            TfheJob *jobs_original,
+                            int n_jobs,
+                            const SchedulerOps *ops,
+                            const SimParams *params)
+{
+    Sim sim = { .cfg = cfg, .params = params, .ops = ops };
+    return run_array(&sim, jobs_original, n_jobs);
+}
+
+int run_simulation_snapshot(const HwConfig *cfg,
+                            TfheJob *jobs_original,
+                            int n_jobs,
+                            const SchedulerOps *ops,
+                            const SimParams *params,
+                            double at_us,
+                            const char *path)
+{
+    Sim sim = { .cfg = cfg, .params = params, .ops = ops,
+                .snap_path = path, .snap_at_us = at_us, .snap_rc = 1 };
+    SimStats s = run_array(&sim, jobs_original, n_jobs);
+    sim_stats_free(&s);
+
+    if (sim.snap_rc > 0)
+        fprintf(stderr, "The run ended at %.0f us, before the snapshot time\n",
+                s.last_finish_us);
+    return sim.snap_rc == 0 ? 0 : -1;
+}
+
+static int run_stream(Sim *sim, SimStats *out)
+{
+    if (table_grow(sim, 1024) != 0) {
+        table_free(&sim->tab);
+        return -1;
+    }
+
+    int rc = simulate(sim, out);
+
+    table_free(&sim->tab);
+    return rc != 0 || sim->feed_error ? -1 : 0;
+}
+
+int run_simulation_stream(const HwConfig *cfg,
+                          JobSource *src,
+                          SchedulerFn pick_job,
+                          const SimParams *params,
+                          SimStats *out)
+{
+    Sim sim = { .cfg = cfg, .params = params, .src = src };
+    sim.ops = ops_for_fn(&sim, pick_job);
+    return run_stream(&sim, out);
+}
+
+int run_simulation_stream_ops(const HwConfig *cfg,
+                              JobSource *src,
+                              const SchedulerOps *ops,
+                              const SimParams *params,
+                              SimStats *out)
+{
+    Sim sim = { .cfg = cfg, .params = params, .src = src, .ops = ops };
+    return run_stream(&sim, out);
+}
@@ -0,0 +1,287 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "../includes/sweep.h"
+#include "../includes/hw_config.h"
+#include "../includes/scheduler.h"
+#include "../includes/simulator.h"
+
+#define SWEEP_MAX_VALUES 256
+
+enum { AX_W1, AX_W2, AX_W3, AX_W4, AX_W5, AX_PCIE_SCALE, AX_PCIE_CAP, N_NUM_AXES };
+
+static const char *axis_names[N_NUM_AXES] = {
+    "hps-w1", "hps-w2", "hps-w3", "hps-w4", "hps-w5",
+    "pcie-scale", "pcie-cap-mb"
+};
+
+typedef struct {
+    double values[SWEEP_MAX_VALUES];
+    int n;
+} Axis;
+
+typedef struct {
+    char *hw_paths[SWEEP_MAX_VALUES];
+    HwConfig hw[SWEEP_MAX_VALUES];
+    int n_hw;
+    int sched[2];           // sched[0] = fifo, sched[1] = hps
+    Axis num[N_NUM_AXES];
+    int threads;
+} Grid;
+
+typedef struct {
+    int hw;
+    int hps;
+    SimParams params;
+    SimStats stats;
+} SweepPoint;
+
+typedef struct {
+    const Grid *grid;
+    TfheJob *jobs;
+    int n_jobs;
+    SweepPoint *points;
+    int n_points;
+    int next;
+    pthread_mutex_t lock;
+} SweepCtx;
+
+/* ===================== GRID SPEC ===================== */
+
+static void grid_free(Grid *g) {
+    for (int i = 0; i < g->n_hw; i++) free(g->hw_paths[i]);
+}
+
+static int read_grid(const char *path, Grid *g) {
+    memset(g, 0, sizeof(*g));
+
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror("fopen sweep grid");
+        return -1;
+    }
+
+    int have_sched = 0;
+    char bad_axis[64] = "";
+    char line[4096];
+    while (fgets(line, sizeof(line), f)) {
+        char *save = NULL;
+        char *name = strtok_r(line, " \t\r\n", &save);
+        if (!name || name[0] == '#') continue;
+
+        int axis = -1;
+        for (int a = 0; a < N_NUM_AXES; a++)
+            if (strcmp(name, axis_names[a]) == 0) axis = a;
+
+        char *tok;
+        while ((tok = strtok_r(NULL, " \t\r\n", &save)) && tok[0] != '#') {
+            if (strcmp(name, "hw") == 0) {
+                if (g->n_hw == SWEEP_MAX_VALUES) {
+                    snprintf(bad_axis, sizeof(bad_axis), "%s", name);
+                    goto too_many;
+                }
+                if (read_hw_config(tok, &g->hw[g->n_hw]) != 0) goto fail;
+                g->hw_paths[g->n_hw++] = strdup(tok);
+            } else if (strcmp(name, "sched") == 0) {
+                have_sched = 1;
+                if (strcmp(tok, "fifo") == 0) g->sched[0] = 1;
+                else if (strcmp(tok, "hps") == 0) g->sched[1] = 1;
+                else {
+                    fprintf(stderr, "Unknown scheduler in sweep grid: %s\n", tok);
+                    goto fail;
+                }
+            } else if (strcmp(name, "threads") == 0) {
+                g->threads = atoi(tok);
+            } else if (axis >= 0) {
+                if (g->num[axis].n == SWEEP_MAX_VALUES) {
+                    snprintf(bad_axis, sizeof(bad_axis), "%s", name);
+                    goto too_many;
+                }
+                g->num[axis].values[g->num[axis].n++] = atof(tok);
+            } else {
+                fprintf(stderr, "Unknown sweep axis: %s\n", name);
+                goto fail;
+            }
+        }
+    }
+    fclose(f);
+
+    if (g->n_hw == 0) {
+        fprintf(stderr, "Sweep grid has no hw configs\n");
+        grid_free(g);
+        return -1;
+    }
+    if (!have_sched) g->sched[0] = g->sched[1] = 1;
+    return 0;
+
+too_many:
+    fprintf(stderr, "Too many values for sweep axis %s (max %d)\n",
+            bad_axis, SWEEP_MAX_VALUES);
+fail:
+    fclose(f);
+    grid_free(g);
+    return -1;
+}
+
+/* Value of `axis` at index `i`, or `def` when the axis was left out. */
+static double axis_value(const Grid *g, int axis, int i, double def) {
+    return g->num[axis].n > 0 ? g->num[axis].values[i] : def;
+}
+
+static int axis_len(const Grid *g, int axis) {
+    return g->num[axis].n > 0 ? g->num[axis].n : 1;
+}
+
+static SweepPoint *expand_grid(const Grid *g, int *n_out) {
+    SimParams base;
+    sim_params_default(&base);
+    base.show_progress = 0;
+    base.csv_prefix = NULL;
+
+    long total = g->n_hw * 2L;
+    for (int a = 0; a < N_NUM_AXES; a++) total *= axis_len(g, a);
+
+    SweepPoint *pts = malloc(total * sizeof(SweepPoint));
+    int n = 0;
+
+    int idx[N_NUM_AXES];
+    for (int h = 0; h < g->n_hw; h++) {
+        for (int s = 0; s < 2; s++) {
+            if (!g->sched[s]) continue;
+            memset(idx, 0, sizeof(idx));
+            for (;;) {
+                int weights_moved = 0;
+                for (int a = AX_W1; a <= AX_W5; a++)
+                    if (idx[a] > 0) weights_moved = 1;
+
+                // FIFO ignores the weights: one point per PCIe setting
+                if (s == 1 || !weights_moved) {
+                    SweepPoint *p = &pts[n++];
+                    p->hw = h;
+                    p->hps = s;
+                    p->params = base;
+
+                    HpsWeights *w = &p->params.weights;
+                    w->key_affinity  = axis_value(g, AX_W1, idx[AX_W1], w->key_affinity);
+                    w->noise_urgency = axis_value(g, AX_W2, idx[AX_W2], w->noise_urgency);
+                    w->bw_penalty    = axis_value(g, AX_W3, idx[AX_W3], w->bw_penalty);
+                    w->fairness      = axis_value(g, AX_W4, idx[AX_W4], w->fairness);
+                    w->deadline      = axis_value(g, AX_W5, idx[AX_W5], w->deadline);
+                    p->params.pcie_scale =
+                        axis_value(g, AX_PCIE_SCALE, idx[AX_PCIE_SCALE], base.pcie_scale);
+                    p->params.pcie_cap_mb =
+                        axis_value(g, AX_PCIE_CAP, idx[AX_PCIE_CAP], base.pcie_cap_mb);
+                }
+
+                // odometer over the numeric axes
+                int a = 0;
+                while (a < N_NUM_AXES && ++idx[a] >= axis_len(g, a))
+                    idx[a++] = 0;
+                if (a == N_NUM_AXES) break;
+            }
+        }
+    }
+
+    *n_out = n;
+    return pts;
+}
+
+/* ===================== WORKERS ===================== */
+
+static void *sweep_worker(void *arg) {
+    SweepCtx *ctx = arg;
+
+    for (;;) {
+        pthread_mutex_lock(&ctx->lock);
+        int i = ctx->next++;
+        pthread_mutex_unlock(&ctx->lock);
+        if (i >= ctx->n_points) break;
+
+        SweepPoint *p = &ctx->points[i];
+        SchedulerFn fn = p->hps ? (SchedulerFn)pick_job_hps
+                                : (SchedulerFn)pick_job_fifo;
+        p->stats = run_simulation_params(&ctx->grid->hw[p->hw],
+                                         ctx->jobs, ctx->n_jobs, fn, &p->params);
+    }
+    return NULL;
+}
+
+static void write_results(FILE *f, const Grid *g, const SweepPoint *pts, int n) {
+    fprintf(f, "point,hw,sched,hps_w1,hps_w2,hps_w3,hps_w4,hps_w5,"
+               "pcie_scale,pcie_cap_mb,makespan_us,avg_completion_us,"
+               "avg_slowdown,utilization,fairness,p99_response_us,"
+               "p99_queue_us,p99_slowdown,ks_utilization,engine_stall,"
+               "miss_rate,rejected\n");
+    for (int i = 0; i < n; i++) {
+        const SweepPoint *p = &pts[i];
+        const HpsWeights *w = &p->params.weights;
+        double engine_us = p->stats.makespan_us * g->hw[p->hw].num_engines;
+        const DeadlineStats *dl = &p->stats.deadlines;
+        fprintf(f, "%d,%s,%s,%g,%g,%g,%g,%g,%g,%g,%.2f,%.2f,%.4f,%.4f,%.4f,"
+                   "%.2f,%.2f,%.4f,%.4f,%.4f,%.4f,%ld\n",
+                i, g->hw_paths[p->hw], p->hps ? "hps" : "fifo",
+                w->key_affinity, w->noise_urgency, w->bw_penalty,
+                w->fairness, w->deadline,
+                p->params.pcie_scale, p->params.pcie_cap_mb,
+                p->stats.makespan_us, p->stats.avg_completion_time_us,
+                p->stats.avg_slowdown, p->stats.engine_utilization,
+                p->stats.fairness, p->stats.response_us.p99,
+                p->stats.queue_us.p99, p->stats.slowdown.p99,
+                p->stats.ks_utilization,
+                engine_us > 0 ? p->stats.engine_stall_us / engine_us : 0.0,
+                dl->with_deadline > 0 ? (double)dl->missed / dl->with_deadline : 0.0,
+                dl->rejected);
+    }
+}
+
+int run_sweep(const char *grid_path, TfheJob *jobs, int n_jobs,
+              int threads, const char *out_path)
+{
+    Grid *g = malloc(sizeof(Grid));
+    if (read_grid(grid_path, g) != 0) {
+        free(g);
+        return -1;
+    }
+
+    if (threads <= 0) threads = g->threads;
+    if (threads <= 0) threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads <= 0) threads = 1;
+
+    SweepCtx ctx;
+    ctx.grid = g;
+    ctx.jobs = jobs;
+    ctx.n_jobs = n_jobs;
+    ctx.points = expand_grid(g, &ctx.n_points);
+    ctx.next = 0;
+    pthread_mutex_init(&ctx.lock, NULL);
+
+    if (threads > ctx.n_points) threads = ctx.n_points > 0 ? ctx.n_points : 1;
+    fprintf(stderr, "Sweep: %d points on %d threads\n", ctx.n_points, threads);
+
+    pthread_t *tids = malloc(threads * sizeof(pthread_t));
+    for (int t = 0; t < threads; t++)
+        pthread_create(&tids[t], NULL, sweep_worker, &ctx);
+    for (int t = 0; t < threads; t++)
+        pthread_join(tids[t], NULL);
+    free(tids);
+    pthread_mutex_destroy(&ctx.lock);
+
+    int rc = 0;
+    FILE *f = out_path ? fopen(out_path, "w") : stdout;
+    if (f) {
+        write_results(f, g, ctx.points, ctx.n_points);
+        if (f != stdout) fclose(f);
+    } else {
+        perror("fopen sweep output");
+        rc = -1;
+    }
+
+    for (int i = 0; i < ctx.n_points; i++)
+        sim_stats_free(&ctx.points[i].stats);
+    free(ctx.points);
+    grid_free(g);
+    free(g);
+    return rc;
+}
@@ -0,0 +1,223 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "../includes/timeline.h"
+
+#define TIMELINE_IO_BUF     (1 << 20)   // stdio buffer per file
+#define TIMELINE_BLOCK_ROWS 65536       // rows per binary block
+#define TIMELINE_ROW_MAX    128         // longest formatted CSV row
+
+/* The run still being extended on one engine. */
+typedef struct {
+    long long job_id;   // -1 once several jobs share a MERGED row
+    double start_us;
+    double end_us;
+    double busy_us;
+    int count;          // slices in the run, 0 = none open
+} Run;
+
+struct Timeline {
+    FILE *f;
+    char *io_buf;
+    char *row_buf;      // CSV rows are formatted here, then written in bulk
+    size_t row_len;
+    TimelineFormat fmt;
+    int num_engines;
+    double merge_us;
+    Run *open;
+
+    /* BIN: the block being filled */
+    double *start_us;
+    double *end_us;
+    int32_t *engine;
+    int32_t *job_id;
+    int32_t *count;
+    int n_rows;
+};
+
+static void write_block(Timeline *tl) {
+    if (tl->n_rows == 0) return;
+
+    uint32_t head[2] = { (uint32_t)tl->n_rows, 0 };
+    int n = tl->n_rows;
+    fwrite(head, sizeof(head), 1, tl->f);
+    fwrite(tl->start_us, sizeof(double), n, tl->f);
+    fwrite(tl->end_us, sizeof(double), n, tl->f);
+    fwrite(tl->engine, sizeof(int32_t), n, tl->f);
+    fwrite(tl->job_id, sizeof(int32_t), n, tl->f);
+    fwrite(tl->count, sizeof(int32_t), n, tl->f);
+
+    static const char pad[8];
+    size_t tail = (3 * n * sizeof(int32_t)) % 8;
+    if (tail) fwrite(pad, 1, 8 - tail, tl->f);
+    tl->n_rows = 0;
+}
+
+/* Append `v` the way "%lld" / "%.0f" would print it.  llrint rounds
+ * half to even, as printf does on the exact binary value. */
+static char *put_int(char *p, long long v) {
+    char tmp[24];
+    int n = 0;
+    unsigned long long u = v < 0 ? -(unsigned long long)v : (unsigned long long)v;
+    do {
+        tmp[n++] = '0' + u % 10;
+        u /= 10;
+    } while (u);
+    if (v < 0) *p++ = '-';
+    while (n) *p++ = tmp[--n];
+    return p;
+}
+
+static char *put_us(char *p, double v) {
+    if (fabs(v) < 1e15) {
+        long long x = llrint(v);
+        if (x != 0 || !signbit(v)) return put_int(p, x);
+    }
+    return p + snprintf(p, 48, "%.0f", v);
+}
+
+static void emit_csv(Timeline *tl, int e, const Run *r) {
+    if (tl->row_len + TIMELINE_ROW_MAX > TIMELINE_IO_BUF) {
+        fwrite(tl->row_buf, 1, tl->row_len, tl->f);
+        tl->row_len = 0;
+    }
+
+    char *p = tl->row_buf + tl->row_len;
+    p = put_int(p, e);
+    *p++ = ',';
+    p = put_int(p, r->job_id);
+    *p++ = ',';
+    p = put_us(p, r->start_us);
+    *p++ = ',';
+    p = put_us(p, r->end_us);
+    *p++ = ',';
+    p = put_int(p, r->count);
+    if (tl->fmt == TIMELINE_MERGED) {
+        *p++ = ',';
+        p = put_us(p, r->busy_us);
+    }
+    *p++ = '\n';
+    tl->row_len = p - tl->row_buf;
+}
+
+static void emit(Timeline *tl, int e, const Run *r) {
+    if (tl->fmt != TIMELINE_BIN) {
+        emit_csv(tl, e, r);
+        return;
+    }
+
+    int k = tl->n_rows++;
+    tl->start_us[k] = r->start_us;
+    tl->end_us[k] = r->end_us;
+    tl->engine[k] = e;
+    tl->job_id[k] = (int32_t)r->job_id;
+    tl->count[k] = r->count;
+    if (tl->n_rows == TIMELINE_BLOCK_ROWS) write_block(tl);
+}
+
+Timeline *timeline_open(const char *path, TimelineFormat fmt,
+                        int num_engines, double merge_us)
+{
+    Timeline *tl = calloc(1, sizeof(Timeline));
+    if (!tl) return NULL;
+
+    tl->f = fopen(path, fmt == TIMELINE_BIN ? "wb" : "w");
+    if (!tl->f) {
+        perror(path);
+        free(tl);
+        return NULL;
+    }
+    tl->io_buf = malloc(TIMELINE_IO_BUF);
+    if (tl->io_buf) setvbuf(tl->f, tl->io_buf, _IOFBF, TIMELINE_IO_BUF);
+
+    tl->fmt = fmt;
+    tl->num_engines = num_engines;
+    tl->merge_us = merge_us > 0.0 ? merge_us : 0.0;
+    tl->open = calloc(num_engines, sizeof(Run));
+
+    if (fmt == TIMELINE_BIN) {
+        tl->start_us = malloc(TIMELINE_BLOCK_ROWS * sizeof(double));
+        tl->end_us = malloc(TIMELINE_BLOCK_ROWS * sizeof(double));
+        tl->engine = malloc(TIMELINE_BLOCK_ROWS * sizeof(int32_t));
+        tl->job_id = malloc(TIMELINE_BLOCK_ROWS * sizeof(int32_t));
+        tl->count = malloc(TIMELINE_BLOCK_ROWS * sizeof(int32_t));
+
+        char magic[8] = TIMELINE_BIN_MAGIC;
+        uint32_t head[2] = { TIMELINE_BIN_VERSION, (uint32_t)num_engines };
+        fwrite(magic, sizeof(magic), 1, tl->f);
+        fwrite(head, sizeof(head), 1, tl->f);
+    } else {
+        tl->row_buf = malloc(TIMELINE_IO_BUF);
+        fprintf(tl->f, fmt == TIMELINE_MERGED
+                ? "engine,job_id,start_us,end_us,count,busy_us\n"
+                : "engine,job_id,start_us,end_us,count\n");
+    }
+    return tl;
+}
+
+void timeline_slice(Timeline *tl, int engine, long long job_id,
+                    double start_us, double end_us)
+{
+    Run *r = &tl->open[engine];
+
+    if (r->count > 0) {
+        int joins = tl->fmt == TIMELINE_MERGED
+            ? start_us - r->end_us <= tl->merge_us
+            : job_id == r->job_id && start_us == r->end_us;
+        if (joins) {
+            if (job_id != r->job_id) r->job_id = -1;
+            if (end_us > r->end_us) r->end_us = end_us;
+            r->busy_us += end_us - start_us;
+            r->count++;
+            return;
+        }
+        emit(tl, engine, r);
+    }
+
+    r->job_id = job_id;
+    r->start_us = start_us;
+    r->end_us = end_us;
+    r->busy_us = end_us - start_us;
+    r->count = 1;
+}
+
+int timeline_close(Timeline *tl) {
+    if (!tl) return 0;
+
+    for (int e = 0; e < tl->num_engines; e++)
+        if (tl->open[e].count > 0) emit(tl, e, &tl->open[e]);
+    if (tl->fmt == TIMELINE_BIN) write_block(tl);
+    else fwrite(tl->row_buf, 1, tl->row_len, tl->f);
+
+    int rc = ferror(tl->f) ? -1 : 0;
+    if (fclose(tl->f) != 0) rc = -1;
+
+    free(tl->io_buf);
+    free(tl->row_buf);
+    free(tl->open);
+    free(tl->start_us);
+    free(tl->end_us);
+    free(tl->engine);
+    free(tl->job_id);
+    free(tl->count);
+    free(tl);
+    return rc;
+}
+
+const char *timeline_suffix(TimelineFormat fmt) {
+    switch (fmt) {
+    case TIMELINE_BIN:    return "engines.tlb";
+    case TIMELINE_MERGED: return "engines-merged.csv";
+    default:              return "engines.csv";
+    }
+}
+
+int timeline_parse_format(const char *name, TimelineFormat *out) {
+    if (strcmp(name, "csv") == 0) *out = TIMELINE_CSV;
+    else if (strcmp(name, "bin") == 0) *out = TIMELINE_BIN;
+    else if (strcmp(name, "merged") == 0) *out = TIMELINE_MERGED;
+    else return -1;
+    return 0;
+}
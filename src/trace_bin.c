@@ -0,0 +1,229 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "../includes/trace_bin.h"
+
+static const int col_width[TRACE_COLS] = {
+    [TRACE_COL_ID] = 4,       [TRACE_COL_TENANT] = 4,
+    [TRACE_COL_ARRIVAL] = 8,  [TRACE_COL_NUM_BOOT] = 4,
+    [TRACE_COL_KEY_SIZE] = 8, [TRACE_COL_NOISE] = 8,
+    [TRACE_COL_PRIORITY] = 4, [TRACE_COL_DEADLINE] = 8,
+    [TRACE_COL_KEY_ID] = 4
+};
+
+static uint64_t align8(uint64_t x) {
+    return (x + 7) & ~(uint64_t)7;
+}
+
+/* ===================== READER ===================== */
+
+int trace_bin_check(const void *data, size_t len) {
+    const TraceBinHeader *h = data;
+    if (len < sizeof(h->magic) || memcmp(h->magic, TRACE_BIN_MAGIC, sizeof(h->magic)) != 0)
+        return 0;
+
+    if (len < sizeof(TraceBinHeader)) {
+        fprintf(stderr, "Binary workload: truncated header\n");
+        return -1;
+    }
+    if (h->version != TRACE_BIN_VERSION ||
+        h->header_size < sizeof(TraceBinHeader)) {
+        fprintf(stderr, "Binary workload: unsupported version %u\n", h->version);
+        return -1;
+    }
+    for (int c = 0; c < TRACE_COLS; c++) {
+        uint64_t off = h->col_offset[c];
+        if (off % 8 != 0 || off < h->header_size || off > len ||
+            h->n_jobs > (len - off) / col_width[c]) {
+            fprintf(stderr, "Binary workload: column %d is truncated\n", c);
+            return -1;
+        }
+    }
+    return 1;
+}
+
+static int32_t col_i32(const void *data, int c, uint64_t k) {
+    const TraceBinHeader *h = data;
+    return ((const int32_t *)((const char *)data + h->col_offset[c]))[k];
+}
+
+static double col_f64(const void *data, int c, uint64_t k) {
+    const TraceBinHeader *h = data;
+    return ((const double *)((const char *)data + h->col_offset[c]))[k];
+}
+
+void trace_bin_job(const void *data, uint64_t k, TfheJob *job) {
+    job->id = col_i32(data, TRACE_COL_ID, k);
+    job->tenant_id = col_i32(data, TRACE_COL_TENANT, k);
+    job->arrival_time_us = col_f64(data, TRACE_COL_ARRIVAL, k);
+    job->num_bootstraps = col_i32(data, TRACE_COL_NUM_BOOT, k);
+    job->key_size_mb = col_f64(data, TRACE_COL_KEY_SIZE, k);
+    job->noise_budget = col_f64(data, TRACE_COL_NOISE, k);
+    job->priority = col_i32(data, TRACE_COL_PRIORITY, k);
+    job->deadline_us = col_f64(data, TRACE_COL_DEADLINE, k);
+    job->key_id = col_i32(data, TRACE_COL_KEY_ID, k);
+
+    job->remaining_bootstraps = job->num_bootstraps;
+    job->start_time_us = -1;
+    job->completion_time_us = -1;
+    job->started = 0;
+    job->pcie_transferred = 0;
+}
+
+void trace_bin_release(void *data, uint64_t from_row, uint64_t to_row) {
+    const TraceBinHeader *h = data;
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+
+    for (int c = 0; c < TRACE_COLS; c++) {
+        size_t lo = h->col_offset[c] + from_row * col_width[c];
+        size_t hi = h->col_offset[c] + to_row * col_width[c];
+        lo = (lo + page - 1) / page * page;
+        hi = hi / page * page;
+        if (hi > lo) madvise((char *)data + lo, hi - lo, MADV_DONTNEED);
+    }
+}
+
+/* ===================== WRITER ===================== */
+
+typedef struct {
+    char buf[1 << 16];
+    size_t len;
+    uint64_t off;       // file offset of buf[0]
+} ColBuf;
+
+struct TraceBinWriter {
+    int fd;
+    int failed;
+    uint64_t added;
+    TraceBinHeader h;
+    ColBuf col[TRACE_COLS];
+};
+
+static void col_flush(TraceBinWriter *w, ColBuf *cb) {
+    size_t done = 0;
+    while (done < cb->len) {
+        ssize_t r = pwrite(w->fd, cb->buf + done, cb->len - done, cb->off + done);
+        if (r <= 0) {
+            w->failed = 1;
+            break;
+        }
+        done += r;
+    }
+    cb->off += cb->len;
+    cb->len = 0;
+}
+
+static void col_put(TraceBinWriter *w, int c, const void *v) {
+    ColBuf *cb = &w->col[c];
+    if (cb->len + col_width[c] > sizeof(cb->buf)) col_flush(w, cb);
+    memcpy(cb->buf + cb->len, v, col_width[c]);
+    cb->len += col_width[c];
+}
+
+TraceBinWriter *trace_bin_writer_open(const char *path, uint64_t n_jobs) {
+    TraceBinWriter *w = calloc(1, sizeof(TraceBinWriter));
+    if (!w) return NULL;
+
+    w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (w->fd < 0) {
+        perror("open binary workload");
+        free(w);
+        return NULL;
+    }
+
+    memcpy(w->h.magic, TRACE_BIN_MAGIC, sizeof(w->h.magic));
+    w->h.version = TRACE_BIN_VERSION;
+    w->h.header_size = sizeof(TraceBinHeader);
+    w->h.n_jobs = n_jobs;
+    w->h.flags = TRACE_BIN_SORTED;
+
+    uint64_t off = align8(sizeof(TraceBinHeader));
+    for (int c = 0; c < TRACE_COLS; c++) {
+        w->h.col_offset[c] = off;
+        w->col[c].off = off;
+        off = align8(off + n_jobs * col_width[c]);
+    }
+    if (ftruncate(w->fd, off) != 0) {
+        perror("size binary workload");
+        close(w->fd);
+        free(w);
+        return NULL;
+    }
+    return w;
+}
+
+int trace_bin_writer_add(TraceBinWriter *w, const TfheJob *job) {
+    TraceBinHeader *h = &w->h;
+    if (w->added >= h->n_jobs) {
+        fprintf(stderr, "Binary workload: more rows than announced\n");
+        w->failed = 1;
+        return -1;
+    }
+    if (w->added > 0 && job->arrival_time_us < h->arrival_max) {
+        fprintf(stderr, "Binary workload: job %d is out of arrival order\n", job->id);
+        w->failed = 1;
+        return -1;
+    }
+
+    if (w->added == 0) {
+        h->arrival_min = h->arrival_max = job->arrival_time_us;
+        h->key_size_min = h->key_size_max = job->key_size_mb;
+        h->deadline_min = h->deadline_max = job->deadline_us;
+        h->tenant_min = h->tenant_max = job->tenant_id;
+        h->num_boot_min = h->num_boot_max = job->num_bootstraps;
+        h->priority_min = h->priority_max = job->priority;
+        h->key_id_min = h->key_id_max = job->key_id;
+    }
+    h->arrival_max = job->arrival_time_us;
+    if (job->key_size_mb < h->key_size_min) h->key_size_min = job->key_size_mb;
+    if (job->key_size_mb > h->key_size_max) h->key_size_max = job->key_size_mb;
+    if (job->deadline_us < h->deadline_min) h->deadline_min = job->deadline_us;
+    if (job->deadline_us > h->deadline_max) h->deadline_max = job->deadline_us;
+    if (job->tenant_id < h->tenant_min) h->tenant_min = job->tenant_id;
+    if (job->tenant_id > h->tenant_max) h->tenant_max = job->tenant_id;
+    if (job->num_bootstraps < h->num_boot_min) h->num_boot_min = job->num_bootstraps;
+    if (job->num_bootstraps > h->num_boot_max) h->num_boot_max = job->num_bootstraps;
+    if (job->priority < h->priority_min) h->priority_min = job->priority;
+    if (job->priority > h->priority_max) h->priority_max = job->priority;
+    if (job->key_id < h->key_id_min) h->key_id_min = job->key_id;
+    if (job->key_id > h->key_id_max) h->key_id_max = job->key_id;
+    if (job->num_bootstraps > 0) h->total_bootstraps += job->num_bootstraps;
+
+    int32_t id = job->id, tenant = job->tenant_id, nb = job->num_bootstraps;
+    int32_t prio = job->priority, key_id = job->key_id;
+    col_put(w, TRACE_COL_ID, &id);
+    col_put(w, TRACE_COL_TENANT, &tenant);
+    col_put(w, TRACE_COL_ARRIVAL, &job->arrival_time_us);
+    col_put(w, TRACE_COL_NUM_BOOT, &nb);
+    col_put(w, TRACE_COL_KEY_SIZE, &job->key_size_mb);
+    col_put(w, TRACE_COL_NOISE, &job->noise_budget);
+    col_put(w, TRACE_COL_PRIORITY, &prio);
+    col_put(w, TRACE_COL_DEADLINE, &job->deadline_us);
+    col_put(w, TRACE_COL_KEY_ID, &key_id);
+
+    w->added++;
+    return w->failed ? -1 : 0;
+}
+
+int trace_bin_writer_close(TraceBinWriter *w) {
+    for (int c = 0; c < TRACE_COLS; c++)
+        col_flush(w, &w->col[c]);
+
+    if (w->added != w->h.n_jobs) {
+        fprintf(stderr, "Binary workload: %llu of %llu rows written\n",
+                (unsigned long long)w->added, (unsigned long long)w->h.n_jobs);
+        w->failed = 1;
+    }
+    if (pwrite(w->fd, &w->h, sizeof(w->h), 0) != (ssize_t)sizeof(w->h))
+        w->failed = 1;
+    if (close(w->fd) != 0)
+        w->failed = 1;
+
+    int rc = w->failed ? -1 : 0;
+    if (rc != 0) fprintf(stderr, "Binary workload: write failed\n");
+    free(w);
+    return rc;
+}
@@ -0,0 +1,353 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "../includes/tune.h"
+#include "../includes/sched_registry.h"
+#include "../includes/histogram.h"
+
+#define TUNE_ETA 3      // successive halving keeps 1/TUNE_ETA per rung
+
+typedef struct {
+    HpsWeights w;
+    int id;
+    double makespan_us;
+    double p99_slowdown;
+    double fairness;
+    double score;       // lower bound when pruned
+    int pruned;
+} Candidate;
+
+/* Metrics of the default weights on the rung's jobs, for TUNE_MIX. */
+typedef struct {
+    double p99_slowdown;
+    double makespan_us;
+    double unfairness;
+} Reference;
+
+typedef struct {
+    const HwConfig *cfg;
+    TfheJob *jobs;
+    int n_jobs;             // trace prefix this rung runs on
+    const TuneOptions *opt;
+    const SimParams *base;
+    Reference ref;
+    double ref_score;
+
+    Candidate **cands;
+    int n_cands;
+    int next;
+    double best;            // best finished score so far
+    pthread_mutex_t lock;
+} Rung;
+
+typedef struct {
+    Rung *rung;
+    double bound;
+    int pruned;
+} EvalCtx;
+
+/* ===================== OPTIONS ===================== */
+
+void tune_options_default(TuneOptions *o) {
+    memset(o, 0, sizeof(*o));
+    o->objective = TUNE_P99_SLOWDOWN;
+    o->method = TUNE_HALVING;
+    o->budget = 64;
+    o->seed = 1;
+    o->w_max = 8.0;
+    o->early_stop = 1;
+}
+
+int tune_parse_objective(const char *s, TuneOptions *o) {
+    if (strcmp(s, "p99-slowdown") == 0) o->objective = TUNE_P99_SLOWDOWN;
+    else if (strcmp(s, "makespan") == 0) o->objective = TUNE_MAKESPAN;
+    else if (strcmp(s, "fairness") == 0) o->objective = TUNE_FAIRNESS;
+    else if (strncmp(s, "mix:", 4) == 0) {
+        if (sscanf(s + 4, "%lf,%lf,%lf", &o->mix[0], &o->mix[1], &o->mix[2]) != 3 ||
+            o->mix[0] < 0.0 || o->mix[1] < 0.0 || o->mix[2] < 0.0)
+            return -1;
+        o->objective = TUNE_MIX;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+int tune_parse_method(const char *s, TuneMethod *out) {
+    if (strcmp(s, "random") == 0) *out = TUNE_RANDOM;
+    else if (strcmp(s, "halving") == 0) *out = TUNE_HALVING;
+    else return -1;
+    return 0;
+}
+
+/* ===================== SCORING ===================== */
+
+static double relative(double v, double ref) {
+    return ref > 0.0 ? v / ref : v;
+}
+
+static double score_of(const TuneOptions *o, const Reference *ref,
+                       double p99_slowdown, double makespan_us, double unfairness)
+{
+    switch (o->objective) {
+    case TUNE_MAKESPAN:
+        return makespan_us;
+    case TUNE_FAIRNESS:
+        return unfairness;
+    case TUNE_MIX:
+        return o->mix[0] * relative(p99_slowdown, ref->p99_slowdown) +
+               o->mix[1] * relative(makespan_us, ref->makespan_us) +
+               o->mix[2] * relative(unfairness, ref->unfairness);
+    case TUNE_P99_SLOWDOWN:
+    default:
+        return p99_slowdown;
+    }
+}
+
+/* The jobs still running add slowdowns of at least 0, so the final P99
+ * is at least the partial histogram's value at the same rank counted
+ * from the top. */
+static double p99_lower_bound(const SimProgress *p) {
+    if (p->n_jobs <= 0 || p->finished <= 0) return 0.0;
+    double rank = ceil(0.99 * p->n_jobs);
+    double unfinished = (double)(p->n_jobs - p->finished);
+    if (rank <= unfinished) return 0.0;
+    // the half keeps hist_quantile's ceil() on the intended rank
+    return hist_quantile(p->slowdown, (rank - unfinished - 0.5) / p->finished);
+}
+
+static int tune_stop(void *ctx, const SimProgress *p) {
+    EvalCtx *e = ctx;
+    Rung *r = e->rung;
+
+    // no bound on the fairness term: count it as perfect
+    double bound = score_of(r->opt, &r->ref, p99_lower_bound(p),
+                            p->now_us - p->first_arrival_us, 0.0);
+
+    pthread_mutex_lock(&r->lock);
+    double best = r->best;
+    pthread_mutex_unlock(&r->lock);
+
+    if (bound <= best) return 0;
+    e->bound = bound;
+    e->pruned = 1;
+    return 1;
+}
+
+static int can_stop_early(const TuneOptions *o) {
+    if (!o->early_stop) return 0;
+    if (o->objective == TUNE_FAIRNESS) return 0;
+    if (o->objective == TUNE_MIX && o->mix[0] == 0.0 && o->mix[1] == 0.0) return 0;
+    return 1;
+}
+
+static void evaluate(Rung *r, Candidate *c, int allow_stop) {
+    SimParams params = *r->base;
+    EvalCtx e = { .rung = r };
+    params.weights = c->w;
+    if (allow_stop) {
+        params.stop = tune_stop;
+        params.stop_ctx = &e;
+    }
+
+    SimStats s = run_simulation_ops(r->cfg, r->jobs, r->n_jobs,
+                                    &sched_hps_ops, &params);
+    c->makespan_us = s.makespan_us;
+    c->p99_slowdown = s.slowdown.p99;
+    c->fairness = s.fairness;
+    c->pruned = e.pruned;
+    c->score = e.pruned ? e.bound
+                        : score_of(r->opt, &r->ref, c->p99_slowdown,
+                                   c->makespan_us, 1.0 - c->fairness);
+    sim_stats_free(&s);
+
+    if (!c->pruned) {
+        pthread_mutex_lock(&r->lock);
+        if (c->score < r->best) r->best = c->score;
+        pthread_mutex_unlock(&r->lock);
+    }
+}
+
+/* ===================== WORKERS ===================== */
+
+static void *tune_worker(void *arg) {
+    Rung *r = arg;
+    int allow_stop = can_stop_early(r->opt);
+
+    for (;;) {
+        pthread_mutex_lock(&r->lock);
+        int i = r->next++;
+        pthread_mutex_unlock(&r->lock);
+        if (i >= r->n_cands) break;
+        evaluate(r, r->cands[i], allow_stop);
+    }
+    return NULL;
+}
+
+/* Evaluate a rung: the defaults first, as the reference and the first
+ * bar to beat, then the rest on `threads` workers. */
+static void run_rung(Rung *r, Candidate *defaults, int threads) {
+    Candidate ref = *defaults;
+    r->best = INFINITY;
+    r->ref = (Reference){ 0.0, 0.0, 0.0 };
+    evaluate(r, &ref, 0);
+    r->ref = (Reference){ ref.p99_slowdown, ref.makespan_us, 1.0 - ref.fairness };
+    ref.score = score_of(r->opt, &r->ref, ref.p99_slowdown, ref.makespan_us,
+                         1.0 - ref.fairness);
+    r->best = r->ref_score = ref.score;
+
+    // when the defaults are in this rung, that run was their evaluation
+    int n = r->n_cands;
+    for (int i = 0; i < n; i++) {
+        if (r->cands[i] == defaults) {
+            *defaults = ref;
+            r->cands[i] = r->cands[n - 1];
+            r->cands[n - 1] = defaults;
+            r->n_cands = n - 1;
+            break;
+        }
+    }
+
+    r->next = 0;
+    if (threads > r->n_cands) threads = r->n_cands > 0 ? r->n_cands : 1;
+    pthread_t *tids = malloc(threads * sizeof(pthread_t));
+    for (int t = 0; t < threads; t++)
+        pthread_create(&tids[t], NULL, tune_worker, r);
+    for (int t = 0; t < threads; t++)
+        pthread_join(tids[t], NULL);
+    free(tids);
+    r->n_cands = n;
+}
+
+static int by_score(const void *a, const void *b) {
+    const Candidate *x = *(Candidate *const *)a;
+    const Candidate *y = *(Candidate *const *)b;
+    // finished runs rank ahead of pruned ones
+    if (x->pruned != y->pruned) return x->pruned - y->pruned;
+    if (x->score != y->score) return x->score < y->score ? -1 : 1;
+    return x->id - y->id;
+}
+
+static void write_rung(FILE *f, int rung, const Rung *r) {
+    for (int i = 0; i < r->n_cands; i++) {
+        const Candidate *c = r->cands[i];
+        fprintf(f, "%d,%d,%d,%g,%g,%g,%g,%g,%s,%.2f,%.4f,%.4f,%.6g\n",
+                rung, r->n_jobs, c->id,
+                c->w.key_affinity, c->w.noise_urgency, c->w.bw_penalty,
+                c->w.fairness, c->w.deadline,
+                c->pruned ? "pruned" : "done",
+                c->makespan_us, c->p99_slowdown, c->fairness, c->score);
+    }
+}
+
+/* ===================== SEARCH ===================== */
+
+static double draw_weight(uint64_t *rng, double w_max) {
+    // splitmix64
+    uint64_t z = (*rng += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    z ^= z >> 31;
+    double u = (double)(z >> 11) / 9007199254740992.0;
+    // three decimals, so the printed weights reproduce the run
+    return round(u * w_max * 1000.0) / 1000.0;
+}
+
+int run_tune(const HwConfig *cfg, TfheJob *jobs, int n_jobs,
+             const TuneOptions *opt, const SimParams *base,
+             const char *out_path, HpsWeights *best)
+{
+    int budget = opt->budget > 1 ? opt->budget : 1;
+    int threads = opt->threads;
+    if (threads <= 0) threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads <= 0) threads = 1;
+
+    Candidate *all = calloc(budget, sizeof(Candidate));
+    Candidate **cands = malloc(budget * sizeof(Candidate *));
+    if (!all || !cands) {
+        free(all);
+        free(cands);
+        return -1;
+    }
+
+    uint64_t rng = opt->seed;
+    all[0].w = base->weights;
+    for (int i = 0; i < budget; i++) {
+        all[i].id = i;
+        if (i > 0) {
+            HpsWeights *w = &all[i].w;
+            w->key_affinity = draw_weight(&rng, opt->w_max);
+            w->noise_urgency = draw_weight(&rng, opt->w_max);
+            w->bw_penalty = draw_weight(&rng, opt->w_max);
+            w->fairness = draw_weight(&rng, opt->w_max);
+            w->deadline = draw_weight(&rng, opt->w_max);
+        }
+        cands[i] = &all[i];
+    }
+
+    // rungs of successive halving; random search is the one-rung case
+    int n_rungs = 1;
+    if (opt->method == TUNE_HALVING)
+        for (int k = budget; k > 1; k = (k + TUNE_ETA - 1) / TUNE_ETA) n_rungs++;
+
+    SimParams params = *base;
+    params.show_progress = 0;
+    params.csv_prefix = NULL;
+    params.counters = NULL;
+
+    FILE *f = out_path ? fopen(out_path, "w") : stdout;
+    if (!f) {
+        perror("fopen tune output");
+        free(all);
+        free(cands);
+        return -1;
+    }
+    fprintf(f, "rung,jobs,candidate,hps_w1,hps_w2,hps_w3,hps_w4,hps_w5,status,"
+               "makespan_us,p99_slowdown,fairness,score\n");
+    fprintf(stderr, "Tune: %d candidates, %d rung%s on %d threads\n",
+            budget, n_rungs, n_rungs > 1 ? "s" : "", threads);
+
+    Rung r = { .cfg = cfg, .jobs = jobs, .opt = opt, .base = &params };
+    pthread_mutex_init(&r.lock, NULL);
+    int n_cands = budget;
+    double default_score = 0.0;
+    for (int rung = 0; rung < n_rungs; rung++) {
+        double frac = pow(TUNE_ETA, rung - (n_rungs - 1));
+        r.n_jobs = (int)ceil(n_jobs * frac);
+        if (r.n_jobs < 1) r.n_jobs = n_jobs < 1 ? n_jobs : 1;
+        r.cands = cands;
+        r.n_cands = n_cands;
+
+        run_rung(&r, &all[0], threads);
+        qsort(cands, n_cands, sizeof(Candidate *), by_score);
+        write_rung(f, rung, &r);
+        fflush(f);
+
+        default_score = r.ref_score;
+        n_cands = (n_cands + TUNE_ETA - 1) / TUNE_ETA;
+    }
+    pthread_mutex_destroy(&r.lock);
+    if (f != stdout) fclose(f);
+
+    // prefixes can mislead successive halving: never end up worse than
+    // the defaults, which the last rung ran on the whole workload
+    const Candidate *w = cands[0];
+    if (w->pruned || w->score > default_score) {
+        all[0].score = default_score;
+        w = &all[0];
+    }
+    *best = w->w;
+    fprintf(stderr, "Best: candidate %d, score %.6g (defaults %.6g)\n",
+            w->id, w->score, default_score);
+    fprintf(stderr, "  --hps-w1 %g --hps-w2 %g --hps-w3 %g --hps-w4 %g --hps-w5 %g\n",
+            w->w.key_affinity, w->w.noise_urgency, w->w.bw_penalty,
+            w->w.fairness, w->w.deadline);
+
+    free(all);
+    free(cands);
+    return 0;
+}
@@ -0,0 +1,41 @@
+#include "../includes/uploads.h"
+
+static void set_open(const UploadCap *u, SchedContext *ctx)
+{
+    ctx->uploads = u->in_flight < u->engines + u->spare ? SCHED_UPLOADS_OPEN
+                                                        : SCHED_UPLOADS_CLOSED;
+}
+
+void upload_cap_begin(UploadCap *u, SchedContext *ctx, int num_engines)
+{
+    u->engines = num_engines;
+    u->spare = 0;
+    set_open(u, ctx);
+}
+
+int upload_cap_spare(UploadCap *u, SchedContext *ctx, int idle)
+{
+    // with uploads open the policy had nothing at all
+    if (ctx->uploads == SCHED_UPLOADS_OPEN || u->spare > 0) return 0;
+    u->spare = idle;
+    set_open(u, ctx);
+    return ctx->uploads == SCHED_UPLOADS_OPEN;
+}
+
+int upload_cap_ahead(UploadCap *u, SchedContext *ctx)
+{
+    if (u->in_flight > 0) return 0;
+    ctx->uploads = SCHED_UPLOADS_ONLY;
+    return 1;
+}
+
+void upload_cap_started(UploadCap *u, SchedContext *ctx)
+{
+    u->in_flight++;
+    set_open(u, ctx);
+}
+
+void upload_cap_landed(UploadCap *u)
+{
+    u->in_flight--;
+}
@@ -1,7 +1,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <float.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "../includes/workload.h"
+#include "../includes/trace_bin.h"
 
 static int cmp_arrival(const void *a, const void *b) {
     const TfheJob *ja = a;
@@ -11,50 +19,429 @@ static int cmp_arrival(const void *a, const void *b) {
     return 0;
 }
 
-int read_workload(const char *path, TfheJob **jobs_out, int *n_jobs_out) {
-    FILE *f = fopen(path, "r");
-    if (!f) {
-        perror("fopen workload");
+/* ===================== TRACE BUFFER ===================== */
+
+// The whole trace, mapped read-only.  Inputs that cannot be mapped
+// (pipes, /dev/stdin) are read into a heap buffer instead.
+typedef struct {
+    char *data;
+    size_t len;
+    int mapped;
+} TraceBuf;
+
+static int trace_open(const char *path, TraceBuf *tb) {
+    tb->data = NULL;
+    tb->len = 0;
+    tb->mapped = 0;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror("open workload");
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        if (st.st_size == 0) {
+            close(fd);
+            return 0;
+        }
+        void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            madvise(p, st.st_size, MADV_SEQUENTIAL);
+            tb->data = p;
+            tb->len = st.st_size;
+            tb->mapped = 1;
+            close(fd);
+            return 0;
+        }
+    }
+
+    size_t cap = 1 << 16;
+    char *buf = malloc(cap);
+    ssize_t r;
+    while ((r = read(fd, buf + tb->len, cap - tb->len)) > 0) {
+        tb->len += r;
+        if (tb->len == cap) {
+            cap *= 2;
+            buf = realloc(buf, cap);
+        }
+    }
+    close(fd);
+    if (r < 0) {
+        perror("read workload");
+        free(buf);
         return -1;
     }
+    tb->data = buf;
+    return 0;
+}
 
-    int cap = 16, n = 0;
-    TfheJob *jobs = malloc(cap * sizeof(TfheJob));
+static void trace_close(TraceBuf *tb) {
+    if (tb->mapped) munmap(tb->data, tb->len);
+    else free(tb->data);
+    tb->data = NULL;
+}
 
-    char line[512];
-    while (fgets(line, sizeof(line), f)) {
-        if (line[0] == '#' || line[0] == '\n') continue;
+/* ===================== LINE PARSER ===================== */
 
-        TfheJob j;
-        int parsed = sscanf(line, "%d %d %lf %d %lf %lf %d %lf",
-                            &j.id, &j.tenant_id, &j.arrival_time_us,
-                            &j.num_bootstraps, &j.key_size_mb,
-                            &j.noise_budget, &j.priority, &j.deadline_us);
+static int is_blank(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
 
-        if (parsed < 7) {
-            fprintf(stderr, "Invalid workload line: %s\n", line);
-            free(jobs);
-            fclose(f);
-            return -1;
+static int next_token(const char **p, const char *eol,
+                      const char **tok, size_t *len) {
+    const char *s = *p;
+    while (s < eol && is_blank(*s)) s++;
+    const char *t = s;
+    while (t < eol && !is_blank(*t)) t++;
+    *tok = s;
+    *len = t - s;
+    *p = t;
+    return t > s;
+}
+
+static int parse_int(const char *s, size_t len, int *out) {
+    size_t i = 0;
+    int neg = 0;
+    if (s[i] == '+' || s[i] == '-') neg = s[i++] == '-';
+    if (i == len) return 0;
+
+    long long v = 0;
+    for (; i < len; i++) {
+        if (s[i] < '0' || s[i] > '9') return 0;
+        v = v * 10 + (s[i] - '0');
+        if (v > (long long)INT_MAX + 1) return 0;
+    }
+    if (neg) v = -v;
+    if (v > INT_MAX) return 0;
+    *out = (int)v;
+    return 1;
+}
+
+static const double pow10_exact[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/* Decimal to double.  Plain decimals take Clinger's fast path: when the
+ * digits fit in 53 bits and the power of ten is exact, a single multiply
+ * or divide is correctly rounded.  Anything else goes through strtod, so
+ * values are always the ones scanf("%lf") would produce. */
+static int parse_double(const char *s, size_t len, double *out) {
+    size_t i = 0;
+    int neg = 0;
+    if (s[i] == '+' || s[i] == '-') neg = s[i++] == '-';
+
+    uint64_t mant = 0;
+    int digits = 0, exp10 = 0, any = 0, slow = 0;
+    for (; i < len && s[i] >= '0' && s[i] <= '9'; i++) {
+        any = 1;
+        if (mant == 0 && s[i] == '0') continue;
+        if (++digits > 19) { slow = 1; break; }
+        mant = mant * 10 + (s[i] - '0');
+    }
+    if (!slow && i < len && s[i] == '.') {
+        for (i++; i < len && s[i] >= '0' && s[i] <= '9'; i++) {
+            any = 1;
+            exp10--;
+            if (mant == 0 && s[i] == '0') continue;
+            if (++digits > 19) { slow = 1; break; }
+            mant = mant * 10 + (s[i] - '0');
         }
-        if (parsed == 7) j.deadline_us = 0;
+    }
+    if (!slow && any && i < len && (s[i] == 'e' || s[i] == 'E')) {
+        size_t k = i + 1;
+        int eneg = 0, e = 0;
+        if (k < len && (s[k] == '+' || s[k] == '-')) eneg = s[k++] == '-';
+        if (k == len) slow = 1;
+        for (; k < len && s[k] >= '0' && s[k] <= '9'; k++)
+            if (e < 10000) e = e * 10 + (s[k] - '0');
+        exp10 += eneg ? -e : e;
+        i = k;
+    }
 
-        j.remaining_bootstraps = j.num_bootstraps;
-        j.start_time_us = -1;
-        j.completion_time_us = -1;
-        j.started = 0;
+    if (!slow && any && i == len && mant <= (1ULL << 53) &&
+        exp10 >= -22 && exp10 <= 22) {
+        double v = (double)mant;
+        v = exp10 < 0 ? v / pow10_exact[-exp10] : v * pow10_exact[exp10];
+        *out = neg ? -v : v;
+        return 1;
+    }
 
-        if (n == cap) {
-            cap *= 2;
-            jobs = realloc(jobs, cap * sizeof(TfheJob));
+    char buf[128];
+    if (len >= sizeof(buf)) return 0;
+    memcpy(buf, s, len);
+    buf[len] = '\0';
+    char *endp;
+    double v = strtod(buf, &endp);
+    if (endp != buf + len) return 0;
+    *out = v;
+    return 1;
+}
+
+/* Fields in file order; parsing stops at the first missing or malformed
+ * one and returns how many were read, like the sscanf it replaces. */
+static int parse_fields(const char *p, const char *eol, TfheJob *j) {
+    static const char kind[] = "iididdidi";
+    void *dst[] = {
+        &j->id, &j->tenant_id, &j->arrival_time_us, &j->num_bootstraps,
+        &j->key_size_mb, &j->noise_budget, &j->priority, &j->deadline_us,
+        &j->key_id
+    };
+
+    int n;
+    for (n = 0; n < 9; n++) {
+        const char *tok;
+        size_t len;
+        if (!next_token(&p, eol, &tok, &len)) break;
+        int ok = kind[n] == 'i' ? parse_int(tok, len, dst[n])
+                                : parse_double(tok, len, dst[n]);
+        if (!ok) break;
+    }
+    return n;
+}
+
+/* Parse the line [line, eol).  Returns 1 for a job, 0 for a blank or
+ * comment line and -1 for a malformed one. */
+static int read_job(const char *line, const char *eol, TfheJob *j) {
+    const char *p = line;
+    while (p < eol && is_blank(*p)) p++;
+    if (p == eol || line[0] == '#') return 0;
+
+    int parsed = parse_fields(line, eol, j);
+    if (parsed < 7) {
+        fprintf(stderr, "Invalid workload line: %.*s\n", (int)(eol - line), line);
+        return -1;
+    }
+    if (parsed == 7) j->deadline_us = 0;
+    if (parsed < 9) j->key_id = -1;
+
+    j->remaining_bootstraps = j->num_bootstraps;
+    j->start_time_us = -1;
+    j->completion_time_us = -1;
+    j->started = 0;
+    j->pcie_transferred = 0;
+    return 1;
+}
+
+int workload_parse_line(const char *line, const char *eol, TfheJob *job) {
+    return read_job(line, eol, job);
+}
+
+/* Next job in the text buffer at *p, skipping blank and comment lines.
+ * Returns 1 for a job, 0 at the end and -1 on a malformed line. */
+static int next_text_job(const char **p, const char *end, TfheJob *j) {
+    while (*p < end) {
+        const char *line = *p;
+        const char *eol = memchr(line, '\n', end - line);
+        if (!eol) eol = end;
+        *p = eol < end ? eol + 1 : end;
+
+        int rc = read_job(line, eol, j);
+        if (rc != 0) return rc;
+    }
+    return 0;
+}
+
+/* ===================== WHOLE-TRACE READER ===================== */
+
+int read_workload(const char *path, TfheJob **jobs_out, int *n_jobs_out) {
+    TraceBuf tb;
+    if (trace_open(path, &tb) != 0)
+        return -1;
+
+    int bin = trace_bin_check(tb.data, tb.len);
+    if (bin < 0) {
+        trace_close(&tb);
+        return -1;
+    }
+
+    int cap = 16, n = 0, sorted = 1;
+    TfheJob *jobs;
+
+    if (bin) {
+        const TraceBinHeader *h = (const TraceBinHeader *)tb.data;
+        if (h->n_jobs > INT_MAX) {
+            fprintf(stderr, "Binary workload has %llu jobs; use --stream\n",
+                    (unsigned long long)h->n_jobs);
+            trace_close(&tb);
+            return -1;
+        }
+        n = (int)h->n_jobs;
+        sorted = (h->flags & TRACE_BIN_SORTED) != 0;
+        jobs = malloc((n > 0 ? n : 1) * sizeof(TfheJob));
+        for (int k = 0; k < n; k++)
+            trace_bin_job(tb.data, k, &jobs[k]);
+    } else {
+        jobs = malloc(cap * sizeof(TfheJob));
+        const char *p = tb.data, *end = tb.data + tb.len;
+        TfheJob j;
+        int rc;
+        while ((rc = next_text_job(&p, end, &j)) > 0) {
+            if (n == cap) {
+                cap *= 2;
+                jobs = realloc(jobs, cap * sizeof(TfheJob));
+            }
+            if (n > 0 && j.arrival_time_us < jobs[n - 1].arrival_time_us)
+                sorted = 0;
+            jobs[n++] = j;
+        }
+        if (rc < 0) {
+            free(jobs);
+            trace_close(&tb);
+            return -1;
         }
-        jobs[n++] = j;
     }
-    fclose(f);
+    trace_close(&tb);
 
-    qsort(jobs, n, sizeof(TfheJob), cmp_arrival);
+    if (!sorted)
+        qsort(jobs, n, sizeof(TfheJob), cmp_arrival);
 
     *jobs_out = jobs;
     *n_jobs_out = n;
     return 0;
 }
+
+/* ===================== STREAMING READER ===================== */
+
+// give parsed pages back every this many bytes (text) or rows (binary)
+#define STREAM_RELEASE_BYTES ((size_t)64 << 20)
+#define STREAM_RELEASE_ROWS  ((uint64_t)1 << 20)
+
+typedef struct {
+    TraceBuf tb;
+    int binary;
+    size_t pos;         // text: offset of the next line; binary: next row
+    size_t released;    // text: page-aligned prefix given back; binary: rows
+    double last_arrival;
+} TraceStream;
+
+static void stream_release(TraceStream *ts) {
+    if (!ts->tb.mapped) return;
+
+    if (ts->binary) {
+        if (ts->pos - ts->released < STREAM_RELEASE_ROWS) return;
+        trace_bin_release(ts->tb.data, ts->released, ts->pos);
+        ts->released = ts->pos;
+        return;
+    }
+
+    if (ts->pos - ts->released < STREAM_RELEASE_BYTES) return;
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t upto = ts->pos / page * page;
+    madvise(ts->tb.data + ts->released, upto - ts->released, MADV_DONTNEED);
+    ts->released = upto;
+}
+
+static int stream_next(JobSource *src, TfheJob *job) {
+    TraceStream *ts = src->ctx;
+
+    if (ts->binary) {
+        const TraceBinHeader *h = (const TraceBinHeader *)ts->tb.data;
+        if (ts->pos >= h->n_jobs) return 0;
+        trace_bin_job(ts->tb.data, ts->pos++, job);
+    } else {
+        const char *p = ts->tb.data + ts->pos;
+        int rc = next_text_job(&p, ts->tb.data + ts->tb.len, job);
+        ts->pos = p - ts->tb.data;
+        if (rc <= 0) return rc;
+    }
+
+    if (job->arrival_time_us < ts->last_arrival) {
+        fprintf(stderr, "Workload is not sorted by arrival time "
+                        "(job %d); streaming needs a sorted trace\n",
+                job->id);
+        return -1;
+    }
+    ts->last_arrival = job->arrival_time_us;
+    stream_release(ts);
+    return 1;
+}
+
+int workload_stream_open(const char *path, JobSource *src) {
+    TraceStream *ts = calloc(1, sizeof(TraceStream));
+    if (!ts) return -1;
+    if (trace_open(path, &ts->tb) != 0) {
+        free(ts);
+        return -1;
+    }
+
+    int bin = trace_bin_check(ts->tb.data, ts->tb.len);
+    if (bin < 0) {
+        trace_close(&ts->tb);
+        free(ts);
+        return -1;
+    }
+    ts->binary = bin;
+    ts->last_arrival = -DBL_MAX;
+
+    src->next = stream_next;
+    src->ctx = ts;
+    return 0;
+}
+
+void workload_stream_close(JobSource *src) {
+    TraceStream *ts = src->ctx;
+    if (!ts) return;
+    trace_close(&ts->tb);
+    free(ts);
+    src->ctx = NULL;
+}
+
+/* ===================== BINARY CONVERTER ===================== */
+
+int workload_convert(const char *in_path, const char *out_path) {
+    TraceBuf tb;
+    if (trace_open(in_path, &tb) != 0)
+        return -1;
+
+    int bin = trace_bin_check(tb.data, tb.len);
+    if (bin != 0) {
+        if (bin > 0) fprintf(stderr, "%s is already a binary workload\n", in_path);
+        trace_close(&tb);
+        return -1;
+    }
+
+    // first pass: count jobs and check the order
+    const char *p = tb.data, *end = tb.data + tb.len;
+    uint64_t n = 0;
+    int sorted = 1, rc;
+    double last = -DBL_MAX;
+    TfheJob j;
+    while ((rc = next_text_job(&p, end, &j)) > 0) {
+        if (j.arrival_time_us < last) sorted = 0;
+        last = j.arrival_time_us;
+        n++;
+    }
+    if (rc < 0) {
+        trace_close(&tb);
+        return -1;
+    }
+
+    TraceBinWriter *w = trace_bin_writer_open(out_path, n);
+    if (!w) {
+        trace_close(&tb);
+        return -1;
+    }
+
+    if (sorted) {
+        // second pass straight from the mapping
+        p = tb.data;
+        while (next_text_job(&p, end, &j) > 0)
+            trace_bin_writer_add(w, &j);
+        trace_close(&tb);
+    } else {
+        // unsorted traces have to be held in memory to sort them
+        trace_close(&tb);
+        TfheJob *jobs;
+        int n_jobs;
+        if (read_workload(in_path, &jobs, &n_jobs) == 0) {
+            for (int k = 0; k < n_jobs; k++)
+                trace_bin_writer_add(w, &jobs[k]);
+            free(jobs);
+        }
+    }
+
+    return trace_bin_writer_close(w);
+}